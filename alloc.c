@@ -0,0 +1,201 @@
+#include "alloc.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// sits right before every block and remembers its size and where the
+// underlying allocation starts. the union keeps the block as aligned as
+// malloc would
+typedef union MemHeader {
+  struct {
+    size_t size;
+    size_t offset; // from the start of the allocation to the block
+  };
+  max_align_t align;
+} MemHeader;
+
+static struct {
+  size_t max;
+  MemErrorFn onError;
+  atomic_size_t live;
+  atomic_size_t peak;
+  atomic_long allocs;
+  atomic_long frees;
+} mem;
+
+void setMaxHeap(size_t bytes) { mem.max = bytes; }
+
+size_t maxHeap(void) { return mem.max; }
+
+void setMemErrorHandler(MemErrorFn fn) { mem.onError = fn; }
+
+static void memoryError(const char *message) {
+  if (mem.onError) {
+    mem.onError(message);
+  }
+  fflush(stdout);
+  fprintf(stderr, "%s\n", message);
+  exit(EXIT_FAILURE);
+}
+
+// counts size bytes as in use, or ends the script if they do not fit
+static void reserve(size_t size) {
+  size_t live =
+      atomic_fetch_add_explicit(&mem.live, size, memory_order_relaxed) + size;
+  if (mem.max && live > mem.max) {
+    char message[128];
+    snprintf(message, sizeof(message),
+             "MemoryError: script heap limit of %zu bytes exceeded (%zu "
+             "bytes in use)",
+             mem.max, live - size);
+    memoryError(message);
+  }
+
+  size_t peak = atomic_load_explicit(&mem.peak, memory_order_relaxed);
+  while (live > peak &&
+         !atomic_compare_exchange_weak_explicit(
+             &mem.peak, &peak, live, memory_order_relaxed,
+             memory_order_relaxed)) {
+  }
+}
+
+static void release(size_t size) {
+  atomic_fetch_sub_explicit(&mem.live, size, memory_order_relaxed);
+}
+
+static void *outOfMemory(size_t size) {
+  char message[96];
+  snprintf(message, sizeof(message), "MemoryError: failed allocating %zu bytes",
+           size);
+  memoryError(message);
+  return NULL;
+}
+
+void *memAlloc(size_t size) {
+  reserve(size);
+  MemHeader *header = (MemHeader *)malloc(sizeof(MemHeader) + size);
+  if (!header) {
+    return outOfMemory(size);
+  }
+  header->size = size;
+  header->offset = sizeof(MemHeader);
+  atomic_fetch_add_explicit(&mem.allocs, 1, memory_order_relaxed);
+  return header + 1;
+}
+
+void *memAlignedAlloc(size_t alignment, size_t size) {
+  if (alignment < sizeof(MemHeader)) {
+    alignment = sizeof(MemHeader);
+  }
+  // the header takes a whole alignment unit in front of the block
+  size_t total = (alignment + size + alignment - 1) & ~(alignment - 1);
+  reserve(size);
+  char *base = (char *)aligned_alloc(alignment, total);
+  if (!base) {
+    return outOfMemory(size);
+  }
+  MemHeader *header = (MemHeader *)(base + alignment) - 1;
+  header->size = size;
+  header->offset = alignment;
+  atomic_fetch_add_explicit(&mem.allocs, 1, memory_order_relaxed);
+  return base + alignment;
+}
+
+void *memCalloc(size_t count, size_t size) {
+  if (size && count > ((size_t)-1 - sizeof(MemHeader)) / size) {
+    return outOfMemory((size_t)-1);
+  }
+  void *ptr = memAlloc(count * size);
+  memset(ptr, 0, count * size);
+  return ptr;
+}
+
+void *memRealloc(void *ptr, size_t size) {
+  if (!ptr) {
+    return memAlloc(size);
+  }
+
+  MemHeader *header = (MemHeader *)ptr - 1;
+  size_t old = header->size;
+  if (header->offset != sizeof(MemHeader)) {
+    // aligned blocks cannot go through realloc, they are copied
+    void *copy = memAlloc(size);
+    memcpy(copy, ptr, old < size ? old : size);
+    memFree(ptr);
+    return copy;
+  }
+  if (size > old) {
+    reserve(size - old);
+  }
+  MemHeader *grown = (MemHeader *)realloc(header, sizeof(MemHeader) + size);
+  if (!grown) {
+    return outOfMemory(size);
+  }
+  if (size < old) {
+    release(old - size);
+  }
+  grown->size = size;
+  return grown + 1;
+}
+
+char *memStrdup(const char *value) {
+  size_t length = strlen(value) + 1;
+  char *copy = (char *)memAlloc(length);
+  memcpy(copy, value, length);
+  return copy;
+}
+
+void memFree(void *ptr) {
+  if (!ptr) {
+    return;
+  }
+  MemHeader *header = (MemHeader *)ptr - 1;
+  release(header->size);
+  atomic_fetch_add_explicit(&mem.frees, 1, memory_order_relaxed);
+  free((char *)ptr - header->offset);
+}
+
+MemStats memStats(void) {
+  MemStats stats;
+  stats.live = atomic_load(&mem.live);
+  stats.peak = atomic_load(&mem.peak);
+  stats.allocs = atomic_load(&mem.allocs);
+  stats.frees = atomic_load(&mem.frees);
+  return stats;
+}
+
+size_t memRoom(void) {
+  if (!mem.max) {
+    return 0;
+  }
+  size_t live = atomic_load_explicit(&mem.live, memory_order_relaxed);
+  return live < mem.max ? mem.max - live : 1;
+}
+
+size_t parseSize(const char *text) {
+  char *end;
+  double value = strtod(text, &end);
+  switch (*end) {
+  case 'k':
+  case 'K':
+    value *= 1024;
+    end++;
+    break;
+  case 'm':
+  case 'M':
+    value *= 1024 * 1024;
+    end++;
+    break;
+  case 'g':
+  case 'G':
+    value *= 1024.0 * 1024 * 1024;
+    end++;
+    break;
+  }
+  if (end == text || *end != '\0' || value < 1) {
+    return 0;
+  }
+  return (size_t)value;
+}
@@ -0,0 +1,42 @@
+#ifndef ALLOC_H_
+#define ALLOC_H_
+
+#include <stddef.h>
+
+// every allocation of the interpreter goes through these so the bytes in use
+// can be counted and capped with --max-heap. a block that would go over the
+// cap ends the script with a MemoryError instead of growing the process. the
+// pointers must be released with memFree, never with free
+
+void *memAlloc(size_t size);
+void *memCalloc(size_t count, size_t size);
+void *memRealloc(void *ptr, size_t size);
+// alignment must be a power of two
+void *memAlignedAlloc(size_t alignment, size_t size);
+char *memStrdup(const char *value);
+void memFree(void *ptr);
+
+// 0 means no cap
+void setMaxHeap(size_t bytes);
+
+// reports a MemoryError and ends the script. the evaluator installs one that
+// names the line it was running, without one the message goes to stderr
+typedef void (*MemErrorFn)(const char *message);
+void setMemErrorHandler(MemErrorFn fn);
+size_t maxHeap(void);
+
+typedef struct MemStats {
+  size_t live;  // bytes held right now
+  size_t peak;  // most bytes ever held at once
+  long allocs;  // blocks handed out
+  long frees;   // blocks given back
+} MemStats;
+
+MemStats memStats(void);
+
+// bytes left under the cap, or 0 when there is none
+size_t memRoom(void);
+
+// parses sizes like 4096, 512k, 64m or 2g, returns 0 when it is not one
+size_t parseSize(const char *text);
+#endif // ALLOC_H_
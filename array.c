@@ -0,0 +1,106 @@
+#include "array.h"
+#include "alloc.h"
+#include "gc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *allocPayload(size_t bytes) {
+  size_t mask = ARRAY_ALIGNMENT - 1;
+  size_t rounded = (bytes + mask) & ~mask;
+  if (rounded == 0) {
+    rounded = ARRAY_ALIGNMENT;
+  }
+
+  void *payload = memAlignedAlloc(ARRAY_ALIGNMENT, rounded);
+  if (!payload) {
+    printf("failed allocating memory for array of %zu bytes\n", bytes);
+    exit(EXIT_FAILURE);
+  }
+  gcTrack(rounded);
+  return payload;
+}
+
+static size_t elementSize(Array *arr) {
+  return arr->kind == ARRAY_NUMBER ? sizeof(double) : sizeof(char *);
+}
+
+Array *newArray(ArrayKind kind, int capacity, int isFixed) {
+  Array *arr = (Array *)gcAlloc(GC_ARRAY, sizeof(Array));
+  memset(arr, 0, sizeof(Array));
+  arr->kind = kind;
+  arr->isFixed = isFixed;
+
+  if (capacity < ARRAY_MIN_CAPACITY && !isFixed) {
+    capacity = ARRAY_MIN_CAPACITY;
+  }
+  arr->capacity = capacity;
+
+  size_t bytes = elementSize(arr) * capacity;
+  arr->numbers = allocPayload(bytes);
+  memset(arr->numbers, 0, bytes);
+  return arr;
+}
+
+// grows the payload to at least capacity, doubling so that appends stay
+// amortized O(1). realloc cannot keep the alignment, so the payload is copied
+void arrayReserve(Array *arr, int capacity) {
+  if (capacity <= arr->capacity) {
+    return;
+  }
+
+  int newCapacity = arr->capacity ? arr->capacity : ARRAY_MIN_CAPACITY;
+  while (newCapacity < capacity) {
+    newCapacity *= 2;
+  }
+
+  size_t used = elementSize(arr) * arr->length;
+  size_t bytes = elementSize(arr) * newCapacity;
+  void *payload = allocPayload(bytes);
+  memcpy(payload, arr->numbers, used);
+  memset((char *)payload + used, 0, bytes - used);
+
+  memFree(arr->numbers);
+  arr->numbers = payload;
+  arr->capacity = newCapacity;
+}
+
+void arrayPushNumber(Array *arr, double value) {
+  arrayReserve(arr, arr->length + 1);
+  arr->numbers[arr->length++] = value;
+}
+
+void arrayPushString(Array *arr, char *value) {
+  arrayReserve(arr, arr->length + 1);
+  arr->strings[arr->length++] = value;
+}
+
+size_t arrayPayloadBytes(const Array *arr) {
+  size_t element = arr->kind == ARRAY_NUMBER ? sizeof(double) : sizeof(char *);
+  return element * arr->capacity;
+}
+
+// the array itself and its strings belong to the collector
+void freeArrayPayload(Array *arr) { memFree(arr->numbers); }
+
+// replaces the elements of dst with the ones of src. dst keeps its identity
+// so nodes that cached it stay valid; strings are shared, not copied
+void arrayCopy(Array *dst, const Array *src) {
+  if (dst->kind == ARRAY_STRING) {
+    for (int i = 0; i < dst->length; i++) {
+      dst->strings[i] = NULL;
+    }
+  }
+  dst->length = 0;
+  arrayReserve(dst, src->length);
+
+  if (src->kind == ARRAY_NUMBER) {
+    memcpy(dst->numbers, src->numbers, sizeof(double) * src->length);
+  } else {
+    for (int i = 0; i < src->length; i++) {
+      dst->strings[i] = src->strings[i];
+    }
+  }
+  dst->length = src->length;
+}
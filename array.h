@@ -0,0 +1,34 @@
+#ifndef ARRAY_H_
+#define ARRAY_H_
+
+#include <stddef.h>
+
+// payloads are aligned so whole-array kernels can use vector loads
+#define ARRAY_ALIGNMENT 64
+#define ARRAY_MIN_CAPACITY 8
+
+typedef enum ArrayKind {
+  ARRAY_NUMBER,
+  ARRAY_STRING,
+} ArrayKind;
+
+// a script array: `length` elements in use out of `capacity` allocated
+typedef struct Array {
+  ArrayKind kind;
+  int length;
+  int capacity;
+  int isFixed; // fixed arrays never grow past their declared size
+  union {
+    double *numbers; // unboxed, ARRAY_ALIGNMENT aligned
+    char **strings;
+  };
+} Array;
+
+Array *newArray(ArrayKind kind, int capacity, int isFixed);
+void arrayReserve(Array *arr, int capacity);
+void arrayPushNumber(Array *arr, double value);
+void arrayPushString(Array *arr, char *value);
+void arrayCopy(Array *dst, const Array *src);
+size_t arrayPayloadBytes(const Array *arr);
+void freeArrayPayload(Array *arr);
+#endif // ARRAY_H_
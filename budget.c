@@ -0,0 +1,84 @@
+#include "budget.h"
+#include "interpreter.h"
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TRACE_DEPTH 8 // calls listed when the script is stopped
+
+static struct {
+  long maxSteps;
+  atomic_long stepsLeft;
+  double timeout;
+  double deadline;
+} budget;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void setStepLimit(long steps) {
+  budget.maxSteps = steps;
+  atomic_store(&budget.stepsLeft, steps);
+}
+
+void setTimeLimit(double seconds) {
+  budget.timeout = seconds;
+  budget.deadline = seconds > 0 ? now() + seconds : 0;
+}
+
+// prints the calls that led to the stopped node, innermost first
+static void printTrace(EvalStack *s) {
+  int shown = 0;
+  for (int i = s->frameCount - 1; i >= 0 && shown < TRACE_DEPTH; i--) {
+    EvalFrame *f = &s->frames[i];
+    // state 2 is a script function running its body
+    if (f->node->type == NODE_FUNCTION_CALL && f->state == 2) {
+      fprintf(stderr, "  in %s called at %s:%d\n",
+              f->node->function.call.name, nodeLoc(f->node).file_name,
+              nodeLoc(f->node).row);
+      shown++;
+    }
+  }
+}
+
+static void stop(EvalStack *s, AstNode *node, int code, const char *what) {
+  printEvalError(nodeLoc(node), "%s", what);
+  fflush(stdout);
+  printTrace(s);
+  exit(code);
+}
+
+void refuel(EvalStack *s, AstNode *node) {
+  if (budget.deadline && now() > budget.deadline) {
+    char what[96];
+    snprintf(what, sizeof(what), "TimeoutError: --timeout of %gs exceeded",
+             budget.timeout);
+    stop(s, node, EXIT_TIMEOUT, what);
+  }
+
+  if (!budget.maxSteps) {
+    s->fuel = budget.deadline ? BUDGET_CHUNK : LONG_MAX;
+    return;
+  }
+
+  long left = atomic_load(&budget.stepsLeft);
+  long take;
+  do {
+    if (left <= 0) {
+      char what[96];
+      snprintf(what, sizeof(what),
+               "StepLimitError: --max-steps of %ld exceeded", budget.maxSteps);
+      stop(s, node, EXIT_STEP_LIMIT, what);
+    }
+    take = left < BUDGET_CHUNK ? left : BUDGET_CHUNK;
+  } while (!atomic_compare_exchange_weak(&budget.stepsLeft, &left,
+                                         left - take));
+  // this step is paid from the chunk too
+  s->fuel = take - 1;
+}
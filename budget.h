@@ -0,0 +1,28 @@
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+#include "common.h"
+
+// --max-steps and --timeout. every evaluator spends fuel at loop back edges
+// and function entries; only when its fuel runs out does it come here to
+// take another chunk of the step budget and look at the clock
+
+#define BUDGET_CHUNK 4096 // steps an evaluator takes from the budget at once
+
+#define EXIT_STEP_LIMIT 3
+#define EXIT_TIMEOUT 4
+
+// 0 leaves the limit off
+void setStepLimit(long steps);
+void setTimeLimit(double seconds);
+
+// refills s->fuel or ends the script with a report of where node ran
+void refuel(EvalStack *s, AstNode *node);
+
+// the hot path: a decrement and a branch
+static inline void spendStep(EvalStack *s, AstNode *node) {
+  if (--s->fuel < 0) {
+    refuel(s, node);
+  }
+}
+#endif // BUDGET_H_
@@ -0,0 +1,187 @@
+#include "builtin.h"
+#include "alloc.h"
+#include "array.h"
+#include "channel.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "vector.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static Result numberResult(double value) {
+  return newResult(gcNumber(value), NODE_NUMBER);
+}
+
+// the argument at index as a number array, anything else is an error
+static Array *numberArrayArg(AstNode *node, Result *args, int index) {
+  Result arg = args[index];
+  if (arg.NodeType != NODE_ARRAY_VALUE ||
+      ((Array *)arg.result)->kind != ARRAY_NUMBER) {
+    printEvalError(nodeLoc(node),
+                   "%s expects number[] as argument %d but got %s",
+                   node->function.call.name, index + 1, getDataType(arg));
+    exit(EXIT_FAILURE);
+  }
+  return (Array *)arg.result;
+}
+
+static Array *nonEmptyArg(AstNode *node, Result *args) {
+  Array *arr = numberArrayArg(node, args, 0);
+  if (arr->length == 0) {
+    printEvalError(nodeLoc(node), "%s of an empty array",
+                   node->function.call.name);
+    exit(EXIT_FAILURE);
+  }
+  return arr;
+}
+
+static Result builtinLen(AstNode *node, Result *args) {
+  if (args[0].NodeType != NODE_ARRAY_VALUE) {
+    printEvalError(nodeLoc(node), "len expects an array but got %s",
+                   getDataType(args[0]));
+    exit(EXIT_FAILURE);
+  }
+  return numberResult(((Array *)args[0].result)->length);
+}
+
+static Result builtinSum(AstNode *node, Result *args) {
+  Array *arr = numberArrayArg(node, args, 0);
+  return numberResult(vectorOps()->sum(arr->numbers, arr->length));
+}
+
+static Result builtinMean(AstNode *node, Result *args) {
+  Array *arr = nonEmptyArg(node, args);
+  return numberResult(vectorOps()->sum(arr->numbers, arr->length) /
+                      arr->length);
+}
+
+static Result builtinMin(AstNode *node, Result *args) {
+  Array *arr = nonEmptyArg(node, args);
+  return numberResult(vectorOps()->min(arr->numbers, arr->length));
+}
+
+static Result builtinMax(AstNode *node, Result *args) {
+  Array *arr = nonEmptyArg(node, args);
+  return numberResult(vectorOps()->max(arr->numbers, arr->length));
+}
+
+static Result builtinDot(AstNode *node, Result *args) {
+  Array *a = numberArrayArg(node, args, 0);
+  Array *b = numberArrayArg(node, args, 1);
+  if (a->length != b->length) {
+    printEvalError(nodeLoc(node), "dot of arrays with lengths %d and %d",
+                   a->length, b->length);
+    exit(EXIT_FAILURE);
+  }
+  return numberResult(vectorOps()->dot(a->numbers, b->numbers, a->length));
+}
+
+// heapUsed(), heapPeak() and heapAllocs() read the allocation counters
+static Result builtinHeapUsed(AstNode *node, Result *args) {
+  (void)node;
+  (void)args;
+  return numberResult(memStats().live);
+}
+
+static Result builtinHeapPeak(AstNode *node, Result *args) {
+  (void)node;
+  (void)args;
+  return numberResult(memStats().peak);
+}
+
+static Result builtinHeapAllocs(AstNode *node, Result *args) {
+  (void)node;
+  (void)args;
+  return numberResult(memStats().allocs);
+}
+
+static const Builtin builtins[] = {
+    {"len", 1, builtinLen, NULL, TYPE_NUMBER, 1},
+    {"sum", 1, builtinSum, NULL, TYPE_NUMBER, 1},
+    {"mean", 1, builtinMean, NULL, TYPE_NUMBER, 1},
+    {"min", 1, builtinMin, NULL, TYPE_NUMBER, 1},
+    {"max", 1, builtinMax, NULL, TYPE_NUMBER, 1},
+    {"dot", 2, builtinDot, NULL, TYPE_NUMBER, 1},
+    {"chan", 1, builtinChan, NULL, TYPE_NUMBER, 0},
+    {"close", 1, builtinClose, NULL, TYPE_UNKNOWN, 0},
+    {"send", 2, NULL, builtinSend, TYPE_UNKNOWN, 0},
+    {"recv", 1, NULL, builtinRecv, TYPE_UNKNOWN, 0},
+    {"more", 1, NULL, builtinMore, TYPE_NUMBER, 0},
+    {"heapUsed", 0, builtinHeapUsed, NULL, TYPE_NUMBER, 0},
+    {"heapPeak", 0, builtinHeapPeak, NULL, TYPE_NUMBER, 0},
+    {"heapAllocs", 0, builtinHeapAllocs, NULL, TYPE_NUMBER, 0},
+};
+
+const Builtin *lookupBuiltin(const char *name) {
+  for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+    if (strcmp(builtins[i].name, name) == 0) {
+      return &builtins[i];
+    }
+  }
+  return NULL;
+}
+
+static int vectorOpOf(TokenType op, int scalarOnLeft, VectorOp *out) {
+  switch (op) {
+  case TOKEN_PLUS:
+    *out = VEC_ADD;
+    return 1;
+  case TOKEN_MINUS:
+    *out = scalarOnLeft ? VEC_RSUB : VEC_SUB;
+    return 1;
+  case TOKEN_MULTIPLY:
+    *out = VEC_MUL;
+    return 1;
+  case TOKEN_DIVIDE:
+    *out = scalarOnLeft ? VEC_RDIV : VEC_DIV;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int isNumberArray(Result res) {
+  return res.NodeType == NODE_ARRAY_VALUE &&
+         ((Array *)res.result)->kind == ARRAY_NUMBER;
+}
+
+Result evalArrayOp(AstNode *node, Result left, Result right) {
+  int scalarOnLeft = left.NodeType == NODE_NUMBER;
+  int valid = (isNumberArray(left) || scalarOnLeft) &&
+              (isNumberArray(right) || right.NodeType == NODE_NUMBER);
+
+  VectorOp op;
+  if (!valid || !vectorOpOf(node->binaryOp.op, scalarOnLeft, &op)) {
+    printEvalError(nodeLoc(node),
+                   "Error: cannot do ( %s ) operations between %s and %s\n",
+                   tokenNames[node->binaryOp.op], getDataType(left),
+                   getDataType(right));
+    exit(EXIT_FAILURE);
+  }
+
+  const VectorOps *ops = vectorOps();
+  Array *arr = scalarOnLeft ? (Array *)right.result : (Array *)left.result;
+  Array *out = newArray(ARRAY_NUMBER, arr->length, 0);
+  out->length = arr->length;
+
+  if (left.NodeType == NODE_ARRAY_VALUE &&
+      right.NodeType == NODE_ARRAY_VALUE) {
+    Array *other = (Array *)right.result;
+    if (arr->length != other->length) {
+      printEvalError(nodeLoc(node),
+                     "cannot do ( %s ) between arrays of length %d and %d",
+                     tokenNames[node->binaryOp.op], arr->length,
+                     other->length);
+      exit(EXIT_FAILURE);
+    }
+    ops->binary(op, out->numbers, arr->numbers, other->numbers, arr->length);
+  } else {
+    double scalar =
+        scalarOnLeft ? *(double *)left.result : *(double *)right.result;
+    ops->scalar(op, out->numbers, arr->numbers, scalar, arr->length);
+  }
+
+  return newResult(out, NODE_ARRAY_VALUE);
+}
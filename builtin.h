@@ -0,0 +1,27 @@
+#ifndef BUILTIN_H_
+#define BUILTIN_H_
+
+#include "common.h"
+
+// a native function. args stay on the evaluator stack during the call
+typedef Result (*BuiltinFn)(AstNode *node, Result *args);
+
+// a native function that may have to wait. it returns 0 when it parked the
+// task it runs in, otherwise it sets out and returns 1
+typedef int (*BlockingFn)(AstNode *node, Result *args, Parser *p, Result *out);
+
+typedef struct Builtin {
+  const char *name;
+  int argsCount;
+  BuiltinFn fn;
+  BlockingFn wait; // set instead of fn
+  ValueType returns; // TYPE_UNKNOWN when it depends on the arguments
+  int pure; // the result only depends on the arguments, nothing else changes
+} Builtin;
+
+// script functions with the same name shadow the builtins
+const Builtin *lookupBuiltin(const char *name);
+
+// + - * / where at least one side is an array
+Result evalArrayOp(AstNode *node, Result left, Result right);
+#endif // BUILTIN_H_
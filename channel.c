@@ -0,0 +1,325 @@
+#include "channel.h"
+#include "alloc.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "task.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHANNEL_CHUNK 256
+#define MAX_CHANNEL_CHUNKS 4096
+
+// a slot of the ring. seq says whose turn it is: pos when a sender may fill
+// it for position pos, pos + 1 once it holds the value for a receiver
+typedef struct Slot {
+  atomic_size_t seq;
+  Result value;
+} Slot;
+
+typedef struct Channel {
+  Slot *slots;
+  size_t capacity;
+  atomic_size_t sendPos;
+  char pad1[64]; // senders and receivers move on separate cache lines
+  atomic_size_t recvPos;
+  char pad2[64];
+  atomic_int closed;
+
+  // only touched when some caller has to wait
+  atomic_int waiting;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  WaitQueue tasks;
+} Channel;
+
+typedef enum ChannelStatus {
+  CHANNEL_DONE,
+  CHANNEL_WAIT,
+  CHANNEL_CLOSED,
+} ChannelStatus;
+
+// handles index a table of fixed chunks, lookups need no lock
+static struct {
+  pthread_mutex_t lock;
+  Channel **chunks[MAX_CHANNEL_CHUNKS];
+  atomic_int count;
+} channels = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static Result numberResult(double value) {
+  return newResult(gcNumber(value), NODE_NUMBER);
+}
+
+static Channel *findChannel(AstNode *node, Result handle) {
+  int id = 0;
+  if (handle.NodeType == NODE_NUMBER) {
+    id = (int)*(double *)handle.result;
+  }
+  if (id < 1 || id > atomic_load(&channels.count)) {
+    printEvalError(nodeLoc(node), "%s expects a channel handle",
+                   node->function.call.name);
+    exit(EXIT_FAILURE);
+  }
+  id--;
+  return channels.chunks[id / CHANNEL_CHUNK][id % CHANNEL_CHUNK];
+}
+
+// ------------------------------ the ring --------------------------------
+
+static ChannelStatus trySend(Channel *ch, Result *value) {
+  if (atomic_load(&ch->closed)) {
+    return CHANNEL_CLOSED;
+  }
+
+  size_t pos = atomic_load_explicit(&ch->sendPos, memory_order_relaxed);
+  for (;;) {
+    Slot *slot = &ch->slots[pos % ch->capacity];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&ch->sendPos, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        slot->value = newResult(value->result, value->NodeType);
+        atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+        return CHANNEL_DONE;
+      }
+    } else if (diff < 0) {
+      return CHANNEL_WAIT; // full
+    } else {
+      pos = atomic_load_explicit(&ch->sendPos, memory_order_relaxed);
+    }
+  }
+}
+
+static int takeSlot(Channel *ch, Result *out) {
+  size_t pos = atomic_load_explicit(&ch->recvPos, memory_order_relaxed);
+  for (;;) {
+    Slot *slot = &ch->slots[pos % ch->capacity];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&ch->recvPos, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *out = slot->value;
+        atomic_store_explicit(&slot->seq, pos + ch->capacity,
+                              memory_order_release);
+        return 1;
+      }
+    } else if (diff < 0) {
+      return 0; // empty
+    } else {
+      pos = atomic_load_explicit(&ch->recvPos, memory_order_relaxed);
+    }
+  }
+}
+
+static ChannelStatus tryRecv(Channel *ch, Result *out) {
+  if (takeSlot(ch, out)) {
+    return CHANNEL_DONE;
+  }
+  // sends finish before the close, one more look sees the last of them
+  if (atomic_load(&ch->closed)) {
+    return takeSlot(ch, out) ? CHANNEL_DONE : CHANNEL_CLOSED;
+  }
+  return CHANNEL_WAIT;
+}
+
+static int hasValue(Channel *ch) {
+  size_t pos = atomic_load(&ch->recvPos);
+  Slot *slot = &ch->slots[pos % ch->capacity];
+  return atomic_load(&slot->seq) == pos + 1;
+}
+
+static ChannelStatus tryMore(Channel *ch, Result *out) {
+  (void)out;
+  if (hasValue(ch)) {
+    return CHANNEL_DONE;
+  }
+  if (atomic_load(&ch->closed)) {
+    return hasValue(ch) ? CHANNEL_DONE : CHANNEL_CLOSED;
+  }
+  return CHANNEL_WAIT;
+}
+
+// ------------------------------- waiting --------------------------------
+
+// wakes whoever waits on the channel after it changed
+static void notify(Channel *ch) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&ch->waiting) == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&ch->lock);
+  pthread_cond_broadcast(&ch->changed);
+  atomic_fetch_sub(&ch->waiting, wakeTasks(&ch->tasks));
+  pthread_mutex_unlock(&ch->lock);
+}
+
+typedef ChannelStatus (*ChannelOp)(Channel *ch, Result *value);
+
+// runs op until it no longer has to wait. a task is parked on the channel
+// instead, CHANNEL_WAIT tells the caller to stop
+static ChannelStatus waitFor(Channel *ch, Parser *p, ChannelOp op,
+                             Result *value) {
+  for (;;) {
+    ChannelStatus status = op(ch, value);
+    if (status != CHANNEL_WAIT) {
+      notify(ch);
+      return status;
+    }
+
+    // waiting is raised before the retry, so a change after the retry sees
+    // it and takes the lock to wake us
+    pthread_mutex_lock(&ch->lock);
+    atomic_fetch_add(&ch->waiting, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    status = op(ch, value);
+    if (status != CHANNEL_WAIT) {
+      atomic_fetch_sub(&ch->waiting, 1);
+      pthread_mutex_unlock(&ch->lock);
+      notify(ch);
+      return status;
+    }
+
+    if (p->task && p->eval->nested == 0) {
+      // stays counted in waiting until notify wakes it
+      parkTask(&ch->tasks, p);
+      pthread_mutex_unlock(&ch->lock);
+      return CHANNEL_WAIT;
+    }
+    enterBlocking();
+    pthread_cond_wait(&ch->changed, &ch->lock);
+    leaveBlocking();
+    atomic_fetch_sub(&ch->waiting, 1);
+    pthread_mutex_unlock(&ch->lock);
+  }
+}
+
+// ------------------------------- builtins -------------------------------
+
+Result builtinChan(AstNode *node, Result *args) {
+  double capacity = 0;
+  if (args[0].NodeType == NODE_NUMBER) {
+    capacity = *(double *)args[0].result;
+  }
+  if (capacity < 1 || capacity != (long)capacity) {
+    printEvalError(nodeLoc(node), "chan expects a capacity of at least 1");
+    exit(EXIT_FAILURE);
+  }
+
+  Channel *ch = (Channel *)memCalloc(1, sizeof(Channel));
+  if (ch) {
+    ch->capacity = (size_t)capacity;
+    ch->slots = (Slot *)memCalloc(ch->capacity, sizeof(Slot));
+  }
+  if (!ch || !ch->slots) {
+    printf("failed allocating channel\n");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < ch->capacity; i++) {
+    atomic_init(&ch->slots[i].seq, i);
+  }
+  pthread_mutex_init(&ch->lock, NULL);
+  pthread_cond_init(&ch->changed, NULL);
+
+  pthread_mutex_lock(&channels.lock);
+  int id = atomic_load(&channels.count);
+  if (id >= CHANNEL_CHUNK * MAX_CHANNEL_CHUNKS) {
+    printEvalError(nodeLoc(node), "too many channels");
+    exit(EXIT_FAILURE);
+  }
+  if (id % CHANNEL_CHUNK == 0) {
+    channels.chunks[id / CHANNEL_CHUNK] =
+        (Channel **)memAlloc(sizeof(Channel *) * CHANNEL_CHUNK);
+    if (!channels.chunks[id / CHANNEL_CHUNK]) {
+      printf("failed allocating channel\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  channels.chunks[id / CHANNEL_CHUNK][id % CHANNEL_CHUNK] = ch;
+  atomic_store(&channels.count, id + 1);
+  pthread_mutex_unlock(&channels.lock);
+
+  return numberResult(id + 1);
+}
+
+Result builtinClose(AstNode *node, Result *args) {
+  Channel *ch = findChannel(node, args[0]);
+  if (atomic_exchange(&ch->closed, 1)) {
+    printEvalError(nodeLoc(node), "close of a closed channel");
+    exit(EXIT_FAILURE);
+  }
+  notify(ch);
+  return newResult(NULL, NODE_NONE);
+}
+
+int builtinSend(AstNode *node, Result *args, Parser *p, Result *out) {
+  Channel *ch = findChannel(node, args[0]);
+  if (args[1].NodeType != NODE_NUMBER &&
+      args[1].NodeType != NODE_STRING_LITERAL) {
+    printEvalError(nodeLoc(node),
+                   "channels carry numbers and strings but got %s",
+                   getDataType(args[1]));
+    exit(EXIT_FAILURE);
+  }
+
+  ChannelStatus status = waitFor(ch, p, trySend, &args[1]);
+  if (status == CHANNEL_CLOSED) {
+    printEvalError(nodeLoc(node), "send on a closed channel");
+    exit(EXIT_FAILURE);
+  }
+  *out = newResult(NULL, NODE_NONE);
+  return status == CHANNEL_DONE;
+}
+
+int builtinRecv(AstNode *node, Result *args, Parser *p, Result *out) {
+  Channel *ch = findChannel(node, args[0]);
+  ChannelStatus status = waitFor(ch, p, tryRecv, out);
+  if (status == CHANNEL_CLOSED) {
+    printEvalError(nodeLoc(node), "recv on a closed and empty channel");
+    exit(EXIT_FAILURE);
+  }
+  return status == CHANNEL_DONE;
+}
+
+int builtinMore(AstNode *node, Result *args, Parser *p, Result *out) {
+  Channel *ch = findChannel(node, args[0]);
+  ChannelStatus status = waitFor(ch, p, tryMore, out);
+  if (status == CHANNEL_WAIT) {
+    return 0;
+  }
+  *out = numberResult(status == CHANNEL_DONE);
+  return 1;
+}
+
+void markChannels(void) {
+  int count = atomic_load(&channels.count);
+  for (int id = 0; id < count; id++) {
+    Channel *ch = channels.chunks[id / CHANNEL_CHUNK][id % CHANNEL_CHUNK];
+    size_t end = atomic_load(&ch->sendPos);
+    for (size_t pos = atomic_load(&ch->recvPos); pos < end; pos++) {
+      markResult(&ch->slots[pos % ch->capacity].value);
+    }
+  }
+}
+
+void freeChannels(void) {
+  int count = atomic_load(&channels.count);
+  for (int id = 0; id < count; id++) {
+    Channel *ch = channels.chunks[id / CHANNEL_CHUNK][id % CHANNEL_CHUNK];
+    pthread_mutex_destroy(&ch->lock);
+    pthread_cond_destroy(&ch->changed);
+    memFree(ch->slots);
+    memFree(ch);
+  }
+  for (int i = 0; i * CHANNEL_CHUNK < count; i++) {
+    memFree(channels.chunks[i]);
+  }
+  atomic_store(&channels.count, 0);
+}
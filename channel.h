@@ -0,0 +1,25 @@
+#ifndef CHANNEL_H_
+#define CHANNEL_H_
+
+#include "common.h"
+
+// channels are bounded queues of numbers and strings shared by handle
+// between tasks, parfor iterations and the main program
+
+// chan(capacity) and close(c)
+Result builtinChan(AstNode *node, Result *args);
+Result builtinClose(AstNode *node, Result *args);
+
+// send(c, value), recv(c) and more(c). a call that has to wait parks the task
+// it runs in and returns 0, it is made again once the task is woken. other
+// threads sleep in the call instead
+int builtinSend(AstNode *node, Result *args, Parser *p, Result *out);
+int builtinRecv(AstNode *node, Result *args, Parser *p, Result *out);
+int builtinMore(AstNode *node, Result *args, Parser *p, Result *out);
+
+// marks the values still queued in the channels
+void markChannels(void);
+
+// frees every channel, the values left in them belong to the collector
+void freeChannels(void);
+#endif // CHANNEL_H_
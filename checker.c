@@ -0,0 +1,694 @@
+#include "checker.h"
+#include "alloc.h"
+#include "builtin.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "types.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// names are resolved by scope at runtime, which the checker does not model.
+// it does not need to: every variable the evaluator can find under a name
+// was made by one of the declarations of that name, so a name whose
+// declarations all agree has that type wherever it is read. names declared
+// with different types stay unknown and keep their runtime checks
+typedef struct Name {
+  const char *name;
+  ValueType type;
+  int conflict; // declared with more than one type
+  AstNode *fn;  // the definition, for function names
+  int fnCount;  // definitions of the function name
+  int local;    // declared inside a block or as a parameter, for functions
+                // defined inside a block
+  int spawned;  // the function runs as a task somewhere
+  int defined;  // a top level definition the inlining walk has passed
+} Name;
+
+typedef struct NameTable {
+  Name *slots;
+  size_t capacity;
+  size_t count;
+} NameTable;
+
+typedef struct Checker {
+  NameTable vars;
+  NameTable fns;
+  int errors;
+  AstNode *statement; // the top level statement being walked
+} Checker;
+
+// ------------------------------ names ------------------------------------
+
+// names are interned, the pointer is the key
+static size_t hashName(const char *name) {
+  uint64_t hash = (uint64_t)(uintptr_t)name * 0x9E3779B97F4A7C15ULL;
+  return (size_t)(hash >> 32);
+}
+
+static Name *probe(NameTable *t, const char *name) {
+  size_t i = hashName(name) & (t->capacity - 1);
+  while (t->slots[i].name && t->slots[i].name != name) {
+    i = (i + 1) & (t->capacity - 1);
+  }
+  return &t->slots[i];
+}
+
+static Name *findName(NameTable *t, const char *name) {
+  return t->capacity ? probe(t, name) : NULL;
+}
+
+// the slot for name, a new one is zeroed apart from its name
+static Name *addName(NameTable *t, const char *name) {
+  if ((t->count + 1) * 2 > t->capacity) {
+    NameTable grown = {0};
+    grown.capacity = t->capacity ? t->capacity * 2 : 64;
+    grown.slots = (Name *)memCalloc(grown.capacity, sizeof(Name));
+    for (size_t i = 0; i < t->capacity; i++) {
+      if (t->slots[i].name) {
+        *probe(&grown, t->slots[i].name) = t->slots[i];
+      }
+    }
+    grown.count = t->count;
+    memFree(t->slots);
+    *t = grown;
+  }
+
+  Name *slot = probe(t, name);
+  if (!slot->name) {
+    slot->name = name;
+    t->count++;
+  }
+  return slot;
+}
+
+// ------------------------------ types ------------------------------------
+
+static void declare(Checker *c, const char *name, ValueType type, int local) {
+  Name *n = findName(&c->vars, name);
+  if (n && n->name) {
+    if (n->type != type) {
+      n->conflict = 1;
+    }
+    n->local |= local;
+    return;
+  }
+  n = addName(&c->vars, name);
+  n->type = type;
+  n->local = local;
+}
+
+static ValueType varType(Checker *c, const char *name) {
+  Name *n = findName(&c->vars, name);
+  if (!n || !n->name || n->conflict) {
+    return TYPE_UNKNOWN;
+  }
+  return n->type;
+}
+
+static void typeError(Checker *c, AstNode *node, const char *format, ...) {
+  char message[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+
+  printEvalError(nodeLoc(node), "%s", message);
+  c->errors++;
+}
+
+// -------------------------------- walk -----------------------------------
+
+typedef struct Visit {
+  AstNode *node;
+  AstNode *fn; // the function definition the node is in, if any
+  int expanded;
+} Visit;
+
+typedef struct VisitStack {
+  Visit *items;
+  int count;
+  int capacity;
+} VisitStack;
+
+static void pushVisit(VisitStack *s, AstNode *node, AstNode *fn) {
+  if (!node) {
+    return;
+  }
+  if (s->count >= s->capacity) {
+    s->capacity = s->capacity ? s->capacity * 2 : 64;
+    s->items = (Visit *)memRealloc(s->items, sizeof(Visit) * s->capacity);
+  }
+  s->items[s->count++] = (Visit){node, fn, 0};
+}
+
+typedef struct Expand {
+  VisitStack *s;
+  AstNode *fn;
+} Expand;
+
+static void pushChild(AstNode *child, void *ctx) {
+  Expand *expand = (Expand *)ctx;
+  pushVisit(expand->s, child, expand->fn);
+}
+
+// reversed once pushed so they are visited in source order
+static void pushVisits(VisitStack *s, AstNode *node, AstNode *fn) {
+  int from = s->count;
+  Expand expand = {s, node->type == NODE_FUNCTION ? node : fn};
+  forEachChild(node, pushChild, &expand);
+  for (int i = from, j = s->count - 1; i < j; i++, j--) {
+    Visit swap = s->items[i];
+    s->items[i] = s->items[j];
+    s->items[j] = swap;
+  }
+}
+
+typedef void (*VisitFn)(Checker *c, AstNode *node, AstNode *fn);
+
+// calls visit on every node after its children
+static void walk(Checker *c, AstNode **program, int count, VisitFn visit) {
+  VisitStack s = {0};
+  for (int i = 0; i < count; i++) {
+    c->statement = program[i];
+    pushVisit(&s, program[i], NULL);
+
+    while (s.count > 0) {
+      Visit *top = &s.items[s.count - 1];
+      if (!top->expanded) {
+        top->expanded = 1;
+        pushVisits(&s, top->node, top->fn);
+        continue;
+      }
+      s.count--;
+      visit(c, top->node, top->fn);
+    }
+  }
+  memFree(s.items);
+}
+
+// --------------------------- declarations --------------------------------
+
+static void collectNames(Checker *c, AstNode *node, AstNode *fn) {
+  (void)fn;
+  switch (node->type) {
+  case NODE_IDENTIFIER_ASSIGNMENT:
+  case NODE_IDENTIFIER_DECLERATION:
+    declare(c, node->identifier.name, node->identifier.type,
+            node != c->statement);
+    break;
+  case NODE_ARRAY_INIT:
+  case NODE_ARRAY_DECLARATION:
+    declare(c, node->array.name, node->array.type, node != c->statement);
+    break;
+  case NODE_FUNCTION: {
+    Name *n = addName(&c->fns, node->function.defination.name);
+    n->fn = node;
+    n->fnCount++;
+    n->local |= node != c->statement;
+    for (int i = 0; i < node->function.defination.paramsCount; i++) {
+      FuncParams *param = node->function.defination.params[i];
+      declare(c, param->name, param->type, 1);
+    }
+    break;
+  }
+  case NODE_SPAWN:
+    addName(&c->fns, node->expr->function.call.name)->spawned = 1;
+    break;
+  }
+}
+
+// ------------------------------- checks ----------------------------------
+
+static int isNumberOp(TokenType op) {
+  switch (op) {
+  case TOKEN_PLUS:
+  case TOKEN_MINUS:
+  case TOKEN_MODULO:
+  case TOKEN_MULTIPLY:
+  case TOKEN_DIVIDE:
+  case TOKEN_DB_EQUAL:
+  case TOKEN_EQ_GREATER:
+  case TOKEN_EQ_LESSER:
+  case TOKEN_LESSER:
+  case TOKEN_GREATER:
+  case TOKEN_EQ_NOT:
+  case TOKEN_AND:
+  case TOKEN_OR:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int isVectorOp(TokenType op) {
+  return op == TOKEN_PLUS || op == TOKEN_MINUS || op == TOKEN_MULTIPLY ||
+         op == TOKEN_DIVIDE;
+}
+
+// mirrors evalBinaryOp and evalArrayOp
+static void checkBinary(Checker *c, AstNode *node) {
+  ValueType left = node->binaryOp.left->valueType;
+  ValueType right = node->binaryOp.right->valueType;
+  TokenType op = node->binaryOp.op;
+  if (!left || !right) {
+    return;
+  }
+
+  if (left == TYPE_NUMBER && right == TYPE_NUMBER) {
+    node->valueType = isNumberOp(op) ? TYPE_NUMBER : TYPE_UNKNOWN;
+    return;
+  }
+  if (left == TYPE_STRING && right == TYPE_STRING) {
+    node->valueType = TYPE_STRING; // every operator concatenates strings
+    return;
+  }
+  if ((left == TYPE_NUMBER || left == TYPE_NUMBER_ARRAY) &&
+      (right == TYPE_NUMBER || right == TYPE_NUMBER_ARRAY) && isVectorOp(op)) {
+    node->valueType = TYPE_NUMBER_ARRAY;
+    return;
+  }
+  typeError(c, node, "cannot do ( %s ) operations between %s and %s",
+            tokenNames[op], typeName(left), typeName(right));
+}
+
+static void checkCall(Checker *c, AstNode *node) {
+  char *name = node->function.call.name;
+  int argsCount = node->function.call.argsCount;
+  AstNode **args = node->function.call.args;
+  Name *fn = findName(&c->fns, name);
+  const Builtin *builtin = lookupBuiltin(name);
+
+  if (!fn || !fn->name) {
+    if (!builtin) {
+      typeError(c, node, "undeclared function %s was called", name);
+    } else if (builtin->argsCount != argsCount) {
+      typeError(c, node, "%s expects %d arguments but got %d", name,
+                builtin->argsCount, argsCount);
+    } else {
+      node->valueType = builtin->returns;
+    }
+    return;
+  }
+
+  // the builtin runs wherever the script function is out of scope. a local
+  // function is only found inside its block, a call elsewhere is left for
+  // the runtime to report
+  if (fn->fnCount != 1 || fn->local || builtin) {
+    return;
+  }
+
+  AstNode *def = fn->fn;
+  int paramsCount = def->function.defination.paramsCount;
+  if (paramsCount != argsCount) {
+    typeError(c, node, "%s expects %d arguments but got %d", name,
+              paramsCount, argsCount);
+    return;
+  }
+  // a call returns its declared type or fails at runtime
+  node->valueType = def->function.defination.returnType;
+
+  int proven = 1;
+  for (int i = 0; i < argsCount; i++) {
+    ValueType param = def->function.defination.params[i]->type;
+    ValueType arg = args[i]->valueType;
+    if (!param || !arg) {
+      proven = 0;
+    } else if (param != arg) {
+      typeError(c, args[i], "expected argument of type %s  but got %s",
+                typeName(param), typeName(arg));
+      proven = 0;
+    }
+  }
+  node->checked = proven;
+}
+
+static void checkReturn(Checker *c, AstNode *node, AstNode *fn) {
+  if (!node->expr) {
+    return;
+  }
+  ValueType value = node->expr->valueType;
+  node->valueType = value;
+  if (!fn || !value) {
+    return;
+  }
+
+  ValueType returnType = fn->function.defination.returnType;
+  if (returnType != value) {
+    typeError(c, node,
+              "cannot return %s from the function with the return type of %s",
+              typeName(value), typeName(returnType));
+  }
+}
+
+static void checkArrayDeclaration(Checker *c, AstNode *node) {
+  ValueType type = node->array.type;
+  ValueType element = elementTypeOf(type);
+
+  AstNode *size = node->array.arraySize;
+  if (size && size->valueType && size->valueType != TYPE_NUMBER) {
+    typeError(c, node, "size of array %s must be a number", node->array.name);
+  }
+
+  for (int i = 0; i < node->array.actualSize; i++) {
+    AstNode *elm = node->array.elements[i];
+    if (elm && element && elm->valueType && elm->valueType != element) {
+      typeError(c, elm, "array %s holds %s but got %s", node->array.name,
+                typeName(element), typeName(elm->valueType));
+    }
+  }
+
+  AstNode *init = node->array.init;
+  if (init && type && init->valueType && init->valueType != type) {
+    typeError(c, node, "cannot assign type of %s to %s",
+              typeName(init->valueType), typeName(type));
+  }
+}
+
+// the type of the array the element node names, or unknown
+static ValueType arrayOf(Checker *c, AstNode *node) {
+  ValueType type = varType(c, node->arrayElm.name);
+  if (type && !isArrayType(type)) {
+    typeError(c, node, "%s is not an array", node->arrayElm.name);
+    return TYPE_UNKNOWN;
+  }
+  return type;
+}
+
+static void checkNode(Checker *c, AstNode *node, AstNode *fn) {
+  node->valueType = TYPE_UNKNOWN;
+  node->checked = 0;
+
+  switch (node->type) {
+  case NODE_NUMBER:
+    node->valueType = TYPE_NUMBER;
+    break;
+
+  case NODE_STRING_LITERAL:
+    node->valueType = TYPE_STRING;
+    break;
+
+  case NODE_IDENTIFIER_VALUE:
+    node->valueType = varType(c, node->identifier.name);
+    break;
+
+  case NODE_FUNCTION_READ_IN:
+    node->valueType = node->read.type;
+    break;
+
+  case NODE_BINARY_OP:
+    checkBinary(c, node);
+    break;
+
+  case NODE_UNARY_OP: {
+    ValueType right = node->unaryOp.right->valueType;
+    if (right && right != TYPE_NUMBER) {
+      typeError(c, node, "Invalid type for unary operation");
+      break; // left unknown, the error is not reported again above it
+    }
+    node->valueType = TYPE_NUMBER;
+    break;
+  }
+
+  case NODE_FUNCTION_CALL:
+    checkCall(c, node);
+    break;
+
+  case NODE_SPAWN:
+    node->valueType = TYPE_NUMBER;
+    break;
+
+  case NODE_IDENTIFIER_ASSIGNMENT: {
+    ValueType declared = node->identifier.type;
+    ValueType value = node->identifier.value->valueType;
+    if (!declared || !value) {
+      break;
+    }
+    if (declared != value) {
+      typeError(c, node, "cannot assign typeof %s to %s", typeName(value),
+                typeName(declared));
+      break;
+    }
+    node->checked = 1;
+    break;
+  }
+
+  case NODE_IDENTIFIER_MUTATION: {
+    ValueType type = varType(c, node->identifier.name);
+    ValueType value = node->identifier.value->valueType;
+    if (!type || !value) {
+      break;
+    }
+    if (type != value) {
+      typeError(c, node, "cannot assign type of %s to type of %s",
+                typeName(value), typeName(type));
+      break;
+    }
+    // arrays are copied element wise, only plain variables skip the check
+    node->checked = !isArrayType(type);
+    break;
+  }
+
+  case NODE_RETURN:
+    checkReturn(c, node, fn);
+    break;
+
+  case NODE_IF_ELSE: {
+    ValueType condition = node->ifElseBlock.condition->valueType;
+    if (condition && condition != TYPE_NUMBER) {
+      typeError(c, node, "Condition in if-else must be a number (interpreted "
+                         "as boolean)");
+    }
+    break;
+  }
+
+  case NODE_ARRAY_INIT:
+  case NODE_ARRAY_DECLARATION:
+    checkArrayDeclaration(c, node);
+    break;
+
+  case NODE_ARRAY_ELEMENT_ACCESS:
+    node->valueType = elementTypeOf(arrayOf(c, node));
+    break;
+
+  case NODE_ARRAY_ELEMENT_ASSIGN: {
+    ValueType element = elementTypeOf(arrayOf(c, node));
+    ValueType value = node->arrayElm.value->valueType;
+    if (!element || !value) {
+      break;
+    }
+    if (element != value) {
+      typeError(c, node, "cannot assign type of %s to %s", typeName(value),
+                typeName(element));
+      break;
+    }
+    node->checked = 1;
+    break;
+  }
+  }
+}
+
+// ------------------------------ inlining ---------------------------------
+
+// a function whose returned expression is larger than this stays a call
+#define INLINE_MAX_NODES 24
+#define INLINE_MAX_PARAMS 8
+
+static int paramIndex(AstNode *def, const char *name) {
+  for (int i = 0; i < def->function.defination.paramsCount; i++) {
+    if (def->function.defination.params[i]->name == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// a name some caller could have a local of its own under
+static int isLocalName(Checker *c, const char *name) {
+  Name *n = findName(&c->vars, name);
+  return !n || !n->name || n->local;
+}
+
+static int isLeaf(AstNode *node) {
+  return node->type == NODE_NUMBER || node->type == NODE_STRING_LITERAL ||
+         node->type == NODE_IDENTIFIER_VALUE;
+}
+
+// counts the nodes of the returned expression and the reads of each
+// parameter in it. it can only hold operators, literals, parameters and
+// names that are never declared in a scope, which no caller can hide
+static int isInlinable(Checker *c, AstNode *def, AstNode *node, int *uses,
+                       int *size) {
+  if (++*size > INLINE_MAX_NODES) {
+    return 0;
+  }
+
+  switch (node->type) {
+  case NODE_NUMBER:
+  case NODE_STRING_LITERAL:
+    return 1;
+  case NODE_IDENTIFIER_VALUE: {
+    int i = paramIndex(def, node->identifier.name);
+    if (i >= 0) {
+      uses[i]++;
+      return 1;
+    }
+    return !isLocalName(c, node->identifier.name);
+  }
+  case NODE_ARRAY_ELEMENT_ACCESS:
+    return paramIndex(def, node->arrayElm.name) < 0 &&
+           !isLocalName(c, node->arrayElm.name) &&
+           isInlinable(c, def, node->arrayElm.index, uses, size);
+  case NODE_UNARY_OP:
+    return isInlinable(c, def, node->unaryOp.right, uses, size);
+  case NODE_BINARY_OP:
+    return isInlinable(c, def, node->binaryOp.left, uses, size) &&
+           isInlinable(c, def, node->binaryOp.right, uses, size);
+  default:
+    return 0;
+  }
+}
+
+// an argument without side effects, it gives the same value wherever the
+// inlined expression reads it
+static int isPure(AstNode *node, int *size) {
+  if (++*size > INLINE_MAX_NODES) {
+    return 0;
+  }
+
+  switch (node->type) {
+  case NODE_NUMBER:
+  case NODE_STRING_LITERAL:
+  case NODE_IDENTIFIER_VALUE:
+    return 1;
+  case NODE_ARRAY_ELEMENT_ACCESS:
+    return isPure(node->arrayElm.index, size);
+  case NODE_UNARY_OP:
+    return isPure(node->unaryOp.right, size);
+  case NODE_BINARY_OP:
+    return isPure(node->binaryOp.left, size) &&
+           isPure(node->binaryOp.right, size);
+  default:
+    return 0;
+  }
+}
+
+// a copy of the returned expression with the arguments in place of the
+// parameters. a leaf argument is copied for every read, any other is read
+// once and moved in
+static AstNode *substitute(AstNode *def, AstNode *node, AstNode **args) {
+  AstNode *copy;
+  switch (node->type) {
+  case NODE_IDENTIFIER_VALUE: {
+    int i = paramIndex(def, node->identifier.name);
+    if (i < 0) {
+      return copyNode(node);
+    }
+    return isLeaf(args[i]) ? copyNode(args[i]) : args[i];
+  }
+  case NODE_ARRAY_ELEMENT_ACCESS:
+    copy = copyNode(node);
+    copy->arrayElm.index = substitute(def, node->arrayElm.index, args);
+    return copy;
+  case NODE_UNARY_OP:
+    copy = copyNode(node);
+    copy->unaryOp.right = substitute(def, node->unaryOp.right, args);
+    return copy;
+  case NODE_BINARY_OP:
+    copy = copyNode(node);
+    copy->binaryOp.left = substitute(def, node->binaryOp.left, args);
+    copy->binaryOp.right = substitute(def, node->binaryOp.right, args);
+    return copy;
+  default:
+    return copyNode(node);
+  }
+}
+
+// replaces a call with the expression the function returns when its body is
+// that one return. the function is defined at the top level before the
+// statement holding the call, so the call could only ever reach it, and the
+// checker proved the argument and return types
+static void inlineCall(Checker *c, AstNode *node) {
+  Name *fn = findName(&c->fns, node->function.call.name);
+  int argsCount = node->function.call.argsCount;
+  AstNode **args = node->function.call.args;
+  if (!node->checked || !fn || !fn->defined || fn->spawned ||
+      argsCount > INLINE_MAX_PARAMS) {
+    return;
+  }
+
+  AstNode *def = fn->fn;
+  AstNode *body = def->function.defination.body;
+  if (body->block.pending || body->block.statementCount != 1) {
+    return;
+  }
+  AstNode *ret = body->block.statements[0];
+  if (ret->type != NODE_RETURN || !ret->expr ||
+      ret->expr->valueType != def->function.defination.returnType) {
+    return;
+  }
+
+  int uses[INLINE_MAX_PARAMS] = {0};
+  int size = 0;
+  if (!isInlinable(c, def, ret->expr, uses, &size)) {
+    return;
+  }
+  // every argument must still be evaluated exactly as often as it can fail
+  for (int i = 0; i < argsCount; i++) {
+    int argSize = 0;
+    if (!isPure(args[i], &argSize)) {
+      return;
+    }
+    if (uses[i] == 0 && args[i]->type != NODE_NUMBER &&
+        args[i]->type != NODE_STRING_LITERAL) {
+      return;
+    }
+    if (uses[i] > 1 && !isLeaf(args[i])) {
+      return;
+    }
+  }
+
+  AstNode *inlined = substitute(def, ret->expr, args);
+  for (int i = 0; i < argsCount; i++) {
+    if (isLeaf(args[i])) {
+      freeAst(args[i]);
+    }
+  }
+  memFree(args);
+  *node = *inlined; // the spare node goes with its block
+}
+
+static void inlineNode(Checker *c, AstNode *node, AstNode *fn) {
+  (void)fn;
+  switch (node->type) {
+  case NODE_FUNCTION_CALL:
+    inlineCall(c, node);
+    break;
+  case NODE_FUNCTION: {
+    Name *n = findName(&c->fns, node->function.defination.name);
+    if (node == c->statement && n->fnCount == 1) {
+      n->defined = 1;
+    }
+    break;
+  }
+  }
+}
+
+void inlineCalls(AstNode **program, int count) {
+  Checker c = {0};
+  walk(&c, program, count, collectNames);
+  walk(&c, program, count, inlineNode);
+  memFree(c.vars.slots);
+  memFree(c.fns.slots);
+}
+
+int checkProgram(AstNode **program, int count) {
+  Checker c = {0};
+  walk(&c, program, count, collectNames);
+  walk(&c, program, count, checkNode);
+  memFree(c.vars.slots);
+  memFree(c.fns.slots);
+  return c.errors;
+}
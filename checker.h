@@ -0,0 +1,16 @@
+#ifndef CHECKER_H_
+#define CHECKER_H_
+
+#include "common.h"
+
+// the type checking pass that runs between parsing and evaluation. it
+// reports every type error it can prove with its location and fills in
+// valueType and checked on the nodes, so the evaluator can leave out the
+// checks that already passed. returns the number of errors it printed
+int checkProgram(AstNode **program, int count);
+
+// replaces calls to small top level functions, whose body is one return of
+// an expression, with that expression. runs after checkProgram found no
+// errors, it relies on the types it proved
+void inlineCalls(AstNode **program, int count);
+#endif // CHECKER_H_
@@ -0,0 +1,185 @@
+#include "chunk.h"
+#include "alloc.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ChunkJob ChunkJob;
+
+typedef struct Chunk {
+  Lexer lex; // a cursor of its own over the shared source
+  Token **tokens;
+  int count;
+  int capacity;
+  int lines; // newlines inside the chunk
+  ChunkJob *job;
+  pthread_t thread;
+} Chunk;
+
+struct ChunkJob {
+  Chunk *chunks;
+  int count;
+  pthread_barrier_t counted; // every chunk knows its newlines
+};
+
+// where the chunks start. a chunk ends after a newline the lexer passes over
+// as white space. strings and comments are skipped the way GetNextToken reads
+// them: the byte after the opening quote or # never closes it
+static int splitSource(const char *s, int length, int pieces, int *starts) {
+  int count = 1;
+  int pos = 0;
+  int special = -1; // the next quote or # at or after pos, once looked for
+  starts[0] = 0;
+
+  while (count < pieces && pos < length) {
+    int target = (int)((long)length * count / pieces);
+    if (special < pos) {
+      special = pos + (int)strcspn(s + pos, "\"#");
+    }
+
+    int from = pos > target ? pos : target;
+    if (special > from) {
+      const char *nl = memchr(s + from, '\n', special - from);
+      if (nl && nl - s + 1 < length) {
+        pos = (int)(nl - s) + 1;
+        starts[count++] = pos;
+        continue;
+      }
+    }
+    if (special >= length) {
+      break;
+    }
+
+    int after = special + 1;
+    if (after < length) {
+      after++;
+    }
+    const char *close = memchr(s + after, s[special], length - after);
+    if (!close) {
+      break; // unterminated, the last chunk reports it
+    }
+    pos = (int)(close - s) + 1;
+  }
+  return count;
+}
+
+static int countLines(const char *s, int length) {
+  int lines = 0;
+  const char *end = s + length;
+  while ((s = memchr(s, '\n', end - s))) {
+    lines++;
+    s++;
+  }
+  return lines;
+}
+
+static void pushChunkToken(Chunk *chunk, Token *tkn) {
+  if (chunk->count >= chunk->capacity) {
+    chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+    chunk->tokens = (Token **)memRealloc(chunk->tokens,
+                                         sizeof(Token *) * chunk->capacity);
+    if (!chunk->tokens) {
+      printf("failed allocating the tokens of a chunk\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  chunk->tokens[chunk->count++] = tkn;
+}
+
+static void *lexChunk(void *arg) {
+  Chunk *chunk = (Chunk *)arg;
+  Lexer *l = &chunk->lex;
+  chunk->lines = countLines(l->source + l->curr, l->end - l->curr);
+
+  // a chunk starts below the newlines of the chunks before it
+  pthread_barrier_wait(&chunk->job->counted);
+  for (Chunk *before = chunk->job->chunks; before < chunk; before++) {
+    l->line += before->lines;
+  }
+
+  Token *tkn;
+  do {
+    tkn = GetNextToken(l);
+    pushChunkToken(chunk, tkn);
+  } while (tkn->type != TOKEN_EOF);
+  return NULL;
+}
+
+Token **lexChunks(Lexer *lex, int threads, int *count) {
+  int length = lex->end - lex->curr;
+  int pieces = length / LEX_CHUNK_MIN;
+  if (pieces > threads) {
+    pieces = threads;
+  }
+  if (pieces < 1) {
+    pieces = 1;
+  }
+
+  int *starts = (int *)memAlloc(sizeof(int) * pieces);
+  if (!starts) {
+    printf("failed allocating the chunks\n");
+    exit(EXIT_FAILURE);
+  }
+  ChunkJob job;
+  job.count = splitSource(lex->source + lex->curr, length, pieces, starts);
+  job.chunks = (Chunk *)memCalloc(job.count, sizeof(Chunk));
+  if (!job.chunks) {
+    printf("failed allocating the chunks\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_barrier_init(&job.counted, NULL, job.count);
+
+  for (int i = 0; i < job.count; i++) {
+    Chunk *chunk = &job.chunks[i];
+    chunk->job = &job;
+    chunk->lex = *lex;
+    chunk->lex.curr = lex->curr + starts[i];
+    chunk->lex.end = i + 1 < job.count ? lex->curr + starts[i + 1] : lex->end;
+  }
+
+  // the caller lexes the first chunk itself
+  for (int i = 1; i < job.count; i++) {
+    if (pthread_create(&job.chunks[i].thread, NULL, lexChunk,
+                       &job.chunks[i]) != 0) {
+      printf("unable to start a lexer thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  lexChunk(&job.chunks[0]);
+  for (int i = 1; i < job.count; i++) {
+    pthread_join(job.chunks[i].thread, NULL);
+  }
+  pthread_barrier_destroy(&job.counted);
+
+  // every chunk ends in an EOF token, only the last one is kept
+  int total = 1;
+  for (int i = 0; i < job.count; i++) {
+    total += job.chunks[i].count - 1;
+  }
+  Token **tokens = (Token **)memAlloc(sizeof(Token *) * total);
+  if (!tokens) {
+    printf("failed allocating the tokens\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int size = 0;
+  for (int i = 0; i < job.count; i++) {
+    Chunk *chunk = &job.chunks[i];
+    memcpy(tokens + size, chunk->tokens, sizeof(Token *) * (chunk->count - 1));
+    size += chunk->count - 1;
+    if (i + 1 < job.count) {
+      freeToken(chunk->tokens[chunk->count - 1]);
+    } else {
+      tokens[size++] = chunk->tokens[chunk->count - 1];
+    }
+    memFree(chunk->tokens);
+  }
+
+  lex->curr = lex->end;
+  memFree(job.chunks);
+  memFree(starts);
+  *count = size;
+  return tokens;
+}
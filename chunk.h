@@ -0,0 +1,14 @@
+#ifndef CHUNK_H_
+#define CHUNK_H_
+
+#include "lexer.h"
+
+// a thread gets at least this many bytes of source to lex
+#define LEX_CHUNK_MIN (64 * 1024)
+
+// lexes the whole source on up to threads threads. the source is split at
+// newlines outside strings and comments and the chunks are lexed at the same
+// time, the tokens come back in source order with the rows and columns a
+// single lexer gives them. sets *count, the EOF token is the last one
+Token **lexChunks(Lexer *lex, int threads, int *count);
+#endif // CHUNK_H_
@@ -1,13 +1,29 @@
 #ifndef COMMON_H_
 #define COMMON_H_
 
+#include "array.h"
+#include "gc.h"
 #include "lexer.h"
 
 // Forward declare AstNode for use in SymbolTableEntry
 typedef struct AstNode AstNode;
+typedef struct Closure Closure;
+typedef struct Task Task;
+typedef struct TokenFeed TokenFeed;
+
+// the types of the language. declarations, parameters, return types and
+// symbol entries carry one of these, as does the checker's view of an
+// expression. TYPE_UNKNOWN is what the checker could not resolve
+typedef enum ValueType {
+  TYPE_UNKNOWN,
+  TYPE_NUMBER,
+  TYPE_STRING,
+  TYPE_NUMBER_ARRAY,
+  TYPE_STRING_ARRAY,
+} ValueType;
 
 typedef struct FuncParams {
-  char *type;
+  ValueType type;
   char *name;
   int isFunc;  // if the parameter is a
   int isArray; // if the parameter is an array
@@ -15,15 +31,12 @@ typedef struct FuncParams {
 } FuncParams;
 
 typedef struct SymbolTableEntry {
-  char *symbol; // name of the symbol
-  char *type;   // Type field for each symbol table entry
-  int isGlobal; // Flag to determine if it is global
+  char *symbol;   // name of the symbol
+  ValueType type; // the array type for arrays, the return type for functions
+  int isGlobal;   // Flag to determine if it is global
   // arrays
-  int isAllocated;
-  int isArray;
+  int isArray; // value points to an Array
   int isParam;
-  int isFixed;   // determies if the array is dynamic or fixed size array
-  int arraySize; // keeps the recored of the size of array;
   // functions
   int isFn;
   struct {
@@ -45,6 +58,7 @@ typedef struct SymbolTable {
 typedef struct StackFrame {
   SymbolTable *localTable; // Local symbol table for this frame
   int stackLevel;          // Scope level of the frame
+  int isFunction;          // call activation, lookups stop here
 } StackFrame;
 
 typedef struct Stack {
@@ -56,6 +70,7 @@ typedef struct Stack {
 typedef struct SymbolContext {
   SymbolTable *globalTable;
   Stack *stack;
+  int localFunctions; // functions declared in the open frames
 } SymbolContext;
 
 typedef struct Result {
@@ -64,26 +79,60 @@ typedef struct Result {
   int isBreak;
   int isContinue;
   int isReturn;
-  int isAllocated;
 } Result;
 
+// the form a binary node quickened to, see quickenBinary
+typedef Result (*BinaryFn)(AstNode *node, Result left, Result right);
+
+// one pending node on the evaluator's heap stack
+typedef struct EvalFrame {
+  AstNode *node; // node being evaluated
+  void *aux;     // resolved symbol of the node, if it needs one
+  int state;     // where to resume inside the node
+  int index;     // loop counter for blocks, arguments and print lists
+} EvalFrame;
+
+typedef struct EvalStack {
+  EvalFrame *frames;
+  int frameCount;
+  int frameCapacity;
+  Result *values; // results of finished child nodes
+  int valueCount;
+  int valueCapacity;
+  int maxDepth; // frames allowed before a StackOverflowError
+  int nested;   // EvalAst calls running on this stack
+  long fuel;    // steps left before the budget is consulted again
+} EvalStack;
+
 typedef struct {
   Token *current;
   Lexer *lex;
   Token **tokens;
   int idx;
   int size;
+  int capacity;
   int level;
+  TokenFeed *feed; // the lexer thread while it still has tokens to give
+  int pipelined;   // tokens are lexed on a thread and freed once parsed
+  int lazyBodies;  // function bodies are parsed on their first call
 
   SymbolContext *ctx;
+  EvalStack *eval;
+  int inParallel; // evaluating on a parfor worker
+  Task *task;      // the task being evaluated, if any
+  int parked;      // the task has to wait, evaluation stops after the step
 } Parser;
+// nodes are small and carved out of blocks in parse order, see allocNode.
+// the location is only the line, every node comes from the parser's file
 struct AstNode {
   int type;
-  Loc loc;
-  int isParam;
-  double number;
+  int line;
+  unsigned char isParam;
+  unsigned char valueType; // ValueType the checker resolved
+  unsigned char checked;   // the checker proved the node's runtime type checks
 
   union {
+    GcNumber number; // literal value, can be handed out like a heap number
     struct AstNode *expr;
     struct {
       AstNode **statments;
@@ -99,10 +148,16 @@ struct AstNode {
       struct AstNode *left;
       struct AstNode *right;
       TokenType op;
+      BinaryFn quick; // set on the first run, NULL until then
     } binaryOp;
 
     struct {
-      char *type;
+      Closure *closure; // the lowered expression, see compile.h
+      AstNode *source;  // what it was lowered from, for the generic path
+    } compiled;
+
+    struct {
+      ValueType type;
     } read;
     struct {
       struct AstNode *right;
@@ -111,24 +166,28 @@ struct AstNode {
 
     struct {
       char *name;
-      char *type;
+      ValueType type;
       struct AstNode *value;
       int isDeceleration;
     } identifier;
 
     struct {
       char *name;
-      char *type;
+      ValueType type; // TYPE_NUMBER_ARRAY or TYPE_STRING_ARRAY
       AstNode *arraySize;
       int isFixed;
       int isDeclaration;
       AstNode **elements;
       int actualSize;
+      AstNode *init; // `= expr` in place of a literal
     } array;
 
     struct {
       struct AstNode **statements;
       int statementCount;
+      Token **pending; // a function body not parsed yet, see parseLazyBody
+      int pendingCount;
+      int bare; // declares nothing, runs in the scope around it
     } block;
 
     struct {
@@ -152,7 +211,7 @@ struct AstNode {
       char *name;
       AstNode *index;
       AstNode *value;
-
+      Array *array; // resolved on the first evaluation
     } arrayElm;
 
     struct {
@@ -160,7 +219,7 @@ struct AstNode {
       union {
         struct {
           char *name;
-          char *returnType;
+          ValueType returnType;
           FuncParams **params;
           int paramsCount;
           AstNode *body;
@@ -170,6 +229,7 @@ struct AstNode {
           char *name;
           AstNode **args;
           int argsCount;
+          SymbolTableEntry *target; // the top level function last called
         } call;
 
       } function;
@@ -0,0 +1,304 @@
+#include "compile.h"
+#include "alloc.h"
+#include "parser.h"
+#include "symbol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a larger expression is lowered in parts, this bounds the C recursion of
+// the closures
+#define COMPILE_MAX_NODES 64
+
+// ------------------------------ closures ---------------------------------
+
+static int runNumber(Closure *c, Parser *p, double *out) {
+  (void)p;
+  *out = c->number;
+  return 1;
+}
+
+// a hoisted temporary holds no value before its first run, the generic form
+// computes it
+static int runName(Closure *c, Parser *p, double *out) {
+  SymbolTableEntry *var =
+      lookupSymbol(p->ctx, c->name, SYMBOL_KIND_VARIABLES);
+  if (!var || var->isArray || var->type != TYPE_NUMBER || !var->value) {
+    return 0;
+  }
+  *out = *(double *)var->value;
+  return 1;
+}
+
+static int runNot(Closure *c, Parser *p, double *out) {
+  double a;
+  if (!c->operands.left->run(c->operands.left, p, &a)) {
+    return 0;
+  }
+  *out = !a;
+  return 1;
+}
+
+// both operands, left first like the generic evaluator
+static int runOperands(Closure *c, Parser *p, double *a, double *b) {
+  return c->operands.left->run(c->operands.left, p, a) &&
+         c->operands.right->run(c->operands.right, p, b);
+}
+
+static int runAdd(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a + b;
+  return 1;
+}
+
+static int runSubtract(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a - b;
+  return 1;
+}
+
+static int runMultiply(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a * b;
+  return 1;
+}
+
+static int runDivide(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a / b;
+  return 1;
+}
+
+static int runModulo(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = (int)a % (int)b;
+  return 1;
+}
+
+static int runLess(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a < b;
+  return 1;
+}
+
+static int runLessEqual(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a <= b;
+  return 1;
+}
+
+static int runGreater(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a > b;
+  return 1;
+}
+
+static int runGreaterEqual(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a >= b;
+  return 1;
+}
+
+static int runEqual(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a == b;
+  return 1;
+}
+
+static int runNotEqual(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a != b;
+  return 1;
+}
+
+static int runAnd(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a && b;
+  return 1;
+}
+
+static int runOr(Closure *c, Parser *p, double *out) {
+  double a, b;
+  if (!runOperands(c, p, &a, &b)) {
+    return 0;
+  }
+  *out = a || b;
+  return 1;
+}
+
+// the handler of a binary operator on two numbers, NULL for the others
+static ClosureFn operatorFn(TokenType op) {
+  switch (op) {
+  case TOKEN_PLUS:
+    return runAdd;
+  case TOKEN_MINUS:
+    return runSubtract;
+  case TOKEN_MULTIPLY:
+    return runMultiply;
+  case TOKEN_DIVIDE:
+    return runDivide;
+  case TOKEN_MODULO:
+    return runModulo;
+  case TOKEN_LESSER:
+    return runLess;
+  case TOKEN_EQ_LESSER:
+    return runLessEqual;
+  case TOKEN_GREATER:
+    return runGreater;
+  case TOKEN_EQ_GREATER:
+    return runGreaterEqual;
+  case TOKEN_DB_EQUAL:
+    return runEqual;
+  case TOKEN_EQ_NOT:
+    return runNotEqual;
+  case TOKEN_AND:
+    return runAnd;
+  case TOKEN_OR:
+    return runOr;
+  default:
+    return NULL;
+  }
+}
+
+// ------------------------------ lowering ---------------------------------
+
+static int isNumber(AstNode *node) { return node->valueType == TYPE_NUMBER; }
+
+// an expression of numbers the closures compute exactly like the generic
+// evaluator, counting its nodes into size
+static int isLowerable(AstNode *node, int *size) {
+  if (++*size > COMPILE_MAX_NODES) {
+    return 0;
+  }
+
+  switch (node->type) {
+  case NODE_NUMBER:
+    return 1;
+  case NODE_IDENTIFIER_VALUE:
+  case NODE_HOISTED:
+    return isNumber(node);
+  case NODE_UNARY_OP:
+    return node->unaryOp.op == TOKEN_NOT && isNumber(node->unaryOp.right) &&
+           isLowerable(node->unaryOp.right, size);
+  case NODE_BINARY_OP:
+    return operatorFn(node->binaryOp.op) && isNumber(node) &&
+           isNumber(node->binaryOp.left) && isNumber(node->binaryOp.right) &&
+           isLowerable(node->binaryOp.left, size) &&
+           isLowerable(node->binaryOp.right, size);
+  default:
+    return 0;
+  }
+}
+
+// fills closures in pre-order, the root comes first
+static Closure *lower(AstNode *node, Closure *closures, int *used) {
+  Closure *c = &closures[(*used)++];
+  switch (node->type) {
+  case NODE_NUMBER:
+    c->run = runNumber;
+    c->number = node->number.value;
+    break;
+  case NODE_IDENTIFIER_VALUE:
+  case NODE_HOISTED:
+    c->run = runName;
+    c->name = node->identifier.name;
+    break;
+  case NODE_UNARY_OP:
+    c->run = runNot;
+    c->operands.left = lower(node->unaryOp.right, closures, used);
+    c->operands.right = NULL;
+    break;
+  case NODE_BINARY_OP:
+    c->run = operatorFn(node->binaryOp.op);
+    c->operands.left = lower(node->binaryOp.left, closures, used);
+    c->operands.right = lower(node->binaryOp.right, closures, used);
+    break;
+  }
+  return c;
+}
+
+// node becomes a NODE_COMPILED holding its closures and a copy of itself
+static void compileNode(AstNode *node, int size) {
+  Closure *closures = (Closure *)memAlloc(sizeof(Closure) * size);
+  if (!closures) {
+    printf("failed allocating memory while compiling\n");
+    exit(EXIT_FAILURE);
+  }
+  int used = 0;
+  lower(node, closures, &used);
+
+  AstNode *source = copyNode(node);
+  int line = node->line;
+  memset(node, 0, sizeof(AstNode));
+  node->type = NODE_COMPILED;
+  node->line = line;
+  node->valueType = TYPE_NUMBER;
+  node->checked = 1;
+  node->compiled.closure = closures;
+  node->compiled.source = source;
+}
+
+// ------------------------------ program ----------------------------------
+
+void compileProgram(AstNode **program, int count) {
+  NodeList work = {0};
+  for (int i = 0; i < count; i++) {
+    appendNode(program[i], &work);
+  }
+
+  // the largest lowerable expressions are taken whole, the walk only goes
+  // below the ones that are not. the header of a parfor is read by
+  // evalParFor as it was parsed, only its body is entered
+  while (work.size > 0) {
+    AstNode *node = work.nodes[--work.size];
+    int size = 0;
+    if ((node->type == NODE_BINARY_OP || node->type == NODE_UNARY_OP) &&
+        isLowerable(node, &size)) {
+      compileNode(node, size);
+      continue;
+    }
+    if (node->type == NODE_PARFOR_LOOP) {
+      appendNode(node->loopFor.loopBody, &work);
+      continue;
+    }
+    pushChildren(&work, node);
+  }
+  memFree(work.nodes);
+}
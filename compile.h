@@ -0,0 +1,30 @@
+#ifndef COMPILE_H_
+#define COMPILE_H_
+
+#include "common.h"
+
+// computes a lowered expression into *out. returns 0 when a name it reads
+// does not hold a number, the generic evaluator then runs the source and
+// reports it the way it always did
+typedef int (*ClosureFn)(Closure *c, Parser *p, double *out);
+
+// one node of a lowered expression: the handler for its operation bound to
+// its operands. the closures of an expression are one allocation
+struct Closure {
+  ClosureFn run;
+  union {
+    double number; // a literal
+    char *name;    // a variable or a hoisted temporary
+    struct {
+      Closure *left;
+      Closure *right; // NULL for unary operators
+    } operands;
+  };
+};
+
+// lowers the expressions the checker proved to be numbers, made of literals,
+// variables and operators, into closure trees held by NODE_COMPILED nodes.
+// evaluating one is a chain of direct calls instead of a frame on the heap
+// stack per node. runs last, after checkProgram and the optimizations
+void compileProgram(AstNode **program, int count);
+#endif // COMPILE_H_
@@ -0,0 +1,123 @@
+#include "feed.h"
+#include "alloc.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// looks at the ring before a side goes to sleep waiting on it
+#define FEED_SPIN 64
+
+struct TokenFeed {
+  Lexer *lex;
+  Token *slots[FEED_SIZE];
+  atomic_size_t head; // tokens the lexer has put in
+  char pad1[64];      // the two threads move on separate cache lines
+  atomic_size_t tail; // tokens the parser has taken out
+  char pad2[64];
+
+  // only touched when one side has to wait for the other
+  atomic_int waiting;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  pthread_t thread;
+};
+
+static int hasRoom(TokenFeed *feed) {
+  return atomic_load_explicit(&feed->head, memory_order_relaxed) -
+             atomic_load_explicit(&feed->tail, memory_order_acquire) <
+         FEED_SIZE;
+}
+
+static int hasToken(TokenFeed *feed) {
+  return atomic_load_explicit(&feed->head, memory_order_acquire) !=
+         atomic_load_explicit(&feed->tail, memory_order_relaxed);
+}
+
+// wakes the other side after the ring changed
+static void notify(TokenFeed *feed) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&feed->waiting) == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&feed->lock);
+  pthread_cond_broadcast(&feed->changed);
+  pthread_mutex_unlock(&feed->lock);
+}
+
+// blocks until ready says the ring has what the caller needs. waiting is
+// raised before the last look, so a change after it takes the lock to wake us
+static void waitFor(TokenFeed *feed, int (*ready)(TokenFeed *)) {
+  // the other side is usually a few tokens away, a short spin saves the
+  // sleep and the wake up
+  for (int spin = 0; spin < FEED_SPIN; spin++) {
+    if (ready(feed)) {
+      return;
+    }
+    sched_yield();
+  }
+
+  pthread_mutex_lock(&feed->lock);
+  atomic_fetch_add(&feed->waiting, 1);
+  atomic_thread_fence(memory_order_seq_cst);
+  while (!ready(feed)) {
+    pthread_cond_wait(&feed->changed, &feed->lock);
+  }
+  atomic_fetch_sub(&feed->waiting, 1);
+  pthread_mutex_unlock(&feed->lock);
+}
+
+static void *lexAll(void *arg) {
+  TokenFeed *feed = (TokenFeed *)arg;
+  Token *tkn;
+  do {
+    tkn = GetNextToken(feed->lex);
+    waitFor(feed, hasRoom);
+
+    size_t head = atomic_load_explicit(&feed->head, memory_order_relaxed);
+    feed->slots[head % FEED_SIZE] = tkn;
+    atomic_store_explicit(&feed->head, head + 1, memory_order_release);
+    notify(feed);
+  } while (tkn->type != TOKEN_EOF);
+  return NULL;
+}
+
+TokenFeed *startFeed(Lexer *lex) {
+  TokenFeed *feed = (TokenFeed *)memCalloc(1, sizeof(TokenFeed));
+  if (!feed) {
+    printf("unable to allocate the token feed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  feed->lex = lex;
+  atomic_init(&feed->head, 0);
+  atomic_init(&feed->tail, 0);
+  atomic_init(&feed->waiting, 0);
+  pthread_mutex_init(&feed->lock, NULL);
+  pthread_cond_init(&feed->changed, NULL);
+  if (pthread_create(&feed->thread, NULL, lexAll, feed) != 0) {
+    printf("unable to start the lexer thread\n");
+    exit(EXIT_FAILURE);
+  }
+  return feed;
+}
+
+Token *nextFedToken(TokenFeed *feed) {
+  waitFor(feed, hasToken);
+
+  size_t tail = atomic_load_explicit(&feed->tail, memory_order_relaxed);
+  Token *tkn = feed->slots[tail % FEED_SIZE];
+  atomic_store_explicit(&feed->tail, tail + 1, memory_order_release);
+  notify(feed);
+  return tkn;
+}
+
+void stopFeed(TokenFeed *feed) {
+  pthread_join(feed->thread, NULL);
+  pthread_mutex_destroy(&feed->lock);
+  pthread_cond_destroy(&feed->changed);
+  memFree(feed);
+}
@@ -0,0 +1,22 @@
+#ifndef FEED_H_
+#define FEED_H_
+
+#include "lexer.h"
+
+// tokens the lexer thread may run ahead of the parser
+#define FEED_SIZE 1024
+
+// a lexer running on its own thread, handing its tokens to one parser
+// through a bounded single producer single consumer ring
+typedef struct TokenFeed TokenFeed;
+
+// starts lexing lex on a new thread
+TokenFeed *startFeed(Lexer *lex);
+
+// the next token, waits for the lexer when it has not got there yet. the
+// EOF token is the last one the feed hands out
+Token *nextFedToken(TokenFeed *feed);
+
+// waits for the lexer thread to finish and frees the feed
+void stopFeed(TokenFeed *feed);
+#endif // FEED_H_
@@ -0,0 +1,181 @@
+#include "gc.h"
+#include "alloc.h"
+#include "array.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GC_FLUSH (64 * 1024) // bytes a thread allocates before it reports
+
+// the values one thread allocated. threads never share a heap, so allocating
+// takes no lock; only the sweep walks all of them
+typedef struct GcHeap {
+  GcHeader *objects;
+  long pending; // bytes not yet added to gc.debt
+  struct GcHeap *next;
+} GcHeap;
+
+static struct {
+  pthread_mutex_t lock; // guards the list of heaps
+  GcHeap *heaps;
+  atomic_long debt; // bytes allocated since the last sweep
+  atomic_long threshold; // debt that makes a collection due
+  size_t live;           // bytes that survived the last sweep
+} gc = {.lock = PTHREAD_MUTEX_INITIALIZER, .threshold = GC_MIN_HEAP};
+
+static __thread GcHeap *localHeap;
+
+static GcHeap *threadHeap(void) {
+  if (localHeap) {
+    return localHeap;
+  }
+
+  GcHeap *heap = (GcHeap *)memCalloc(1, sizeof(GcHeap));
+  if (!heap) {
+    printf("failed allocating heap\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutex_lock(&gc.lock);
+  heap->next = gc.heaps;
+  gc.heaps = heap;
+  pthread_mutex_unlock(&gc.lock);
+  localHeap = heap;
+  return heap;
+}
+
+void gcTrack(long bytes) {
+  GcHeap *heap = threadHeap();
+  heap->pending += bytes;
+  if (heap->pending >= GC_FLUSH) {
+    atomic_fetch_add_explicit(&gc.debt, heap->pending, memory_order_relaxed);
+    heap->pending = 0;
+  }
+}
+
+void *gcAlloc(GcKind kind, size_t size) {
+  GcHeader *header = (GcHeader *)memAlloc(sizeof(GcHeader) + size);
+  if (!header) {
+    printf("failed allocating %zu bytes\n", size);
+    exit(EXIT_FAILURE);
+  }
+  header->size = sizeof(GcHeader) + size;
+  header->kind = kind;
+  header->marked = 0;
+
+  GcHeap *heap = threadHeap();
+  header->next = heap->objects;
+  heap->objects = header;
+  gcTrack(header->size);
+  return header + 1;
+}
+
+double *gcNumber(double value) {
+  double *number = (double *)gcAlloc(GC_NUMBER, sizeof(double));
+  *number = value;
+  return number;
+}
+
+char *gcString(const char *value) {
+  size_t length = strlen(value) + 1;
+  char *copy = (char *)gcAlloc(GC_STRING, length);
+  memcpy(copy, value, length);
+  return copy;
+}
+
+void gcMark(void *value) {
+  if (!value) {
+    return;
+  }
+
+  GcHeader *header = (GcHeader *)value - 1;
+  if (header->kind == GC_STATIC || header->marked) {
+    return;
+  }
+  header->marked = 1;
+
+  // strings are the only values an array points to
+  if (header->kind == GC_ARRAY) {
+    Array *arr = (Array *)value;
+    if (arr->kind == ARRAY_STRING) {
+      for (int i = 0; i < arr->length; i++) {
+        gcMark(arr->strings[i]);
+      }
+    }
+  }
+}
+
+int gcWanted(void) {
+  return atomic_load_explicit(&gc.debt, memory_order_relaxed) >=
+         atomic_load_explicit(&gc.threshold, memory_order_relaxed);
+}
+
+void gcPostpone(void) {
+  long debt = atomic_load_explicit(&gc.debt, memory_order_relaxed);
+  atomic_store_explicit(&gc.threshold, debt * 2, memory_order_relaxed);
+}
+
+static void freeObject(GcHeader *header) {
+  if (header->kind == GC_ARRAY) {
+    freeArrayPayload((Array *)(header + 1));
+  }
+  memFree(header);
+}
+
+void gcSweep(void) {
+  size_t live = 0;
+
+  pthread_mutex_lock(&gc.lock);
+  for (GcHeap *heap = gc.heaps; heap; heap = heap->next) {
+    GcHeader **link = &heap->objects;
+    while (*link) {
+      GcHeader *header = *link;
+      if (!header->marked) {
+        *link = header->next;
+        freeObject(header);
+        continue;
+      }
+
+      header->marked = 0;
+      live += header->size;
+      if (header->kind == GC_ARRAY) {
+        live += arrayPayloadBytes((Array *)(header + 1));
+      }
+      link = &header->next;
+    }
+    heap->pending = 0;
+  }
+  pthread_mutex_unlock(&gc.lock);
+
+  // the next collection comes once the heap has about doubled, or when half
+  // of what is left under --max-heap is used up
+  gc.live = live;
+  size_t threshold = live > GC_MIN_HEAP ? live : GC_MIN_HEAP;
+  size_t room = memRoom();
+  if (room && threshold > room / 2) {
+    threshold = room / 2 > GC_FLUSH ? room / 2 : GC_FLUSH;
+  }
+  atomic_store(&gc.threshold, (long)threshold);
+  atomic_store(&gc.debt, 0);
+}
+
+void gcShutdown(void) {
+  pthread_mutex_lock(&gc.lock);
+  GcHeap *heap = gc.heaps;
+  while (heap) {
+    GcHeader *header = heap->objects;
+    while (header) {
+      GcHeader *next = header->next;
+      freeObject(header);
+      header = next;
+    }
+    GcHeap *next = heap->next;
+    memFree(heap);
+    heap = next;
+  }
+  gc.heaps = NULL;
+  pthread_mutex_unlock(&gc.lock);
+  localHeap = NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef GC_H_
+#define GC_H_
+
+#include <stddef.h>
+
+// script values (numbers, strings and arrays) live on a traced heap. nothing
+// frees them by hand: a collection marks what the symbol tables, the
+// evaluator stacks, tasks and channels still reach and sweeps the rest
+
+#define GC_MIN_HEAP (1 << 20) // bytes allocated before the first collection
+
+typedef enum GcKind {
+  GC_STATIC, // not on the heap, e.g. a number literal in the ast
+  GC_NUMBER,
+  GC_STRING,
+  GC_ARRAY,
+} GcKind;
+
+// sits right before every value, whether it is on the heap or not
+typedef struct GcHeader {
+  struct GcHeader *next;
+  size_t size; // bytes of the value, arrays add their payload
+  unsigned char kind;
+  unsigned char marked;
+} GcHeader;
+
+// a number that lives outside the heap but can sit in the same slots
+typedef struct GcNumber {
+  GcHeader header;
+  double value;
+} GcNumber;
+
+void *gcAlloc(GcKind kind, size_t size);
+double *gcNumber(double value);
+char *gcString(const char *value);
+
+// accounts memory an object owns outside its block, like an array payload
+void gcTrack(long bytes);
+
+// values never move and are never written after they are made, so slots can
+// share them freely
+void gcMark(void *value);
+
+// a collection is due
+int gcWanted(void);
+
+// frees every value that was not marked since the last sweep. no evaluator
+// may run on another thread while it does
+void gcSweep(void);
+
+// the roots could not be scanned now, try again after some more allocation
+void gcPostpone(void);
+
+// frees the whole heap at exit
+void gcShutdown(void);
+#endif // GC_H_
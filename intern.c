@@ -0,0 +1,107 @@
+#include "intern.h"
+#include "alloc.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Interned {
+  char *name;
+  size_t length;
+  uint32_t hash;
+} Interned;
+
+// lexer threads intern at the same time, the top bits of the hash pick one
+// of the shards and only that shard is locked
+#define NAME_SHARDS 64
+
+// open addressing, kept at most half full
+typedef struct Shard {
+  pthread_mutex_t lock;
+  Interned *slots;
+  size_t capacity;
+  size_t count;
+} Shard;
+
+static Shard shards[NAME_SHARDS] = {
+    [0 ... NAME_SHARDS - 1] = {.lock = PTHREAD_MUTEX_INITIALIZER}};
+
+static uint32_t hashBytes(const char *bytes, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char)bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static Interned *findSlot(Interned *slots, size_t capacity, const char *name,
+                          size_t length, uint32_t hash) {
+  size_t i = hash & (capacity - 1);
+  while (slots[i].name &&
+         (slots[i].hash != hash || slots[i].length != length ||
+          memcmp(slots[i].name, name, length) != 0)) {
+    i = (i + 1) & (capacity - 1);
+  }
+  return &slots[i];
+}
+
+static void growNames(Shard *names) {
+  size_t capacity = names->capacity ? names->capacity * 2 : 64;
+  Interned *slots = (Interned *)memCalloc(capacity, sizeof(Interned));
+  if (!slots) {
+    printf("failed allocating the name table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < names->capacity; i++) {
+    Interned *old = &names->slots[i];
+    if (old->name) {
+      *findSlot(slots, capacity, old->name, old->length, old->hash) = *old;
+    }
+  }
+  memFree(names->slots);
+  names->slots = slots;
+  names->capacity = capacity;
+}
+
+char *intern(const char *name, size_t length) {
+  uint32_t hash = hashBytes(name, length);
+  Shard *names = &shards[hash >> 26];
+
+  pthread_mutex_lock(&names->lock);
+  if ((names->count + 1) * 2 > names->capacity) {
+    growNames(names);
+  }
+
+  Interned *slot = findSlot(names->slots, names->capacity, name, length, hash);
+  if (!slot->name) {
+    slot->name = (char *)memAlloc(length + 1);
+    if (!slot->name) {
+      printf("failed allocating a name\n");
+      exit(EXIT_FAILURE);
+    }
+    memcpy(slot->name, name, length);
+    slot->name[length] = '\0';
+    slot->length = length;
+    slot->hash = hash;
+    names->count++;
+  }
+  char *interned = slot->name; // the slot moves once the table grows
+  pthread_mutex_unlock(&names->lock);
+  return interned;
+}
+
+void freeInterned(void) {
+  for (int s = 0; s < NAME_SHARDS; s++) {
+    Shard *names = &shards[s];
+    for (size_t i = 0; i < names->capacity; i++) {
+      memFree(names->slots[i].name);
+    }
+    memFree(names->slots);
+    names->slots = NULL;
+    names->capacity = 0;
+    names->count = 0;
+  }
+}
@@ -0,0 +1,17 @@
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#include <stddef.h>
+
+// identifier names are interned by the lexer: every distinct name is stored
+// once and the same name always comes back as the same pointer. the ast and
+// the symbol tables hold these pointers, so two names are equal exactly
+// when the pointers are. interned names live until freeInterned. intern
+// may be called from several lexer threads at once
+
+// the interned copy of the first length bytes of name
+char *intern(const char *name, size_t length);
+
+// frees every interned name
+void freeInterned(void);
+#endif // INTERN_H_
@@ -1,8 +1,17 @@
 #include "interpreter.h"
+#include "alloc.h"
 #include "common.h"
 #include "lexer.h"
 #include "parser.h"
+#include "array.h"
+#include "budget.h"
+#include "builtin.h"
+#include "channel.h"
+#include "compile.h"
+#include "parallel.h"
 #include "symbol.h"
+#include "task.h"
+#include "types.h"
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -54,13 +63,13 @@ static double convertStrToDouble(char *s) {
   return val;
 }
 
-void printSymbolError(SymbolError err, Loc loc, char *name, char *type) {
+void printSymbolError(SymbolError err, Loc loc, char *name, ValueType type) {
   switch (err) {
   case SYMBOL_MEM_ERROR:
     printEvalError(loc, "failed allocating memory");
     exit(EXIT_FAILURE);
   case SYMBOL_TYPE_ERROR:
-    printEvalError(loc, "TypeError: cannot assign type of %s", type);
+    printEvalError(loc, "TypeError: cannot assign type of %s", typeName(type));
     exit(EXIT_FAILURE);
   case SYMBOL_DUPLICATE_ERROR:
     printEvalError(loc, "ReferenceError: %s is already declared\n", name);
@@ -73,6 +82,20 @@ void printSymbolError(SymbolError err, Loc loc, char *name, char *type) {
   }
 }
 
+// the stack this thread is evaluating on, for errors raised outside of it
+static __thread EvalStack *runningEval;
+
+void reportMemoryError(const char *message) {
+  EvalStack *s = runningEval;
+  if (!s || s->frameCount == 0) {
+    fflush(stdout);
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+  }
+  printEvalError(nodeLoc(s->frames[s->frameCount - 1].node), "%s", message);
+  exit(EXIT_FAILURE);
+}
+
 Result newResult(void *data, int nodeType) {
   Result res = {0};
   res.NodeType = nodeType;
@@ -80,91 +103,165 @@ Result newResult(void *data, int nodeType) {
   return res;
 }
 
-void freeResult(Result *res) {
-  if (res && res->NodeType == NODE_STRING_LITERAL) {
-    free(res->result);
-  } else if (res && res->isAllocated) {
-    free(res->result);
+void markResult(Result *res) {
+  switch (res->NodeType) {
+  case NODE_NUMBER:
+  case NODE_STRING_LITERAL:
+  case NODE_ARRAY_VALUE:
+    gcMark(res->result);
+    break;
+  }
+}
+
+// registers the array under the node's name
+static void declareArray(AstNode *node, Parser *p, Array *arr) {
+  SymbolError err =
+      insertArray(p->ctx, node->array.name, node->array.type, arr);
+
+  if (err != SYMBOL_ERROR_NONE) {
+    printSymbolError(err, nodeLoc(node), node->array.name, node->array.type);
+    exit(EXIT_FAILURE);
   }
 }
 
-void insertFixedStringArray(AstNode *node, Parser *p, int size) {
-  char **values = (char **)calloc(size, sizeof(char *));
+static ArrayKind arrayKindOf(ValueType type) {
+  return type == TYPE_STRING_ARRAY ? ARRAY_STRING : ARRAY_NUMBER;
+}
 
+// evaluates the literal elements of the node into arr starting at index 0
+static void fillArrayElements(AstNode *node, Parser *p, Array *arr) {
   for (int i = 0; i < node->array.actualSize; i++) {
-    if (node->array.elements[i]) {
-      Result res = EvalAst(node->array.elements[i], p);
-      values[i] = strdup((char *)res.result);
-      freeResult(&res);
+    Result res = EvalAst(node->array.elements[i], p);
+    if (res.NodeType == NODE_NONE) {
+      break;
+    }
+
+    if (arr->kind == ARRAY_STRING) {
+      if (arr->isFixed) {
+        arr->strings[i] = (char *)res.result;
+      } else {
+        arrayPushString(arr, (char *)res.result);
+      }
+    } else {
+      if (arr->isFixed) {
+        arr->numbers[i] = *(double *)res.result;
+      } else {
+        arrayPushNumber(arr, *(double *)res.result);
+      }
     }
   }
+}
 
-  SymbolError err = insertArray(p->ctx, node->array.name, node->array.type,
-                                size, values, node->array.isFixed);
+int evalArraySize(AstNode *node, Parser *p) {
+  Result res = EvalAst(node->array.arraySize, p);
+  if (res.NodeType != NODE_NUMBER) {
+    printEvalError(nodeLoc(node), "size of array %s must be a number",
+                   node->array.name);
+    exit(EXIT_FAILURE);
+  }
+  int size = (int)*(double *)res.result;
 
-  if (err != SYMBOL_ERROR_NONE) {
-    printSymbolError(err, node->loc, node->array.name, node->array.type);
+  if (size < 0) {
+    printEvalError(nodeLoc(node), "size of array %s cannot be negative",
+                   node->array.name);
     exit(EXIT_FAILURE);
   }
+  return size;
 }
 
-void insertFixedNumberArray(AstNode *node, Parser *p, int size) {
-  double *values = (double *)calloc(size, sizeof(double));
-  for (int i = 0; i < size; i++) {
-    if (node->array.elements[i]) {
-      Result res = EvalAst(node->array.elements[i], p);
-      values[i] = *(double *)res.result;
-    }
-  }
+void handleFixedArrayInsert(AstNode *node, Parser *p) {
+  int size = evalArraySize(node, p);
 
-  SymbolError err = insertArray(p->ctx, node->array.name, node->array.type,
-                                size, values, node->array.isFixed);
-  if (err != SYMBOL_ERROR_NONE) {
-    printSymbolError(err, node->loc, node->array.name, node->array.type);
+  if (node->array.actualSize > size) {
+    printEvalError(nodeLoc(node), "array %s of size %d cannot hold %d elements",
+                   node->array.name, size, node->array.actualSize);
     exit(EXIT_FAILURE);
   }
+
+  Array *arr = newArray(arrayKindOf(node->array.type), size, 1);
+  arr->length = size;
+  fillArrayElements(node, p, arr);
+  declareArray(node, p, arr);
 }
 
-void handleFixedArrayInsert(AstNode *node, Parser *p) {
+// `name[]:type = expr;` copies the array the expression evaluates to
+void handleArrayExprInsert(AstNode *node, Parser *p) {
+  Result res = EvalAst(node->array.init, p);
+  ArrayKind kind = arrayKindOf(node->array.type);
 
-  Result res = EvalAst(node->array.arraySize, p);
-  double arraySize = *(double *)res.result;
+  if (res.NodeType != NODE_ARRAY_VALUE || ((Array *)res.result)->kind != kind) {
+    printEvalError(nodeLoc(node), "cannot assign type of %s to %s",
+                   getDataType(res), typeName(node->array.type));
+    exit(EXIT_FAILURE);
+  }
 
-  int size = (int)arraySize;
-  if (strcmp(node->array.type, "string") == 0) {
-    insertFixedStringArray(node, p, size);
-  } else if (strcmp(node->array.type, "number") == 0) {
-    insertFixedNumberArray(node, p, size);
+  Array *value = (Array *)res.result;
+  int size = node->array.isFixed ? evalArraySize(node, p) : value->length;
+  if (value->length > size) {
+    printEvalError(nodeLoc(node), "array %s of size %d cannot hold %d elements",
+                   node->array.name, size, value->length);
+    exit(EXIT_FAILURE);
   }
+
+  Array *arr = newArray(kind, size, node->array.isFixed);
+  arrayCopy(arr, value);
+  arr->length = size;
+  declareArray(node, p, arr);
 }
 
-void freeEntry(SymbolTableEntry *entry) {
+// `name = expr;` on an array replaces its elements in place
+static void assignArray(AstNode *node, Array *arr, Result res) {
+  if (res.NodeType != NODE_ARRAY_VALUE ||
+      ((Array *)res.result)->kind != arr->kind) {
+    printEvalError(nodeLoc(node), "cannot assign type of %s to %s[]",
+                   getDataType(res),
+                   arr->kind == ARRAY_STRING ? "string" : "number");
+    exit(EXIT_FAILURE);
+  }
 
-  if (entry->isParam) {
-    free(entry);
+  Array *value = (Array *)res.result;
+  if (arr->isFixed && value->length != arr->length) {
+    printEvalError(nodeLoc(node),
+                   "cannot assign %d elements to array %s of size %d",
+                   value->length, node->identifier.name, arr->length);
+    exit(EXIT_FAILURE);
+  }
+
+  if (value != arr) {
+    arrayCopy(arr, value);
   }
 }
 
-void printResult(Result *res) {
-  if (!res) {
+void handleDynamicArrayInsert(AstNode *node, Parser *p) {
+  Array *arr =
+      newArray(arrayKindOf(node->array.type), node->array.actualSize, 0);
+  fillArrayElements(node, p, arr);
+  declareArray(node, p, arr);
+}
+
+// `name[n]:type;` is zero filled, `name[]:type;` starts empty
+void handleArrayDeclaration(AstNode *node, Parser *p) {
+  ArrayKind kind = arrayKindOf(node->array.type);
+
+  if (node->array.isFixed) {
+    int size = evalArraySize(node, p);
+    Array *arr = newArray(kind, size, 1);
+    arr->length = size;
+    declareArray(node, p, arr);
     return;
   }
-  if (res->NodeType == NODE_STRING_LITERAL) {
-    printf(YELLOW "%s" RESET, trimQuotes((char *)res->result));
-  } else {
-    printf(MAGENTA "%.0lf" RESET, *(double *)res->result);
-  }
+  declareArray(node, p, newArray(kind, 0, 0));
 }
 
-void printArray(SymbolTableEntry *entry, Parser *p) {
+void printArray(Array *arr) {
   printf(GREEN "[ " RESET);
-  if (strcmp(entry->type, "string") == 0) {
+  if (arr->kind == ARRAY_STRING) {
 
-    char **elements = (char **)entry->value;
-    for (int i = 0; i < entry->arraySize; i++) {
+    char **elements = arr->strings;
+    for (int i = 0; i < arr->length; i++) {
       if (elements[i]) {
         printf(YELLOW "%s" RESET, elements[i]);
-        if (i < entry->arraySize - 1) {
+        if (i < arr->length - 1) {
           printf(", ");
         }
       }
@@ -173,10 +270,10 @@ void printArray(SymbolTableEntry *entry, Parser *p) {
     return;
   }
 
-  double *elements = (double *)entry->value;
-  for (int i = 0; i < entry->arraySize; i++) {
+  double *elements = arr->numbers;
+  for (int i = 0; i < arr->length; i++) {
     printf(MAGENTA "%.0lf" RESET, elements[i]);
-    if (i < entry->arraySize - 1) {
+    if (i < arr->length - 1) {
       printf(", ");
     }
   }
@@ -185,1120 +282,1499 @@ void printArray(SymbolTableEntry *entry, Parser *p) {
   return;
 }
 
-void insertDynamicStringArray(AstNode *node, Parser *p) {
-  int size = 0;
-  int capacity = 10;
-  char **values = (char **)calloc(capacity, sizeof(char *));
+void printResult(Result *res) {
+  if (!res) {
+    return;
+  }
+  if (res->NodeType == NODE_STRING_LITERAL) {
+    printf(YELLOW "%s" RESET, trimQuotes((char *)res->result));
+  } else if (res->NodeType == NODE_ARRAY_VALUE) {
+    printArray((Array *)res->result);
+  } else {
+    printf(MAGENTA "%.0lf" RESET, *(double *)res->result);
+  }
+}
 
-  while (1) {
-    if (node->array.elements[size]) {
-      Result res = EvalAst(node->array.elements[size], p);
-      if (res.NodeType == NODE_NONE) {
-        break;
-      }
+// arrays always live in the global table and a name cannot be declared twice,
+// so the first resolution of an element node stays valid for the whole run
+static Array *resolveArray(AstNode *node, Parser *p) {
+  if (node->arrayElm.array) {
+    return node->arrayElm.array;
+  }
 
-      if (size >= capacity) {
-        char **newValues =
-            (char **)realloc(values, (sizeof(char *) * (capacity *= 2)));
-        if (newValues == NULL) {
-          // Handle realloc failure, free allocated memory, and exit
-          for (int i = 0; i < size; i++) {
-            free(values[i]);
-          }
-          free(values);
-          fprintf(stderr,
-                  "Memory allocation failed during dynamic array resizing.\n");
-          exit(EXIT_FAILURE);
-        }
-        values = newValues;
-      }
+  SymbolTableEntry *var =
+      lookupSymbol(p->ctx, node->arrayElm.name, SYMBOL_KIND_VARIABLES);
 
-      values[size] = strdup((char *)res.result);
-      freeResult(&res);
-      (size)++;
-    } else {
-      break;
-    }
+  if (!var) {
+    printEvalError(nodeLoc(node), "array %s is not decleared\n",
+                   node->arrayElm.name);
+    exit(EXIT_FAILURE);
   }
 
-  SymbolError err = insertArray(p->ctx, node->array.name, node->array.type,
-                                size, values, node->array.isFixed);
-  if (err != SYMBOL_ERROR_NONE) {
-    printSymbolError(err, node->loc, node->array.name, node->array.type);
+  if (!var->isArray) {
+    printEvalError(nodeLoc(node), " %s is not an array \n",
+                   node->arrayElm.name);
     exit(EXIT_FAILURE);
   }
-}
 
-void handleBound(AstNode *node, SymbolTableEntry *var, int index) {
+  node->arrayElm.array = (Array *)var->value;
+  return node->arrayElm.array;
+}
 
-  if (var->isFixed) {
-    if (var->arraySize <= index) {
-      printEvalError(node->loc,
-                     "index out of bound canot access %d index. Array `%s` is "
-                     "only size of %d\n",
-                     var->arraySize, var->symbol, index);
-      exit(EXIT_FAILURE);
-    }
-  } else {
-    if (var->arraySize <= index) {
-      if (!(index <= var->arraySize)) {
-        printEvalError(node->loc, "cannot access  index %d ", index);
-        exit(EXIT_FAILURE);
-      }
-      if (strcmp(var->type, "string") == 0) {
-        var->value =
-            (char **)realloc(var->value, sizeof(char *) * (var->arraySize + 1));
-      } else {
-        var->value = (double *)realloc(var->value,
-                                       sizeof(double) * (var->arraySize + 1));
-      }
+// top level functions are never removed or declared twice, so a call site
+// keeps the one it found. only a function declared in an open scope could
+// shadow it, while there is one the call looks the name up every time
+static SymbolTableEntry *resolveFunction(AstNode *node, Parser *p) {
+  if (p->ctx->localFunctions == 0) {
+    SymbolTableEntry *cached =
+        __atomic_load_n(&node->function.call.target, __ATOMIC_ACQUIRE);
+    if (cached) {
+      return cached;
     }
   }
-}
 
-void insertDynamicNumberArray(AstNode *node, Parser *p) {
+  SymbolTableEntry *sym =
+      lookupSymbol(p->ctx, node->function.call.name, SYMBOL_KIND_FUNCTION);
+  if (sym && p->ctx->localFunctions == 0) {
+    __atomic_store_n(&node->function.call.target, sym, __ATOMIC_RELEASE);
+  }
+  return sym;
+}
 
-  int size = 0;
-  int capacity = 10;
+// checks the index for a write. fixed arrays must stay in bound, dynamic
+// arrays may also append right after their last element, but not from a
+// parfor where another worker could be using the payload
+void handleBound(AstNode *node, Parser *p, Array *arr, int index) {
+  if (index >= 0 && index < arr->length) {
+    return;
+  }
 
-  double *values = (double *)malloc(sizeof(double) * capacity);
-  while (1) {
-    if (node->array.elements[size]) {
-      Result res = EvalAst(node->array.elements[size], p);
-      if (res.NodeType == NODE_NONE) {
-        break;
-      }
+  if (p->inParallel) {
+    printEvalError(nodeLoc(node),
+                   "index %d is out of bound, array `%s` cannot grow inside "
+                   "a parfor",
+                   index, node->arrayElm.name);
+    exit(EXIT_FAILURE);
+  }
 
-      if (size >= capacity) {
-        values = (double *)realloc(values, (sizeof(double) * (capacity *= 2)));
-      }
-      values[size] = *(double *)res.result;
-      freeResult(&res);
-      size++;
-    } else {
-      break;
-    }
+  if (arr->isFixed) {
+    printEvalError(nodeLoc(node),
+                   "index out of bound canot access %d index. Array `%s` is "
+                   "only size of %d\n",
+                   index, node->arrayElm.name, arr->length);
+    exit(EXIT_FAILURE);
   }
 
-  SymbolError err = insertArray(p->ctx, node->array.name, node->array.type,
-                                size, values, node->array.isFixed);
-  if (err != SYMBOL_ERROR_NONE) {
-    printSymbolError(err, node->loc, node->array.name, node->array.type);
+  if (index != arr->length) {
+    printEvalError(nodeLoc(node), "cannot access  index %d ", index);
     exit(EXIT_FAILURE);
   }
-}
 
-void handleDynamicArrayInsert(AstNode *node, Parser *p) {
+  arrayReserve(arr, arr->length + 1);
+  arr->length++;
+}
 
-  if (strcmp(node->array.type, "string") == 0) {
-    insertDynamicStringArray(node, p);
-  } else {
-    insertDynamicNumberArray(node, p);
+const char *getDataType(Result res) {
+  ValueType type = resultType(res);
+  if (type == TYPE_UNKNOWN) {
+    printf("unknown result type\n");
+    exit(EXIT_FAILURE);
   }
+  return typeName(type);
 }
 
-static char *inferDatatype(AstNode *node) {
-  if (strcmp(node->identifier.type, "iden_num") == 0) {
-    return "number";
+// ------------------------- evaluator stack -------------------------------
+//
+// EvalAst does not recurse on the C stack. Every node that has children gets
+// an EvalFrame on p->eval and is resumed through its `state` once a child has
+// pushed its Result onto the value stack. Both stacks live on the heap and
+// grow on demand, so script recursion depth is bounded by maxDepth only.
+
+EvalStack *createEvalStack(int maxDepth) {
+  EvalStack *s = (EvalStack *)memCalloc(1, sizeof(EvalStack));
+  if (!s) {
+    printf("failed allocating evaluator stack\n");
+    exit(EXIT_FAILURE);
   }
-  if (strcmp(node->identifier.type, "iden_str") == 0) {
-    return "string";
+
+  s->frameCapacity = 256;
+  s->frames = (EvalFrame *)memAlloc(sizeof(EvalFrame) * s->frameCapacity);
+  s->valueCapacity = 256;
+  s->values = (Result *)memAlloc(sizeof(Result) * s->valueCapacity);
+  if (!s->frames || !s->values) {
+    printf("failed allocating evaluator stack\n");
+    exit(EXIT_FAILURE);
   }
-  printEvalError(node->loc, "unknown result type\n");
-  exit(EXIT_FAILURE);
+  s->maxDepth = maxDepth;
+  return s;
 }
 
-static char *getDataType(Result res) {
-  switch (res.NodeType) {
-  case NODE_NUMBER:
-    return "number";
-  case NODE_STRING_LITERAL:
-    return "string";
+void freeEvalStack(EvalStack *s) {
+  if (!s) {
+    return;
   }
-  printf("unknown result type\n");
-  exit(EXIT_FAILURE);
+  memFree(s->frames);
+  memFree(s->values);
+  memFree(s);
 }
 
-// eval ast function
-Result EvalAst(AstNode *node, Parser *p) {
-  switch (node->type) {
-  case NODE_RETURN: {
-    Result res = EvalAst(node->expr, p);
-    res.isReturn = 1;
-    return res;
+static void pushValue(EvalStack *s, Result res) {
+  if (s->valueCount >= s->valueCapacity) {
+    s->valueCapacity *= 2;
+    Result *values =
+        (Result *)memRealloc(s->values, sizeof(Result) * s->valueCapacity);
+    if (!values) {
+      printf("failed growing evaluator stack\n");
+      exit(EXIT_FAILURE);
+    }
+    s->values = values;
   }
+  s->values[s->valueCount++] = res;
+}
 
-  case NODE_NUMBER: {
-    Result res = newResult(&node->number, NODE_NUMBER);
-    return res;
-  }
+static Result popValue(EvalStack *s) { return s->values[--s->valueCount]; }
 
-  case NODE_FUNCTION: {
-    SymbolTableEntry *sym = lookupSymbol(p->ctx, node->function.defination.name,
-                                         SYMBOL_KIND_FUNCTION);
+static void pushFrame(Parser *p, AstNode *node) {
+  EvalStack *s = p->eval;
+  if (s->frameCount >= s->maxDepth) {
+    printEvalError(nodeLoc(node),
+                   "StackOverflowError: maximum evaluation depth of %d "
+                   "exceeded",
+                   s->maxDepth);
+    exit(EXIT_FAILURE);
+  }
 
-    if (sym) {
-      printEvalError(node->loc, "%s is already defined",
-                     node->function.defination.name);
+  if (s->frameCount >= s->frameCapacity) {
+    s->frameCapacity *= 2;
+    EvalFrame *frames = (EvalFrame *)memRealloc(
+        s->frames, sizeof(EvalFrame) * s->frameCapacity);
+    if (!frames) {
+      printf("failed growing evaluator stack\n");
       exit(EXIT_FAILURE);
     }
+    s->frames = frames;
+  }
 
-    insertFunctionSymbol(p->ctx, node->function.defination.name,
-                         node->function.defination.returnType,
-                         node->function.defination.paramsCount,
-                         node->function.defination.params, SYMBOL_KIND_FUNCTION,
-                         node->function.defination.body, p->level);
+  EvalFrame *f = &s->frames[s->frameCount++];
+  f->node = node;
+  f->aux = NULL;
+  f->state = 0;
+  f->index = 0;
+}
 
-    break;
+// pops the current frame and hands its result to the parent
+static void finishFrame(EvalStack *s, Result res) {
+  s->frameCount--;
+  pushValue(s, res);
+}
+
+static Result concatStrings(Result left, Result right) {
+  char *leftStr = trimQuotes((char *)left.result);
+  char *rightStr = trimQuotes((char *)right.result);
+
+  size_t len1 = strlen(leftStr);
+  size_t len2 = strlen(rightStr);
+
+  char *concatenated = (char *)gcAlloc(GC_STRING, len1 + len2 + 1);
+  strcpy(concatenated, leftStr);
+  strcat(concatenated, rightStr);
+  return newResult(concatenated, NODE_STRING_LITERAL);
+}
+
+static Result evalBinaryOp(AstNode *node, Result left, Result right) {
+  if (left.NodeType == NODE_NONE || right.NodeType == NODE_NONE) {
+    printEvalError(nodeLoc(node), "Error: Null result encountered\n");
+    exit(EXIT_FAILURE);
   }
 
-  case NODE_FUNCTION_CALL: {
+  if (left.NodeType == NODE_ARRAY_VALUE || right.NodeType == NODE_ARRAY_VALUE) {
+    return evalArrayOp(node, left, right);
+  }
 
-    SymbolTableEntry *sym =
-        lookupSymbol(p->ctx, node->function.call.name, SYMBOL_KIND_FUNCTION);
+  Result res = {0};
+
+  if (left.NodeType == NODE_NUMBER && right.NodeType == NODE_NUMBER) {
+    double leftVal = *(double *)(left.result);
+    double rightVal = *(double *)(right.result);
 
-    if (!sym) {
-      printEvalError(node->loc, "undeclared function %s was called\n",
-                     node->function.call.name);
+    double *val = gcNumber(0);
+
+    switch (node->binaryOp.op) {
+    case TOKEN_PLUS: {
+      *val = leftVal + rightVal;
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_MINUS: {
+      *val = leftVal - rightVal;
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_MODULO: {
+      *val = (int)leftVal % (int)rightVal;
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_MULTIPLY: {
+      *val = leftVal * rightVal;
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_DIVIDE: {
+      *val = leftVal / rightVal;
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_DB_EQUAL: {
+      *val = (double)(leftVal == rightVal);
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_EQ_GREATER: {
+      *val = (double)(leftVal >= rightVal);
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_EQ_LESSER: {
+      *val = (double)(leftVal <= rightVal);
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_LESSER: {
+      *val = (double)(leftVal < rightVal);
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_GREATER: {
+      *val = (double)(leftVal > rightVal);
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_EQ_NOT: {
+      *val = (double)(leftVal != rightVal);
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_AND: {
+      *val = (double)(leftVal && rightVal);
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    case TOKEN_OR: {
+      *val = (double)(leftVal || rightVal);
+      res = newResult(val, NODE_NUMBER);
+      break;
+    }
+    default:
+      printEvalError(nodeLoc(node), "Error: Unknown binary operator\n");
       exit(EXIT_FAILURE);
     }
-    // update the func symbol table params with the value of args
+    return res;
+  } else if (left.NodeType == NODE_STRING_LITERAL &&
+             right.NodeType == NODE_STRING_LITERAL) {
+    return concatStrings(left, right);
+  }
 
-    for (int i = 0; i < node->function.call.argsCount; i++) {
-      Result res = EvalAst(node->function.call.args[i], p);
+  printEvalError(nodeLoc(node),
+                 "Error: cannot do ( %s ) operations between %s and %s\n",
+                 tokenNames[node->binaryOp.op], getDataType(left),
+                 getDataType(right));
+  exit(EXIT_FAILURE);
+}
 
-      char *paramType = sym->function.params[i]->type;
+// a binary node rewrites itself on its first run into a form made for the
+// operand types it saw, which skips the type and operator dispatch of
+// evalBinaryOp. the form checks its types and turns the node back into the
+// generic one for good when they change. nodes are shared between threads,
+// the form is swapped atomically and every form gives the same result
 
-      if (strcmp(paramType, getDataType(res)) != 0) {
-        printEvalError(node->loc, "expected argument of type %s  but got %s",
-                       paramType, getDataType(res));
-        exit(EXIT_FAILURE);
-      }
-      updateParamWithArgs(sym, i, &res);
-      freeResult(&res);
-    }
+static Result deoptBinary(AstNode *node, Result left, Result right) {
+  __atomic_store_n(&node->binaryOp.quick, evalBinaryOp, __ATOMIC_RELAXED);
+  return evalBinaryOp(node, left, right);
+}
 
-    Result value = EvalAst(sym->function.body, p);
+static int bothNumbers(Result left, Result right, double *a, double *b) {
+  if (left.NodeType != NODE_NUMBER || right.NodeType != NODE_NUMBER) {
+    return 0;
+  }
+  *a = *(double *)left.result;
+  *b = *(double *)right.result;
+  return 1;
+}
 
-    if (sym->type && (value.NodeType == NODE_NONE)) {
-      printEvalError(node->loc, "expected return type to be %s but got void\n",
-                     sym->type);
-      exit(EXIT_FAILURE);
-    }
+static Result quickAdd(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber(a + b), NODE_NUMBER);
+}
 
-    if (strcmp(sym->type, getDataType(value)) != 0) {
-      printEvalError(
-          node->loc,
-          " cannot return %s from the function with  the return type of %s",
-          getDataType(value), sym->type);
-      exit(EXIT_FAILURE);
-    }
+static Result quickSubtract(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber(a - b), NODE_NUMBER);
+}
 
-    return value;
+static Result quickMultiply(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
   }
+  return newResult(gcNumber(a * b), NODE_NUMBER);
+}
 
-  case NODE_BINARY_OP: {
-    Result left = EvalAst(node->binaryOp.left, p);
-    Result right = EvalAst(node->binaryOp.right, p);
+static Result quickDivide(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber(a / b), NODE_NUMBER);
+}
 
-    if (left.NodeType == NODE_NONE || right.NodeType == NODE_NONE) {
-      printEvalError(node->loc, "Error: Null result encountered\n");
-      exit(EXIT_FAILURE);
-    }
+static Result quickModulo(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber((int)a % (int)b), NODE_NUMBER);
+}
 
-    Result res = {0};
+static Result quickLess(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber((double)(a < b)), NODE_NUMBER);
+}
 
-    if (left.NodeType == NODE_NUMBER && right.NodeType == NODE_NUMBER) {
-      double leftVal = *(double *)(left.result);
-      double rightVal = *(double *)(right.result);
+static Result quickLessEqual(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber((double)(a <= b)), NODE_NUMBER);
+}
 
-      // Allocate memory dynamically for the result
-      double *val = malloc(sizeof(double));
-      if (val == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
-      }
+static Result quickGreater(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber((double)(a > b)), NODE_NUMBER);
+}
 
-      switch (node->binaryOp.op) {
-      case TOKEN_PLUS: {
-        *val = leftVal + rightVal;
-        res = newResult(val, NODE_NUMBER); // Pass dynamically allocated memory
-        break;
-      }
-      case TOKEN_MINUS: {
-        *val = leftVal - rightVal;
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_MODULO: {
-        *val = (int)leftVal % (int)rightVal;
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_MULTIPLY: {
-        *val = leftVal * rightVal;
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_DIVIDE: {
-        *val = leftVal / rightVal;
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_DB_EQUAL: {
-        *val = (double)(leftVal == rightVal);
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_EQ_GREATER: {
-        *val = (double)(leftVal >= rightVal);
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_EQ_LESSER: {
-        *val = (double)(leftVal <= rightVal);
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_LESSER: {
-        *val = (double)(leftVal < rightVal);
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_GREATER: {
-        *val = (double)(leftVal > rightVal);
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_EQ_NOT: {
-        *val = (double)(leftVal != rightVal);
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_AND: {
-        *val = (double)(leftVal && rightVal);
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      case TOKEN_OR: {
-        *val = (double)(leftVal || rightVal);
-        res = newResult(val, NODE_NUMBER);
-        break;
-      }
-      default:
-        printEvalError(node->loc, "Error: Unknown binary operator\n");
-        exit(EXIT_FAILURE);
-      }
+static Result quickGreaterEqual(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber((double)(a >= b)), NODE_NUMBER);
+}
 
-      // Free the results used, as needed
-      freeResult(&left);
-      freeResult(&right);
-      res.isAllocated = 1;
-      return res;
-    } else if (left.NodeType == NODE_STRING_LITERAL &&
-               right.NodeType == NODE_STRING_LITERAL) {
-      char *leftStr = trimQuotes((char *)left.result);
-      char *rightStr = trimQuotes((char *)right.result);
-
-      size_t len1 = strlen(leftStr);
-      size_t len2 = strlen(rightStr);
-
-      char *concatenated = (char *)malloc(len1 + len2 + 1);
-      if (concatenated == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
-      }
+static Result quickEqual(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber((double)(a == b)), NODE_NUMBER);
+}
 
-      strcpy(concatenated, leftStr);
-      strcat(concatenated, rightStr);
+static Result quickNotEqual(AstNode *node, Result left, Result right) {
+  double a, b;
+  if (!bothNumbers(left, right, &a, &b)) {
+    return deoptBinary(node, left, right);
+  }
+  return newResult(gcNumber((double)(a != b)), NODE_NUMBER);
+}
 
-      freeResult(&left); // Free left and right strings after use
-      freeResult(&right);
+static Result quickConcat(AstNode *node, Result left, Result right) {
+  if (left.NodeType != NODE_STRING_LITERAL ||
+      right.NodeType != NODE_STRING_LITERAL) {
+    return deoptBinary(node, left, right);
+  }
+  return concatStrings(left, right);
+}
 
-      return newResult(
-          concatenated,
-          NODE_STRING_LITERAL); // Pass dynamically allocated memory
-    } else {
-      printEvalError(
-          node->loc, "Error: cannot do ( %s ) operations between %s and %s\n",
-          tokenNames[node->binaryOp.op], getDataType(left), getDataType(right));
-      exit(EXIT_FAILURE);
-    }
+static BinaryFn numberForm(TokenType op) {
+  switch (op) {
+  case TOKEN_PLUS:
+    return quickAdd;
+  case TOKEN_MINUS:
+    return quickSubtract;
+  case TOKEN_MULTIPLY:
+    return quickMultiply;
+  case TOKEN_DIVIDE:
+    return quickDivide;
+  case TOKEN_MODULO:
+    return quickModulo;
+  case TOKEN_LESSER:
+    return quickLess;
+  case TOKEN_EQ_LESSER:
+    return quickLessEqual;
+  case TOKEN_GREATER:
+    return quickGreater;
+  case TOKEN_EQ_GREATER:
+    return quickGreaterEqual;
+  case TOKEN_DB_EQUAL:
+    return quickEqual;
+  case TOKEN_EQ_NOT:
+    return quickNotEqual;
+  default:
+    return evalBinaryOp;
   }
+}
 
-  case NODE_UNARY_OP: {
-    Result right = EvalAst(node->unaryOp.right, p);
-    if (right.NodeType == NODE_NUMBER) {
-      double rightVal = *(double *)(right.result);
-      switch (node->unaryOp.op) {
-      case TOKEN_NOT: {
-        Result node = newResult(&(double){!rightVal}, NODE_NUMBER);
-        return node;
-      }
-      default:
-        printEvalError(node->loc, "Error: Unknown unary operator\n");
+// the first run of a binary node picks its form
+static Result quickenBinary(AstNode *node, Result left, Result right) {
+  BinaryFn quick = evalBinaryOp;
+  if (left.NodeType == NODE_NUMBER && right.NodeType == NODE_NUMBER) {
+    quick = numberForm(node->binaryOp.op);
+  } else if (left.NodeType == NODE_STRING_LITERAL &&
+             right.NodeType == NODE_STRING_LITERAL) {
+    // evalBinaryOp joins two strings whatever the operator, `.` in scripts
+    quick = quickConcat;
+  }
+  __atomic_store_n(&node->binaryOp.quick, quick, __ATOMIC_RELAXED);
+  return quick(node, left, right);
+}
+
+static Result evalReadIn(AstNode *node) {
+  int initialBufferSize = 100;
+  int currentBufferSize = 0;
+
+  char *buffer = (char *)memAlloc(sizeof(char) * initialBufferSize);
+  if (buffer == NULL) {
+    perror("Failed to allocate memory for buffer");
+    exit(EXIT_FAILURE);
+  }
+
+  while (1) {
+    if (currentBufferSize >= initialBufferSize - 1) {
+      initialBufferSize += 100;
+      char *newBuffer =
+          (char *)memRealloc(buffer, sizeof(char) * initialBufferSize);
+      if (newBuffer == NULL) {
+        perror("Failed to reallocate memory");
+        memFree(buffer); // Free original buffer before exiting
         exit(EXIT_FAILURE);
       }
-    } else {
-      printEvalError(node->loc, "Error: Invalid type for unary operation\n");
-      exit(EXIT_FAILURE);
+      buffer = newBuffer;
+    }
+
+    int ch = getchar();
+    if (ch == '\n' || ch == EOF) {
+      break;
     }
+    buffer[currentBufferSize] = ch;
+    currentBufferSize++;
   }
 
-  case NODE_IDENTIFIER_VALUE: {
+  buffer[currentBufferSize] = '\0';
+
+  Result res = {0};
 
+  if (node->read.type == TYPE_STRING) {
+    res = newResult(gcString(buffer), NODE_STRING_LITERAL);
+  } else if (node->read.type == TYPE_NUMBER) {
+    double numberValue = 0;
+    sscanf(buffer, "%lf", &numberValue);
+    res = newResult(gcNumber(numberValue), NODE_NUMBER);
+  }
+  memFree(buffer);
+
+  return res;
+}
+
+// evaluates nodes without children directly onto the value stack
+static Result evalLeaf(AstNode *node, Parser *p) {
+  switch (node->type) {
+  case NODE_NUMBER:
+    return newResult(&node->number.value, NODE_NUMBER);
+
+  case NODE_STRING_LITERAL:
+    return newResult(gcString(node->stringLiteral.value), NODE_STRING_LITERAL);
+
+  case NODE_IDENTIFIER_VALUE: {
     SymbolTableEntry *var =
         lookupSymbol(p->ctx, node->identifier.name, SYMBOL_KIND_VARIABLES);
 
     if (!var) {
-      printEvalError(node->loc, "%s is not decleared\n", node->identifier.name);
+      printEvalError(nodeLoc(node), "%s is not decleared\n",
+                     node->identifier.name);
       exit(EXIT_FAILURE);
     }
 
-    if (strcmp(var->type, "string") == 0) {
+    if (var->isArray) {
+      return newResult(var->value, NODE_ARRAY_VALUE);
+    }
 
-      Result res = newResult((char *)var->value, NODE_STRING_LITERAL);
-      freeEntry(var);
-      return res;
+    // printing trims the quotes of a string in place, so every read gets
+    // its own copy
+    if (var->type == TYPE_STRING) {
+      return newResult(gcString((char *)var->value), NODE_STRING_LITERAL);
     }
-    Result res = newResult(var->value, NODE_NUMBER);
-    freeEntry(var);
-    return res;
+    return newResult(var->value, NODE_NUMBER);
   }
 
-  case NODE_IDENTIFIER_MUTATION: {
+  case NODE_IDENTIFIER_DECLERATION: {
     SymbolTableEntry *var =
         lookupSymbol(p->ctx, node->identifier.name, SYMBOL_KIND_VARIABLES);
-    if (!var) {
-      printEvalError(node->loc, "%s is not decleared\n", node->identifier.name);
+    if (var) {
+      printEvalError(nodeLoc(node),
+                     "cannot redeclare variable %s is already decleared\n",
+                     node->identifier.name);
       exit(EXIT_FAILURE);
     }
 
-    Result res = EvalAst(node->identifier.value, p);
-
-    char *type = getDataType(res);
+    SymbolError err =
+        insertSymbol(p->ctx, node->identifier.type, node->identifier.name, NULL,
+                     SYMBOL_KIND_VARIABLES, p->level);
 
-    if (strcmp(type, var->type) != 0) {
-      printEvalError(node->loc, "cannot assign type of %s to type of %s", type,
-                     var->type);
-      freeResult(&res);
+    if (err != SYMBOL_ERROR_NONE) {
+      printSymbolError(err, nodeLoc(node), node->identifier.name,
+                       node->identifier.type);
       exit(EXIT_FAILURE);
     }
+    break;
+  }
 
-    SymbolError err = updateSymbolTableValue(var, &res);
-    if (err != SYMBOL_ERROR_NONE) {
-      printSymbolError(err, node->loc, node->identifier.name,
-                       node->identifier.type);
+  case NODE_FUNCTION: {
+    SymbolTableEntry *sym = lookupSymbol(p->ctx, node->function.defination.name,
+                                         SYMBOL_KIND_FUNCTION);
+
+    if (sym) {
+      printEvalError(nodeLoc(node), "%s is already defined",
+                     node->function.defination.name);
       exit(EXIT_FAILURE);
     }
 
+    insertFunctionSymbol(p->ctx, node->function.defination.name,
+                         node->function.defination.returnType,
+                         node->function.defination.paramsCount,
+                         node->function.defination.params, SYMBOL_KIND_FUNCTION,
+                         node->function.defination.body, p->level);
     break;
   }
 
-  case NODE_IDENTIFIER_ASSIGNMENT: {
+  case NODE_FUNCTION_READ_IN:
+    return evalReadIn(node);
 
-    SymbolTableEntry *var =
-        lookupSymbol(p->ctx, node->identifier.name, SYMBOL_KIND_VARIABLES);
+  case NODE_BREAK: {
+    Result res = newResult(NULL, NODE_BREAK);
+    res.isBreak = 1;
+    return res;
+  }
 
-    if (var && !var->isParam) {
-      printEvalError(node->loc, "cannot redeclare %s\n", node->identifier.name);
+  case NODE_CONTNUE: {
+    Result res = newResult(NULL, NODE_CONTNUE);
+    res.isContinue = 1;
+    return res;
+  }
+  }
+
+  return newResult(NULL, NODE_NONE);
+}
+
+static void checkArgs(AstNode *node, SymbolTableEntry *fn, Result *args) {
+  for (int i = 0; i < fn->function.parameterCount; i++) {
+    ValueType paramType = fn->function.params[i]->type;
+    if (paramType != resultType(args[i])) {
+      printEvalError(nodeLoc(node), "expected argument of type %s  but got %s",
+                     typeName(paramType), getDataType(args[i]));
       exit(EXIT_FAILURE);
     }
+  }
+}
 
-    Result res = EvalAst(node->identifier.value, p);
+void checkReturnValue(AstNode *node, SymbolTableEntry *fn, Result value) {
+  if (resultType(value) == fn->type) {
+    return;
+  }
 
-    char *inferedDataType = getDataType(res);
+  if (value.NodeType == NODE_NONE) {
+    printEvalError(nodeLoc(node),
+                   "expected return type to be %s but got void\n",
+                   typeName(fn->type));
+    exit(EXIT_FAILURE);
+  }
 
-    if (strcmp(node->identifier.type, inferedDataType) != 0) {
-      printEvalError(node->loc, "cannot assign typeof %s to %s\n",
-                     inferedDataType, node->identifier.type);
-      free(res.result);
-      exit(EXIT_FAILURE);
-    }
+  printEvalError(
+      nodeLoc(node),
+      " cannot return %s from the function with  the return type of %s",
+      getDataType(value), typeName(fn->type));
+  exit(EXIT_FAILURE);
+}
 
-    SymbolError err =
-        insertSymbol(p->ctx, node->identifier.type, node->identifier.name, &res,
-                     SYMBOL_KIND_VARIABLES, p->level);
+// the value a hoisted expression left in its temporary, strings get a copy
+// of their own like any variable read
+static Result hoistedResult(SymbolTableEntry *slot) {
+  if (slot->type == TYPE_STRING) {
+    return newResult(gcString((char *)slot->value), NODE_STRING_LITERAL);
+  }
+  return newResult(slot->value, NODE_NUMBER);
+}
 
-    if (err != SYMBOL_ERROR_NONE) {
-      printSymbolError(err, node->loc, node->identifier.name, inferedDataType);
+static void pushNode(Parser *p, AstNode *node) {
+  switch (node->type) {
+  case NODE_COMPILED: {
+    // a lowered expression runs in one go, the generic form of it reports
+    // what the closures could not handle
+    Closure *c = node->compiled.closure;
+    double value;
+    if (c->run(c, p, &value)) {
+      pushValue(p->eval, newResult(gcNumber(value), NODE_NUMBER));
+    } else {
+      pushNode(p, node->compiled.source);
     }
-    break;
+    return;
   }
-
-  case NODE_IDENTIFIER_DECLERATION: {
-    SymbolTableEntry *var =
+  case NODE_HOISTED: {
+    // once computed in this scope the expression is only read back
+    SymbolTableEntry *slot =
         lookupSymbol(p->ctx, node->identifier.name, SYMBOL_KIND_VARIABLES);
-    if (var) {
-      printEvalError(node->loc,
-                     "cannot redeclare variable %s is already decleared\n",
-                     node->identifier.name);
-      exit(EXIT_FAILURE);
+    if (slot->value) {
+      pushValue(p->eval, hoistedResult(slot));
+      return;
     }
+    break;
+  }
+  case NODE_NUMBER:
+  case NODE_STRING_LITERAL:
+  case NODE_IDENTIFIER_VALUE:
+  case NODE_IDENTIFIER_DECLERATION:
+  case NODE_FUNCTION:
+  case NODE_FUNCTION_READ_IN:
+  case NODE_BREAK:
+  case NODE_CONTNUE:
+    pushValue(p->eval, evalLeaf(node, p));
+    return;
+  }
+  pushFrame(p, node);
+}
 
-    SymbolError err =
-        insertSymbol(p->ctx, node->identifier.type, node->identifier.name, NULL,
-                     SYMBOL_KIND_VARIABLES, p->level);
+static int isControlFlow(Result *res) {
+  return res->isReturn || res->isBreak || res->isContinue;
+}
 
-    if (err != SYMBOL_ERROR_NONE) {
-      printSymbolError(err, node->loc, node->identifier.name,
-                       node->identifier.type);
-      exit(EXIT_FAILURE);
+// reads a loop or if condition
+static double takeCondition(EvalStack *s) {
+  Result res = popValue(s);
+  double condition = 0;
+  if (res.NodeType == NODE_NUMBER && res.result) {
+    condition = *(double *)res.result;
+  }
+  return condition;
+}
+
+// a call returned straight from the function it calls reuses the activation
+// of that function instead of stacking a new one. the statements between the
+// return and the activation are left, the parameters take the new arguments
+// and the body starts over. returns 0 when the call is not in that position
+static int reuseActivation(Parser *p, SymbolTableEntry *sym, Result *args,
+                           int argsCount) {
+  EvalStack *s = p->eval;
+  int i = s->frameCount - 2;
+  // functions declared in the body push frames of their own
+  if (i < 0 || s->frames[i].node->type != NODE_RETURN ||
+      p->ctx->localFunctions) {
+    return 0;
+  }
+
+  for (i--; i >= 0; i--) {
+    int type = s->frames[i].node->type;
+    if (type == NODE_FUNCTION_CALL) {
+      break;
+    }
+    if (type != NODE_BLOCK && type != NODE_IF_ELSE &&
+        type != NODE_WHILE_LOOP && type != NODE_FOR_LOOP) {
+      return 0;
     }
+  }
+  if (i < 0 || s->frames[i].aux != sym || s->frames[i].state != 2) {
+    return 0;
+  }
 
-    break;
+  // loops and the blocks that declare something each hold a scope
+  for (int j = s->frameCount - 3; j > i; j--) {
+    AstNode *open = s->frames[j].node;
+    if (open->type != NODE_IF_ELSE &&
+        !(open->type == NODE_BLOCK && open->block.bare)) {
+      exitScope(p->ctx);
+      p->level--;
+    }
   }
+  rebindParams(p->ctx, args, argsCount);
+  s->valueCount -= argsCount;
+  s->frameCount = i + 1;
+  pushNode(p, sym->function.body);
+  return 1;
+}
 
-  case NODE_STRING_LITERAL: {
-    char *str = strdup(node->stringLiteral.value);
-    Result res = newResult(str, NODE_STRING_LITERAL);
-    return res;
+// runs one step of the frame on top of the stack
+static void evalStep(Parser *p) {
+  EvalStack *s = p->eval;
+  EvalFrame *f = &s->frames[s->frameCount - 1];
+  AstNode *node = f->node;
+
+  // children are pushed last: pushing may move the frame array
+  switch (node->type) {
+  case NODE_RETURN: {
+    if (f->state == 0) {
+      f->state = 1;
+      pushNode(p, node->expr);
+      return;
+    }
+    Result res = popValue(s);
+    res.isReturn = 1;
+    finishFrame(s, res);
+    return;
   }
 
-  case NODE_BLOCK: {
-    p->level++;
-    enterScope(p->ctx);
-    for (int i = 0; i < node->block.statementCount; i++) {
-      AstNode *ast = node->block.statements[i];
+  case NODE_FUNCTION_CALL: {
+    switch (f->state) {
+    case 0: {
+      SymbolTableEntry *sym = resolveFunction(node, p);
+
+      if (!sym) {
+        const Builtin *builtin = lookupBuiltin(node->function.call.name);
+        if (!builtin) {
+          printEvalError(nodeLoc(node), "undeclared function %s was called\n",
+                         node->function.call.name);
+          exit(EXIT_FAILURE);
+        }
 
-      Result result = EvalAst(ast, p);
+        if (builtin->argsCount != node->function.call.argsCount) {
+          printEvalError(nodeLoc(node), "%s expects %d arguments but got %d",
+                         builtin->name, builtin->argsCount,
+                         node->function.call.argsCount);
+          exit(EXIT_FAILURE);
+        }
+        f->aux = (void *)builtin;
+        f->state = 3;
+        return;
+      }
 
-      if (result.NodeType != NODE_NONE && (result.isReturn || result.isBreak)) {
-        exitScope(p->ctx);
-        p->level--;
-        return result;
-      } else if (result.NodeType != NODE_NONE &&
-                 (ast->type == NODE_FUNCTION_READ_IN || result.isContinue)) {
-        return result;
+      if (sym->function.parameterCount != node->function.call.argsCount) {
+        printEvalError(nodeLoc(node), "%s expects %d arguments but got %d",
+                       node->function.call.name, sym->function.parameterCount,
+                       node->function.call.argsCount);
+        exit(EXIT_FAILURE);
+      }
+      f->aux = sym;
+      f->state = 1;
+    }
+    // fallthrough
+    case 1: {
+      // arguments are evaluated left to right onto the value stack
+      if (f->index < node->function.call.argsCount) {
+        AstNode *arg = node->function.call.args[f->index++];
+        pushNode(p, arg);
+        return;
       }
 
-      freeResult(&result);
-    };
-    exitScope(p->ctx);
-    p->level--;
-    break;
+      SymbolTableEntry *sym = (SymbolTableEntry *)f->aux;
+      int argsCount = node->function.call.argsCount;
+      Result *args = &s->values[s->valueCount - argsCount];
+
+      if (!node->checked) {
+        checkArgs(node, sym, args);
+      }
+      spendStep(s, node);
+      if (reuseActivation(p, sym, args, argsCount)) {
+        return;
+      }
+
+      // the call gets its own activation holding the parameters
+      enterFunctionScope(p->ctx);
+      for (int i = 0; i < argsCount; i++) {
+        updateParamWithArgs(p->ctx, sym, i, &args[i]);
+      }
+      s->valueCount -= argsCount;
+
+      f->state = 2;
+      parseLazyBody(sym->function.body);
+      pushNode(p, sym->function.body);
+      return;
+    }
+    default: {
+      SymbolTableEntry *sym = (SymbolTableEntry *)f->aux;
+      Result value = popValue(s);
+      exitScope(p->ctx);
+      checkReturnValue(node, sym, value);
+
+      // the return stops at the call that produced it
+      value.isReturn = 0;
+      finishFrame(s, value);
+      return;
+    }
+    case 3: {
+      // builtins run natively once their arguments are on the value stack
+      if (f->index < node->function.call.argsCount) {
+        AstNode *arg = node->function.call.args[f->index++];
+        pushNode(p, arg);
+        return;
+      }
+
+      const Builtin *builtin = (const Builtin *)f->aux;
+      int argsCount = node->function.call.argsCount;
+      Result *args = &s->values[s->valueCount - argsCount];
+      Result res;
+      if (builtin->wait) {
+        if (!builtin->wait(node, args, p, &res)) {
+          return; // parked, the arguments stay for the next try
+        }
+      } else {
+        res = builtin->fn(node, args);
+      }
+      s->valueCount -= argsCount;
+      finishFrame(s, res);
+      return;
+    }
+    }
   }
 
-  case NODE_IF_ELSE: {
-    Result conditionResult = EvalAst(node->ifElseBlock.condition, p);
-    if (conditionResult.NodeType != NODE_NUMBER) {
-      printEvalError(
-          node->loc,
-          "Error: Condition in if-else must be a number (interpreted as "
-          "boolean)\n");
-      exit(EXIT_FAILURE);
+  case NODE_BINARY_OP: {
+    switch (f->state) {
+    case 0:
+      f->state = 1;
+      pushNode(p, node->binaryOp.left);
+      return;
+    case 1:
+      f->state = 2;
+      pushNode(p, node->binaryOp.right);
+      return;
+    default: {
+      Result right = popValue(s);
+      Result left = popValue(s);
+      BinaryFn quick =
+          __atomic_load_n(&node->binaryOp.quick, __ATOMIC_RELAXED);
+      if (!quick) {
+        quick = quickenBinary;
+      }
+      finishFrame(s, quick(node, left, right));
+      return;
     }
+    }
+  }
 
-    double conditionValue = *(double *)(conditionResult.result);
+  case NODE_UNARY_OP: {
+    if (f->state == 0) {
+      f->state = 1;
+      pushNode(p, node->unaryOp.right);
+      return;
+    }
 
-    freeResult(&conditionResult);
+    Result right = popValue(s);
+    if (right.NodeType != NODE_NUMBER) {
+      printEvalError(nodeLoc(node),
+                     "Error: Invalid type for unary operation\n");
+      exit(EXIT_FAILURE);
+    }
 
-    if (conditionValue) {
-      Result val = EvalAst(node->ifElseBlock.ifBlock, p);
-      if (val.NodeType != NODE_NONE) {
-        return val;
-      }
-    } else if (node->ifElseBlock.elseBlock != NULL) {
-      Result val = EvalAst(node->ifElseBlock.elseBlock, p);
-      if (val.NodeType != NODE_NONE) {
-        return val;
+    double rightVal = *(double *)(right.result);
+    switch (node->unaryOp.op) {
+    case TOKEN_NOT: {
+      finishFrame(s, newResult(gcNumber(!rightVal), NODE_NUMBER));
+      return;
+    }
+    default:
+      printEvalError(nodeLoc(node), "Error: Unknown unary operator\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  case NODE_IDENTIFIER_MUTATION: {
+    if (f->state == 0) {
+      SymbolTableEntry *var =
+          lookupSymbol(p->ctx, node->identifier.name, SYMBOL_KIND_VARIABLES);
+      if (!var) {
+        printEvalError(nodeLoc(node), "%s is not decleared\n",
+                       node->identifier.name);
+        exit(EXIT_FAILURE);
       }
+      f->aux = var;
+      f->state = 1;
+      pushNode(p, node->identifier.value);
+      return;
     }
-    break;
+
+    SymbolTableEntry *var = (SymbolTableEntry *)f->aux;
+    Result res = popValue(s);
+
+    if (var->isArray) {
+      assignArray(node, (Array *)var->value, res);
+      finishFrame(s, newResult(NULL, NODE_NONE));
+      return;
+    }
+
+    if (!node->checked && resultType(res) != var->type) {
+      printEvalError(nodeLoc(node), "cannot assign type of %s to type of %s",
+                     getDataType(res), typeName(var->type));
+      exit(EXIT_FAILURE);
+    }
+
+    var->value = res.result;
+    finishFrame(s, newResult(NULL, NODE_NONE));
+    return;
   }
 
-  case NODE_FUNCTION_READ_IN: {
-    int initialBufferSize = 100;
-    int currentBufferSize = 0;
+  case NODE_IDENTIFIER_ASSIGNMENT: {
+    if (f->state == 0) {
+      SymbolTableEntry *var =
+          lookupSymbol(p->ctx, node->identifier.name, SYMBOL_KIND_VARIABLES);
 
-    char *buffer = (char *)malloc(sizeof(char) * initialBufferSize);
-    if (buffer == NULL) {
-      perror("Failed to allocate memory for buffer");
+      if (var && !var->isParam) {
+        printEvalError(nodeLoc(node), "cannot redeclare %s\n",
+                       node->identifier.name);
+        exit(EXIT_FAILURE);
+      }
+      f->state = 1;
+      pushNode(p, node->identifier.value);
+      return;
+    }
+
+    Result res = popValue(s);
+
+    if (!node->checked && resultType(res) != node->identifier.type) {
+      printEvalError(nodeLoc(node), "cannot assign typeof %s to %s\n",
+                     getDataType(res), typeName(node->identifier.type));
       exit(EXIT_FAILURE);
     }
 
-    while (1) {
-      if (currentBufferSize >= initialBufferSize - 1) {
-        initialBufferSize += 100;
-        char *newBuffer =
-            (char *)realloc(buffer, sizeof(char) * initialBufferSize);
-        if (newBuffer == NULL) {
-          perror("Failed to reallocate memory");
-          free(buffer); // Free original buffer before exiting
-          exit(EXIT_FAILURE);
+    SymbolError err =
+        insertSymbol(p->ctx, node->identifier.type, node->identifier.name, &res,
+                     SYMBOL_KIND_VARIABLES, p->level);
+
+    if (err != SYMBOL_ERROR_NONE) {
+      printSymbolError(err, nodeLoc(node), node->identifier.name,
+                       node->identifier.type);
+    }
+    finishFrame(s, newResult(NULL, NODE_NONE));
+    return;
+  }
+
+  case NODE_BLOCK: {
+    // a block that declares nothing has no scope to enter or leave
+    int scoped = !node->block.bare;
+    if (f->state == 0) {
+      if (scoped) {
+        p->level++;
+        enterScope(p->ctx);
+      }
+      f->state = 1;
+    } else {
+      Result result = popValue(s);
+
+      // return, break and continue unwind the block and travel upwards
+      if (result.NodeType != NODE_NONE && isControlFlow(&result)) {
+        if (scoped) {
+          exitScope(p->ctx);
+          p->level--;
         }
-        buffer = newBuffer;
+        finishFrame(s, result);
+        return;
       }
+    }
 
-      char ch = getchar();
-      if (ch == '\n') {
-        break;
+    while (f->index < node->block.statementCount) {
+      AstNode *ast = node->block.statements[f->index++];
+      if (ast) {
+        pushNode(p, ast);
+        return;
       }
-      buffer[currentBufferSize] = ch;
-      currentBufferSize++;
     }
 
-    buffer[currentBufferSize] = '\0';
+    if (scoped) {
+      exitScope(p->ctx);
+      p->level--;
+    }
+    finishFrame(s, newResult(NULL, NODE_NONE));
+    return;
+  }
 
-    Result res = {0};
+  case NODE_IF_ELSE: {
+    switch (f->state) {
+    case 0:
+      f->state = 1;
+      pushNode(p, node->ifElseBlock.condition);
+      return;
+    case 1: {
+      Result conditionResult = popValue(s);
+      if (conditionResult.NodeType != NODE_NUMBER) {
+        printEvalError(
+            nodeLoc(node),
+            "Error: Condition in if-else must be a number (interpreted as "
+            "boolean)\n");
+        exit(EXIT_FAILURE);
+      }
 
-    if (strcmp(node->read.type, "string") == 0) {
-      res = newResult(buffer, NODE_STRING_LITERAL); // Include null terminator
-    } else if (strcmp(node->read.type, "number") == 0) {
-      double numberValue;
-      sscanf(buffer, "%lf", &numberValue);
+      double conditionValue = *(double *)(conditionResult.result);
 
-      double *ptr = (double *)malloc(sizeof(double));
-      if (ptr == NULL) {
-        perror("Failed to allocate memory for number");
-        free(buffer); // Free buffer before exiting
-        exit(EXIT_FAILURE);
+      AstNode *branch = conditionValue ? node->ifElseBlock.ifBlock
+                                       : node->ifElseBlock.elseBlock;
+      if (!branch) {
+        finishFrame(s, newResult(NULL, NODE_NONE));
+        return;
       }
-      *ptr = numberValue;
-      res = newResult((void *)ptr, NODE_NUMBER);
+      f->state = 2;
+      pushNode(p, branch);
+      return;
+    }
+    default:
+      // the branch result is handed up as is
+      finishFrame(s, popValue(s));
+      return;
     }
-
-    return res;
   }
 
   case NODE_FUNCTION_PRINT: {
-
-    for (int i = 0; i < node->print.statementCount; i++) {
-      AstNode *stmt = node->print.statments[i];
-      switch (stmt->type) {
-      case NODE_IDENTIFIER_VALUE: {
-
-        SymbolTableEntry *entry =
-            lookupSymbol(p->ctx, stmt->identifier.name, SYMBOL_KIND_VARIABLES);
-
-        if (!entry) {
-          printf("null no entry found");
-          break;
-        }
-
-        if (entry->isArray) {
-          freeEntry(entry);
-          printArray(entry, p);
-          break;
-        }
-
-        Result res = EvalAst(stmt, p);
+    if (f->state == 1) {
+      Result res = popValue(s);
+      if (res.NodeType == NODE_NUMBER || res.NodeType == NODE_STRING_LITERAL ||
+          res.NodeType == NODE_ARRAY_VALUE) {
         printResult(&res);
-        freeEntry(entry);
-        break;
       }
+      f->state = 0;
+    }
 
-      case NODE_STRING_LITERAL: {
-        Result res = EvalAst(stmt, p);
-        printResult(&res);
-        freeResult(&res);
-        break;
-      }
+    while (f->index < node->print.statementCount) {
+      AstNode *stmt = node->print.statments[f->index++];
 
-      case NODE_NUMBER: {
-        Result res = EvalAst(stmt, p);
-        printResult(&res);
-        break;
+      if (stmt->type == NODE_IDENTIFIER_VALUE &&
+          !lookupSymbol(p->ctx, stmt->identifier.name,
+                        SYMBOL_KIND_VARIABLES)) {
+        printf("null no entry found");
+        continue;
       }
 
-      case NODE_ARRAY_ELEMENT_ACCESS: {
-        Result res = EvalAst(stmt, p);
-        if (res.NodeType == NODE_STRING_LITERAL) {
-          printf(YELLOW "%s" RESET, trimQuotes((char *)res.result));
-        } else {
-          printf(MAGENTA "%0.lf" RESET, *(double *)res.result);
-        }
-        break;
-      }
-      default:
-        printf("node type is %s\n", nodeTypeNames[stmt->type]);
-      }
+      f->state = 1;
+      pushNode(p, stmt);
+      return;
     }
+
     printf("\n");
-    break;
+    finishFrame(s, newResult(NULL, NODE_NONE));
+    return;
   }
 
   case NODE_ARRAY_ELEMENT_ACCESS: {
-    SymbolTableEntry *var =
-        lookupSymbol(p->ctx, node->arrayElm.name, SYMBOL_KIND_VARIABLES);
-
-    if (!var || !var->isArray) {
-      printEvalError(node->loc, " %s is not decleared\n", node->arrayElm.name);
-      exit(EXIT_FAILURE);
+    if (f->state == 0) {
+      f->state = 1;
+      pushNode(p, node->arrayElm.index);
+      return;
     }
-    Result res = EvalAst(node->arrayElm.index, p);
+
+    Array *arr = resolveArray(node, p);
+    Result res = popValue(s);
     if (res.NodeType == NODE_NONE) {
-      printEvalError(node->loc, "invalid index");
+      printEvalError(nodeLoc(node), "invalid index");
       exit(EXIT_FAILURE);
     }
-    double idx = *(double *)res.result;
-    int index = (int)idx;
-    if (index >= var->arraySize) {
-      printEvalError(node->loc,
-                     "index out of bound. index 0 cannot be accessed", index);
+    int index = (int)*(double *)res.result;
+    if (index < 0 || index >= arr->length) {
+      printEvalError(nodeLoc(node),
+                     "index out of bound. index %d cannot be accessed", index);
       exit(EXIT_FAILURE);
     }
 
-    if (strcmp(var->type, "string") == 0) {
-      char *value = ((char **)var->value)[index];
-      return newResult(value, NODE_STRING_LITERAL);
-    } else {
-      double value = ((double *)var->value)[index];
-      return newResult(&value, NODE_NUMBER);
+    if (arr->kind == ARRAY_STRING) {
+      char *value = arr->strings[index] ? arr->strings[index] : "";
+      finishFrame(s, newResult(gcString(value), NODE_STRING_LITERAL));
+      return;
     }
+
+    finishFrame(s, newResult(gcNumber(arr->numbers[index]), NODE_NUMBER));
+    return;
   }
 
   // needs refactoring
-  case NODE_ARRAY_INIT: {
+  case NODE_ARRAY_INIT:
+  case NODE_ARRAY_DECLARATION: {
     SymbolTableEntry *var =
         lookupSymbol(p->ctx, node->array.name, SYMBOL_KIND_VARIABLES);
 
     if (var) {
-      printEvalError(node->loc, "cannot redeclare %s is already decleared\n",
+      printEvalError(nodeLoc(node),
+                     "cannot redeclare %s is already decleared\n",
                      node->array.name);
       exit(EXIT_FAILURE);
     }
 
-    if (node->array.isFixed) {
+    // array literals are flat, their elements are evaluated by nested runs
+    if (node->type == NODE_ARRAY_DECLARATION) {
+      handleArrayDeclaration(node, p);
+    } else if (node->array.init) {
+      handleArrayExprInsert(node, p);
+    } else if (node->array.isFixed) {
       handleFixedArrayInsert(node, p);
     } else {
       handleDynamicArrayInsert(node, p);
     }
 
-    break;
+    finishFrame(s, newResult(NULL, NODE_NONE));
+    return;
   }
 
-    /*
-  case NODE_ARRAY_DECLARATION: {
-    SymbolTableEntry *var =
-        lookupSymbol(p->table, node->array.name, node->isParam);
-
-    if (var) {
-        printEvalError(node->loc, "cannot redeclare  %s is already
-    decleared\n", node->identifier.name); exit(EXIT_FAILURE);
-    }
-
-    if (node->array.arraySize) {
-      Result *result = EvalAst(node->array.arraySize, p);
-      double size = *(double *)result.result;
-      if (strcmp(node->array.type, "string") == 0) {
-        insertStrArraySymbol(p->table, node->array.name, node->array.type,
-  size, NULL, node->array.isFixed, node->array.actualSize); } else {
-        insertNumArraySymbol(p->table, node->array.name, node->array.type,
-  size, NULL, node->array.isFixed);
-      }
-    } else {
-      if (strcmp(node->array.type, "string") == 0) {
-        insertStrArraySymbol(p->table, node->array.name, node->array.type,
-  0, NULL, node->array.isFixed, node->array.actualSize); } else {
-        insertNumArraySymbol(p->table, node->array.name, node->array.type,
-  0, NULL, node->array.isFixed);
-      }
-    }
-    break;
-  }
-  */
   case NODE_ARRAY_ELEMENT_ASSIGN: {
-
-    SymbolTableEntry *var =
-        lookupSymbol(p->ctx, node->arrayElm.name, SYMBOL_KIND_VARIABLES);
-
-    if (!var) {
-      printEvalError(node->loc, "array %s is not decleared\n",
-                     node->arrayElm.name);
-      exit(EXIT_FAILURE);
-    }
-
-    if (!var->isArray) {
-      printEvalError(node->loc, " %s is not an array \n", node->arrayElm.name);
-      exit(EXIT_FAILURE);
-    }
-
-    Result res = EvalAst(node->arrayElm.index, p);
-    double resIndex = *(double *)res.result;
-    int index = (int)resIndex;
-
-    // checks and handles bound of array if fixed else increases the arr size
-    if (var->isFixed) {
-      handleBound(node, var, index);
-    }
-
-    res = EvalAst(node->arrayElm.value, p);
-    char *type = getDataType(res);
-
-    if (strcmp(type, var->type) != 0) {
-      printEvalError(node->loc, "cannot assign type of %s to %s", type,
-                     var->type);
-      exit(EXIT_FAILURE);
-    }
-
-    if (strcmp(var->type, "string") == 0) {
-      if (!var->value) {
-        var->value = (char **)malloc(sizeof(char *) * var->arraySize);
+    switch (f->state) {
+    case 0:
+      f->state = 1;
+      pushNode(p, node->arrayElm.index);
+      return;
+    case 1: {
+      Result res = popValue(s);
+      f->index = (int)*(double *)res.result;
+      f->state = 2;
+      pushNode(p, node->arrayElm.value);
+      return;
+    }
+    default: {
+      Array *arr = resolveArray(node, p);
+      Result res = popValue(s);
+      int isString = arr->kind == ARRAY_STRING;
+
+      if (!node->checked &&
+          isString != (res.NodeType == NODE_STRING_LITERAL)) {
+        printEvalError(nodeLoc(node), "cannot assign type of %s to %s",
+                       getDataType(res), isString ? "string" : "number");
+        exit(EXIT_FAILURE);
       }
-      ((char **)var->value)[index] = strdup((char *)res.result);
 
-      if (!var->isFixed) {
-        var->arraySize++;
-      }
-      free(res.result);
-      break;
-    }
+      // checks the bound of fixed arrays, dynamic arrays grow on append
+      int index = f->index;
+      handleBound(node, p, arr, index);
 
-    if (!var->value) {
-      var->value = (double *)malloc(sizeof(double) * var->arraySize);
+      if (isString) {
+        arr->strings[index] = (char *)res.result;
+      } else {
+        arr->numbers[index] = *(double *)res.result;
+      }
+      finishFrame(s, newResult(NULL, NODE_NONE));
+      return;
     }
-
-    ((double *)var->value)[index] = *(double *)res.result;
-    if (!var->isFixed) {
-      var->arraySize++;
     }
-
-    break;
-  }
-
-  case NODE_BREAK: {
-    Result res = newResult(NULL, NODE_BREAK);
-    res.isBreak = 1;
-    return res;
-  }
-
-  case NODE_CONTNUE: {
-    Result res = newResult(NULL, NODE_CONTNUE);
-    res.isContinue = 1;
-    return res;
   }
 
   case NODE_WHILE_LOOP: {
-    p->level++;
-    enterScope(p->ctx);
-    Result result = EvalAst(node->whileLoop.condition, p);
-    double condition = 0;
-    if (result.NodeType != NODE_NONE) { // Check if result is non-null
-      if (result.result) {
-        condition = *(double *)result.result;
+    switch (f->state) {
+    case 0:
+      p->level++;
+      enterScope(p->ctx);
+      f->state = 1;
+      pushNode(p, node->whileLoop.condition);
+      return;
+    case 1:
+      if (!takeCondition(s)) {
+        break;
       }
-      free(result.result); // Free the dynamically allocated memory pointed to
-      // by result.result, if applicable
-    };
-
-    while (condition) {
-      Result blockRes = EvalAst(node->whileLoop.body, p);
+      f->state = 2;
+      pushNode(p, node->whileLoop.body);
+      return;
+    default: {
+      Result blockRes = popValue(s);
 
       if (blockRes.NodeType != NODE_NONE && blockRes.isReturn) {
-        return blockRes;
-      }
-
-      if (blockRes.NodeType && blockRes.isContinue) {
-        freeResult(&blockRes);
-        result = EvalAst(node->whileLoop.condition, p);
-        condition = *(double *)result.result;
-        freeResult(&result);
-        continue;
+        exitScope(p->ctx);
+        p->level--;
+        finishFrame(s, blockRes);
+        return;
       }
 
       // Handle break: exit the loop
       if (blockRes.NodeType != NODE_NONE && blockRes.isBreak) {
-        freeResult(&blockRes);
         break;
       }
 
-      freeResult(&blockRes);
-
-      blockRes = EvalAst(node->whileLoop.condition, p);
-      condition = *(double *)blockRes.result;
-      freeResult(&blockRes);
+      spendStep(s, node);
+      f->state = 1;
+      pushNode(p, node->whileLoop.condition);
+      return;
     }
+    }
+
     exitScope(p->ctx);
     p->level--;
-    break;
+    finishFrame(s, newResult(NULL, NODE_NONE));
+    return;
   }
 
   case NODE_FOR_LOOP: {
-    p->level++;
-    enterScope(p->ctx);
-    EvalAst(node->loopFor.initializer, p);
-
-    Result result = EvalAst(node->loopFor.condition, p);
-    double condition = *(double *)result.result;
-
-    free(result.result); // result.result  is a allocted pointer
-
-    while (condition) {
-      // evaluates the body
-      Result blockRes = EvalAst(node->loopFor.loopBody, p);
-
-      if (blockRes.NodeType && blockRes.isReturn) {
-        return blockRes;
+    switch (f->state) {
+    case 0:
+      p->level++;
+      enterScope(p->ctx);
+      f->state = 1;
+      pushNode(p, node->loopFor.initializer);
+      return;
+    case 1:
+      popValue(s);
+      f->state = 2;
+      pushNode(p, node->loopFor.condition);
+      return;
+    case 2:
+      if (!takeCondition(s)) {
+        break;
       }
+      // evaluates the body
+      f->state = 3;
+      pushNode(p, node->loopFor.loopBody);
+      return;
+    default: {
+      Result blockRes = popValue(s);
 
-      // free  the result if result is valid and is not a type of return
-      if (blockRes.NodeType && blockRes.isContinue) {
-        EvalAst(node->loopFor.icrDcr, p);
-
-        Result newResult = EvalAst(node->loopFor.condition, p);
-        condition = *(double *)newResult.result;
-        free(newResult.result);
-        continue; // Skip the rest of the loop body
+      if (blockRes.NodeType != NODE_NONE && blockRes.isReturn) {
+        exitScope(p->ctx);
+        p->level--;
+        finishFrame(s, blockRes);
+        return;
       }
 
       // Handle break: exit the loop
-      if (blockRes.NodeType && blockRes.isBreak) {
-        exitScope(p->ctx);
-        break; // Exit the loop
+      if (blockRes.NodeType != NODE_NONE && blockRes.isBreak) {
+        break;
       }
 
-      // handle the icrDcr statement
-      Result res = EvalAst(node->loopFor.icrDcr, p);
-      Result newResult = EvalAst(node->loopFor.condition, p);
-      condition = *(double *)newResult.result;
-      freeResult(&newResult);
-      freeResult(&res);
+      // continue and a finished body both run the icrDcr statement
+      spendStep(s, node);
+      f->state = 1;
+      pushNode(p, node->loopFor.icrDcr);
+      return;
     }
+    }
+
     exitScope(p->ctx);
     p->level--;
-    break;
-  }
-
-  default:
-    printEvalError(node->loc, "Error: Unexpected node type %s\n",
-                   nodeTypeNames[node->type]);
-    exit(EXIT_FAILURE);
+    finishFrame(s, newResult(NULL, NODE_NONE));
+    return;
   }
 
-  return newResult(NULL, NODE_NONE); // Ensure you return a valid pointer
-}
+  case NODE_PARFOR_LOOP:
+    finishFrame(s, evalParFor(node, p));
+    return;
 
-void freeAst(AstNode *node) {
-  if (node == NULL) {
+  case NODE_HOISTED: {
+    if (f->state == 0) {
+      f->aux =
+          lookupSymbol(p->ctx, node->identifier.name, SYMBOL_KIND_VARIABLES);
+      f->state = 1;
+      pushNode(p, node->identifier.value);
+      return;
+    }
+    SymbolTableEntry *slot = (SymbolTableEntry *)f->aux;
+    slot->value = popValue(s).result;
+    finishFrame(s, hoistedResult(slot));
     return;
   }
 
-  switch (node->type) {
-
-  case NODE_IDENTIFIER_MUTATION:
-  case NODE_IDENTIFIER_ASSIGNMENT:
-  case NODE_IDENTIFIER_VALUE:
-    if (node->identifier.name) {
-      free(node->identifier.name);
-      node->identifier.name = NULL;
-    }
-    if (node->identifier.type) {
-      free(node->identifier.type);
-      node->identifier.type = NULL;
-    }
-    if (node->identifier.value) {
-      freeAst(node->identifier.value);
-      node->identifier.value = NULL;
-    }
-    break;
-  case NODE_IDENTIFIER_DECLERATION:
-    if (node->identifier.type) {
-      free(node->identifier.type);
-      node->identifier.type = NULL;
-    }
-    if (node->identifier.name) {
-      free(node->identifier.name);
-      node->identifier.name = NULL;
-    }
-    break;
-  case NODE_FOR_LOOP: {
-
-    if (node->loopFor.loopBody) {
-      freeAst(node->loopFor.loopBody);
+  case NODE_SPAWN: {
+    AstNode *call = node->expr;
+    if (f->state == 0) {
+      // tasks outlive the scopes around the spawn, only top level functions
+      // can run as one
+      SymbolTableEntry *fn =
+          lookupGlobalScope(p->ctx->globalTable, call->function.call.name,
+                            SYMBOL_KIND_FUNCTION);
+      if (!fn) {
+        printEvalError(nodeLoc(node),
+                       "spawn expects a function declared at the top level "
+                       "but got %s",
+                       call->function.call.name);
+        exit(EXIT_FAILURE);
+      }
+      if (fn->function.parameterCount != call->function.call.argsCount) {
+        printEvalError(nodeLoc(node), "%s expects %d arguments but got %d",
+                       call->function.call.name, fn->function.parameterCount,
+                       call->function.call.argsCount);
+        exit(EXIT_FAILURE);
+      }
+      f->aux = fn;
+      f->state = 1;
     }
 
-    if (node->loopFor.condition) {
-      freeAst(node->loopFor.condition);
-    }
-    if (node->loopFor.icrDcr) {
-      freeAst(node->loopFor.icrDcr);
-    }
-    if (node->loopFor.initializer) {
-      freeAst(node->loopFor.initializer);
-    }
-    break;
-  }
-  case NODE_WHILE_LOOP: {
-    if (node->whileLoop.body) {
-      freeAst(node->whileLoop.body);
-    }
-    if (node->whileLoop.condition) {
-      freeAst(node->whileLoop.condition);
-    }
-    break;
-  }
-  case NODE_FUNCTION:
-    if (node->function.defination.returnType) {
-      free(node->function.defination.returnType);
-      node->function.defination.returnType = NULL;
-    }
-    if (node->function.defination.name) {
-      free(node->function.defination.name);
-      node->function.defination.name = NULL;
+    if (f->index < call->function.call.argsCount) {
+      AstNode *arg = call->function.call.args[f->index++];
+      pushNode(p, arg);
+      return;
     }
-    if (node->function.defination.body) {
-      freeAst(node->function.defination.body);
-      node->function.defination.body = NULL;
-    }
-
-    free(node->function.defination.params);
 
-    break;
-  case NODE_NUMBER:
-  case NODE_CONTNUE:
-  case NODE_BREAK:
-    // No dynamic memory to free here
-    break;
-  case NODE_STRING_LITERAL:
-    if (node->stringLiteral.value) {
-      free(node->stringLiteral.value);
-      node->stringLiteral.value = NULL;
+    SymbolTableEntry *fn = (SymbolTableEntry *)f->aux;
+    int argsCount = call->function.call.argsCount;
+    Result *args = &s->values[s->valueCount - argsCount];
+    if (!call->checked) {
+      checkArgs(call, fn, args);
     }
-    break;
 
-  case NODE_BLOCK: {
-    for (int i = 0; i < node->block.statementCount; i++) {
-      if (node->block.statements[i]) {
-        freeAst(node->block.statements[i]);
-        node->block.statements[i] = NULL;
-      }
-    }
-    free(node->block.statements);
-    break;
+    double *handle = gcNumber(spawnTask(node, fn, args, p));
+    s->valueCount -= argsCount;
+    finishFrame(s, newResult(handle, NODE_NUMBER));
+    return;
   }
-  case NODE_ARRAY_INIT:
-  case NODE_ARRAY_DECLARATION: {
-    if (node->array.name) {
-      free(node->array.name);
-    }
 
-    if (node->array.type) {
-      free(node->array.type);
-    }
-    if (node->array.elements) {
-      int i = 0;
-      while (node->array.elements[i]) {
-        freeAst(node->array.elements[i]);
-        i++;
+  case NODE_AWAIT: {
+    switch (f->state) {
+    case 0:
+      f->state = 1;
+      pushNode(p, node->expr);
+      return;
+    case 1: {
+      Result handle = popValue(s);
+      if (handle.NodeType != NODE_NUMBER) {
+        printEvalError(nodeLoc(node), "await expects a task handle but got %s",
+                       getDataType(handle));
+        exit(EXIT_FAILURE);
+      }
+      f->aux = claimTask(node, *(double *)handle.result);
+      f->state = 2;
+    }
+    // fallthrough
+    default: {
+      Task *task = (Task *)f->aux;
+      if (p->task && p->eval->nested > 0 && !isTaskDone(task)) {
+        printEvalError(nodeLoc(node),
+                       "a task cannot await inside an array initializer");
+        exit(EXIT_FAILURE);
+      }
+      if (p->task) {
+        if (!awaitTask(task, p)) {
+          // this frame runs again once the task is woken
+          return;
+        }
+      } else {
+        waitTask(task);
       }
-      free(node->array.elements);
+      finishFrame(s, takeTaskResult(task));
+      return;
     }
-    if (node->array.arraySize) {
-      free(node->array.arraySize);
     }
+  }
 
-    break;
+  default:
+    printEvalError(nodeLoc(node), "Error: Unexpected node type %s\n",
+                   nodeTypeNames[node->type]);
+    exit(EXIT_FAILURE);
   }
-  case NODE_ARRAY_ELEMENT_ASSIGN: {
-    if (node->arrayElm.name) {
-      free(node->arrayElm.name);
-    }
+}
 
-    if (node->arrayElm.value) {
-      freeAst(node->arrayElm.value);
-    }
-    if (node->arrayElm.index) {
-      freeAst(node->arrayElm.index);
-    }
-    break;
+void markEvalStack(EvalStack *s) {
+  for (int i = 0; i < s->valueCount; i++) {
+    markResult(&s->values[i]);
   }
-  case NODE_ARRAY_ELEMENT_ACCESS: {
-    if (node->arrayElm.index) {
-      freeAst(node->arrayElm.index);
-    }
-    if (node->arrayElm.value) {
-      free(node->arrayElm.value);
-    }
-    if (node->arrayElm.name) {
-      free(node->arrayElm.name);
-    }
-    break;
+}
+
+// collections only run between two steps of the main program, with the
+// tasks stopped between two steps of theirs. no parfor worker is running
+// then: the main thread waits inside the parfor step, workers only leave the
+// debt behind
+static void collectGarbage(Parser *p) {
+  if (p->inParallel || p->task) {
+    return;
+  }
+  if (!stopTasks()) {
+    gcPostpone();
+    return;
   }
 
-  case NODE_RETURN:
-    if (node->expr) {
-      freeAst(node->expr);
-      node->expr = NULL;
-    }
-    break;
-  case NODE_UNARY_OP:
-    if (node->unaryOp.right) {
-      freeAst(node->unaryOp.right);
-      node->unaryOp.right = NULL;
-    }
-    break;
-  case NODE_BINARY_OP:
-    if (node->binaryOp.left) {
-      freeAst(node->binaryOp.left);
-      node->binaryOp.left = NULL;
-    }
-    if (node->binaryOp.right) {
-      freeAst(node->binaryOp.right);
-      node->binaryOp.right = NULL;
-    }
-    break;
-  case NODE_IF_ELSE:
-    if (node->ifElseBlock.ifBlock) {
-      freeAst(node->ifElseBlock.ifBlock);
-      node->ifElseBlock.ifBlock = NULL;
-    }
-    if (node->ifElseBlock.elseBlock) {
-      freeAst(node->ifElseBlock.elseBlock);
-      node->ifElseBlock.elseBlock = NULL;
-    }
-    if (node->ifElseBlock.condition) {
-      freeAst(node->ifElseBlock.condition);
-      node->ifElseBlock.condition = NULL;
-    }
-    break;
-  case NODE_FUNCTION_PARAM:
-    if (node->identifier.name) {
-      free(node->identifier.name);
-      node->identifier.name = NULL;
-    }
-    if (node->identifier.type) {
-      free(node->identifier.type);
-      node->identifier.type = NULL;
-    }
-    break;
+  markSymbolContext(p->ctx);
+  markEvalStack(p->eval);
+  markTasks();
+  markChannels();
+  gcSweep();
+  resumeTasks();
+}
 
-  case NODE_FUNCTION_PRINT: {
-    for (int i = 0; i < node->print.statementCount; i++) {
-      freeAst(node->print.statments[i]);
+// eval ast function
+Result EvalAst(AstNode *node, Parser *p) {
+  EvalStack *s = p->eval;
+  EvalStack *outer = runningEval;
+  int base = s->frameCount;
+  runningEval = s;
+
+  // nested calls (array literals) run on the same heap stack
+  s->nested++;
+  pushNode(p, node);
+  while (s->frameCount > base) {
+    evalStep(p);
+    if (s->nested == 1 && gcWanted()) {
+      collectGarbage(p);
+    }
+  }
+  s->nested--;
+  runningEval = outer;
+  return popValue(s);
+}
+
+void startEval(AstNode *node, Parser *p) { pushNode(p, node); }
+
+int resumeEval(Parser *p, long budget) {
+  EvalStack *s = p->eval;
+  EvalStack *outer = runningEval;
+  runningEval = s;
+  while (s->frameCount > 0) {
+    if (budget-- <= 0 || p->parked) {
+      runningEval = outer;
+      return 0;
     }
-    free(node->print.statments);
-    break;
+    evalStep(p);
   }
+  runningEval = outer;
+  return 1;
+}
 
-  case NODE_FUNCTION_CALL:
-    if (node->function.call.name) {
-      free(node->function.call.name);
-      node->function.call.name = NULL;
-    }
-    for (int i = 0; i < node->function.call.argsCount; i++) {
-      if (node->function.call.args[i]) {
-        freeAst(node->function.call.args[i]);
-        node->function.call.args[i] = NULL;
-      }
-    }
-    if (node->function.call.args) {
-      free(node->function.call.args);
-      node->function.call.args = NULL;
-    }
+Result takeEvalResult(Parser *p) { return popValue(p->eval); }
 
-    break;
+// the tree is taken apart through a list, not recursion, like every other
+// walk. names are interned and stay. freed nodes turn into NODE_NONE so a
+// tree reached twice, like a function body its symbol also holds, is freed
+// once
+void freeAst(AstNode *root) {
+  NodeList work = {0};
+  appendNode(root, &work);
 
-  case NODE_FUNCTION_READ_IN:
-    if (node->read.type) {
-      free(node->read.type);
+  while (work.size > 0) {
+    AstNode *node = work.nodes[--work.size];
+    forEachChild(node, appendNode, &work);
+
+    switch (node->type) {
+    case NODE_COMPILED:
+      memFree(node->compiled.closure);
+      break;
+    case NODE_FUNCTION:
+      for (int i = 0; i < node->function.defination.paramsCount; i++) {
+        memFree(node->function.defination.params[i]);
+      }
+      memFree(node->function.defination.params);
+      break;
+    case NODE_STRING_LITERAL:
+      memFree(node->stringLiteral.value);
+      break;
+    case NODE_BLOCK:
+      memFree(node->block.statements);
+      if (node->block.pending) {
+        for (int i = 0; i < node->block.pendingCount; i++) {
+          freeToken(node->block.pending[i]);
+        }
+        memFree(node->block.pending);
+      }
+      break;
+    case NODE_ARRAY_INIT:
+    case NODE_ARRAY_DECLARATION:
+      memFree(node->array.elements);
+      break;
+    case NODE_FUNCTION_PRINT:
+      memFree(node->print.statments);
+      break;
+    case NODE_FUNCTION_CALL:
+      memFree(node->function.call.args);
+      break;
     }
-    break;
-  }
 
-  // Free the node itself
-  free(node);
-  node = NULL;
+    // the node itself goes with its block in freeNodes
+    node->type = NODE_NONE;
+  }
+  memFree(work.nodes);
 }
 
 AstNode *parseAst(Parser *p) {
@@ -1322,7 +1798,7 @@ AstNode *parseAst(Parser *p) {
   }
 
   case TOKEN_IDEN: {
-    Token *nextToken = p->tokens[p->idx + 1];
+    Token *nextToken = parserPeek(p);
 
     switch (nextToken->type) {
     case TOKEN_LPAREN: {
@@ -1360,10 +1836,18 @@ AstNode *parseAst(Parser *p) {
     return numberNode;
   }
 
-  case TOKEN_FOR: {
+  case TOKEN_FOR:
+  case TOKEN_PARFOR: {
     return parseForLoop(p);
   }
 
+  case TOKEN_SPAWN:
+  case TOKEN_AWAIT: {
+    AstNode *ast = logical(p);
+    consume(TOKEN_SEMI_COLON, p);
+    return ast;
+  }
+
   case TOKEN_CONTINUE: {
     AstNode *node = parseContinueNode(p);
     consume(TOKEN_SEMI_COLON, p);
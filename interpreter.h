@@ -4,10 +4,32 @@
 #include "common.h"
 #include "parser.h"
 #include "symbol.h"
+#define DEFAULT_MAX_DEPTH 1000000
+
 Result EvalAst(AstNode *, Parser *);
+Result newResult(void *data, int nodeType);
+const char *getDataType(Result res);
+void printEvalError(Loc loc, const char *s, ...);
+void printSymbolError(SymbolError err, Loc loc, char *name, ValueType type);
+
+// the MemoryError handler of alloc.h, reports the line the evaluator of the
+// failing thread was running
+void reportMemoryError(const char *message);
+EvalStack *createEvalStack(int maxDepth);
+void freeEvalStack(EvalStack *);
+
+// marks the values waiting on the stack for the frames that use them
+void markEvalStack(EvalStack *s);
+
+// resumable evaluation for tasks: startEval pushes the node, resumeEval runs
+// at most budget steps and returns 1 once the result can be taken
+void startEval(AstNode *node, Parser *p);
+int resumeEval(Parser *p, long budget);
+Result takeEvalResult(Parser *p);
+void checkReturnValue(AstNode *node, SymbolTableEntry *fn, Result value);
 void freeAst(AstNode *);
 AstNode *parseAst(Parser *p);
 void printSymbolTable(SymbolTable *);
 #endif // INTERPRETER_H_
 void freeSymbolTable(SymbolTable *table);
-void freeResult(Result *res);
+void markResult(Result *res);
@@ -1,4 +1,7 @@
 #include "lexer.h"
+#include "alloc.h"
+#include "intern.h"
+#include "scan.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,7 +11,7 @@
 // A constructor for Lexer reutrns Lexer
 
 Lexer *InitLexer(char *source, char *filename) {
-  Lexer *lex = (Lexer *)malloc(sizeof(Lexer));
+  Lexer *lex = (Lexer *)memAlloc(sizeof(Lexer));
   if (lex == NULL) {
     printf("Failed allocating memory for lexer\n");
     exit(EXIT_FAILURE);
@@ -18,46 +21,59 @@ Lexer *InitLexer(char *source, char *filename) {
   lex->line = 1;
 
   // Allocate memory for filename and copy it
-  lex->filename = strdup(filename);
+  lex->filename = memStrdup(filename);
   if (lex->filename == NULL) {
     printf("Failed allocating memory for filename\n");
-    free(lex); // Clean up previously allocated memory
+    memFree(lex); // Clean up previously allocated memory
     exit(EXIT_FAILURE);
   }
 
   // Allocate memory for source and copy it
   size_t source_len = strlen(source);
 
-  lex->source = (char *)malloc(sizeof(char) * (source_len + 1));
-  // Ensure +1 for null terminator
+  // the padding lets the scanners read whole blocks at the end
+  lex->source = (char *)memCalloc(source_len + 1 + SCAN_PADDING, sizeof(char));
   if (lex->source == NULL) {
     printf("Failed allocating memory for source\n");
-    free(filename);
-    free(lex->filename); // Clean up previously allocated memory
-    free(lex);           // Clean up previously allocated memory
+    memFree(filename);
+    memFree(lex->filename); // Clean up previously allocated memory
+    memFree(lex);           // Clean up previously allocated memory
     exit(EXIT_FAILURE);
   }
   strcpy(lex->source, source);
   lex->source[source_len] = '\0';
+  lex->end = (int)source_len;
   return lex;
 }
 // Returns  a new token with the supplied value and type
 Token *NewToken(Lexer *lex, TokenType type, char *value) {
-  Token *tkn = (Token *)malloc(sizeof(Token));
+  Token *tkn = (Token *)memAlloc(sizeof(Token));
   tkn->type = type;
-  tkn->value = strdup(value);
-  tkn->loc = (Loc *)malloc(sizeof(Loc));
+  // identifiers arrive interned and are shared, everything else is copied
+  tkn->value = type == TOKEN_IDEN ? value : memStrdup(value);
+  tkn->loc = (Loc *)memAlloc(sizeof(Loc));
   if (!tkn->loc) {
     printf("cannot allocate mem for loc\n");
     exit(EXIT_FAILURE);
   }
-  tkn->loc->file_name = strdup(lex->filename);
+  tkn->loc->file_name = lex->filename; // lives as long as the lexer
   tkn->loc->row = lex->line;
   tkn->loc->col = lex->curr;
   return tkn;
 }
 
-int isAtEnd(Lexer *l) { return l->source[l->curr] == '\0'; }
+void freeToken(Token *tkn) {
+  if (tkn) {
+    memFree(tkn->loc);
+    // identifier names are interned
+    if (tkn->value && tkn->type != TOKEN_IDEN) {
+      memFree(tkn->value);
+    }
+    memFree(tkn);
+  }
+}
+
+int isAtEnd(Lexer *l) { return l->curr >= l->end; }
 char advance(Lexer *l) {
   if (!isAtEnd(l)) {
     char ch = l->source[l->curr];
@@ -85,62 +101,63 @@ char peek(Lexer *l) {
 }
 
 void skipWhiteSpace(Lexer *l) {
-  while (isspace(peek(l)) && !isAtEnd(l)) {
-    advance(l);
-  }
+  l->curr = scanOps()->skipSpace(l->source, l->curr, &l->line);
 }
 
-TokenType getKeywordTokenType(char *buff) {
-  if (strcmp(buff, "if") == 0) {
-    return TOKEN_IF;
-  }
-  if (strcmp(buff, "else") == 0) {
-    return TOKEN_ELSE;
-  }
-
-  if (strcmp(buff, "for") == 0) {
-    return TOKEN_FOR;
-  }
-
-  if (strcmp(buff, "return") == 0) {
-    return TOKEN_RETURN;
-  }
-
-  if (strcmp(buff, "fn") == 0) {
-    return TOKEN_FN;
-  }
-
-  if (strcmp(buff, "println") == 0) {
-    return TOKEN_PRINT;
-  }
-  if (strcmp(buff, "readIn") == 0) {
-    return TOKEN_READ_IN;
-  }
-  if (strcmp(buff, "break") == 0) {
-    return TOKEN_BREAK;
-  }
-  if (strcmp(buff, "continue") == 0) {
-    return TOKEN_CONTINUE;
-  }
-  if (strcmp(buff, "while") == 0) {
-    return TOKEN_WHILE;
-  }
-
-  return -1;
+// moves to the next c, or to the end of the source when there is none
+static void skipTo(Lexer *l, char c) {
+  l->curr = scanOps()->findByte(l->source, l->curr, c, &l->line);
 }
 
-int isNotTypeKeyword(char *name) {
-  int arraySize = 10;
-  const char *keywords[] = {"if",      "fn",     "else",  "for",      "return",
-                            "println", "readIn", "break", "continue", "while"};
+static int isWord(const char *word, const char *keyword, int length) {
+  return memcmp(word, keyword, length) == 0;
+}
 
-  for (int i = 0; i < arraySize; i++) {
-    if (strcmp(keywords[i], name) == 0) {
-      return 1;
+// the keyword token for the word, TOKEN_IDEN when it is not one. the length
+// and the first letter leave at most one keyword to compare against. number
+// and string stay identifiers, the parser reads them as type names
+static TokenType keywordType(const char *word, int length) {
+  switch (length) {
+  case 2:
+    if (isWord(word, "if", 2)) {
+      return TOKEN_IF;
+    }
+    return isWord(word, "fn", 2) ? TOKEN_FN : TOKEN_IDEN;
+  case 3:
+    return isWord(word, "for", 3) ? TOKEN_FOR : TOKEN_IDEN;
+  case 4:
+    return isWord(word, "else", 4) ? TOKEN_ELSE : TOKEN_IDEN;
+  case 5:
+    switch (word[0]) {
+    case 'b':
+      return isWord(word, "break", 5) ? TOKEN_BREAK : TOKEN_IDEN;
+    case 'w':
+      return isWord(word, "while", 5) ? TOKEN_WHILE : TOKEN_IDEN;
+    case 's':
+      return isWord(word, "spawn", 5) ? TOKEN_SPAWN : TOKEN_IDEN;
+    case 'a':
+      return isWord(word, "await", 5) ? TOKEN_AWAIT : TOKEN_IDEN;
+    }
+    return TOKEN_IDEN;
+  case 6:
+    switch (word[0]) {
+    case 'r':
+      if (isWord(word, "return", 6)) {
+        return TOKEN_RETURN;
+      }
+      return isWord(word, "readIn", 6) ? TOKEN_READ_IN : TOKEN_IDEN;
+    case 'p':
+      return isWord(word, "parfor", 6) ? TOKEN_PARFOR : TOKEN_IDEN;
     }
+    return TOKEN_IDEN;
+  case 7:
+    return isWord(word, "println", 7) ? TOKEN_PRINT : TOKEN_IDEN;
+  case 8:
+    return isWord(word, "continue", 8) ? TOKEN_CONTINUE : TOKEN_IDEN;
   }
-  return 0;
+  return TOKEN_IDEN;
 }
+
 Token *GetNextToken(Lexer *l) {
   skipWhiteSpace(l);
   char c = advance(l);
@@ -153,24 +170,22 @@ Token *GetNextToken(Lexer *l) {
   if (c == '"') {
     int start = l->curr - 1;
     advance(l);
-    while (peek(l) != '"') {
-      if (isAtEnd(l)) {
-        printf("unterminated string\n");
-        exit(EXIT_FAILURE);
-      }
-      advance(l);
+    skipTo(l, '"');
+    if (isAtEnd(l)) {
+      printf("unterminated string\n");
+      exit(EXIT_FAILURE);
     }
 
     advance(l); // eating the "
     int length = l->curr - start;
-    char *buffer = (char *)malloc(length + 1);
+    char *buffer = (char *)memAlloc(length + 1);
     for (int i = 0; i < length; i++) {
       buffer[i] = l->source[start + i];
     }
     buffer[length] = '\0';
 
     Token *tkn = NewToken(l, TOKEN_STRING, buffer);
-    free(buffer);
+    memFree(buffer);
     return tkn;
   }
 
@@ -187,26 +202,12 @@ Token *GetNextToken(Lexer *l) {
     }
 
     int length = l->curr - start;
-    char *buffer = (char *)malloc(length + 1);
-
-    strncpy(buffer, l->source + start, length);
-    buffer[length] = '\0';
-
-    if (isNotTypeKeyword(buffer)) {
-
-      TokenType type = getKeywordTokenType(buffer);
-      if (type == -1) {
-        printf("unkwon type\n");
-        exit(EXIT_FAILURE);
-      }
-      Token *tkn = NewToken(l, type, buffer);
-      free(buffer);
-      return tkn;
+    TokenType type = keywordType(l->source + start, length);
+    if (type != TOKEN_IDEN) {
+      return NewToken(l, type, (char *)tokenNames[type]);
     }
 
-    Token *tkn = NewToken(l, TOKEN_IDEN, buffer);
-    free(buffer);
-    return tkn;
+    return NewToken(l, TOKEN_IDEN, intern(l->source + start, length));
   }
 
   if (isdigit(c)) {
@@ -222,11 +223,11 @@ Token *GetNextToken(Lexer *l) {
     }
 
     int length = l->curr - start;
-    char *buffer = (char *)malloc(length + 1);
+    char *buffer = (char *)memAlloc(length + 1);
     strncpy(buffer, l->source + start, length);
     buffer[length] = '\0';
     Token *tkn = NewToken(l, TOKEN_NUMBER, buffer);
-    free(buffer);
+    memFree(buffer);
     return tkn;
   }
   //
@@ -296,9 +297,7 @@ Token *GetNextToken(Lexer *l) {
 
   if (c == '#') {
     advance(l);
-    while ((peek(l) != '#') && (!isAtEnd(l))) {
-      advance(l);
-    }
+    skipTo(l, '#');
     advance(l);
     return NewToken(l, TOKEN_COMMENT, "");
   }
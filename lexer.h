@@ -54,6 +54,9 @@ enum {
   TOKEN_BREAK,
   TOKEN_CONTINUE,
   TOKEN_WHILE,
+  TOKEN_PARFOR,
+  TOKEN_SPAWN,
+  TOKEN_AWAIT,
 
 };
 
@@ -110,6 +113,9 @@ static const char *tokenNames[] = {
     "break",
     "continue",
     "while",
+    "parfor",
+    "spawn",
+    "await",
 };
 
 typedef int TokenType;
@@ -117,6 +123,7 @@ typedef int TokenType;
 typedef struct {
   char *source;
   int curr;
+  int end; // the lexer stops here, a chunk lexer before the source ends
   int line;
   char *filename;
 } Lexer;
@@ -135,6 +142,7 @@ typedef struct {
 
 Lexer *InitLexer(char *, char *);
 Token *NewToken(Lexer *lex, TokenType type, char *value);
+void freeToken(Token *tkn);
 Token *GetNextToken(Lexer *);
 char peek(Lexer *);
 char peekNext(Lexer *);
@@ -1,9 +1,18 @@
 
+#include "alloc.h"
+#include "budget.h"
+#include "channel.h"
+#include "checker.h"
 #include "common.h"
+#include "compile.h"
+#include "intern.h"
 #include "interpreter.h"
 #include "lexer.h"
+#include "optimize.h"
+#include "parallel.h"
 #include "parser.h"
 #include "symbol.h"
+#include "task.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,20 +24,107 @@ typedef struct Program {
   int capacity;
 } Program;
 
-void shiftArgs(int *argc, char **argv) { (*argc) = (*argc) - 1; }
-
-void freeTokens(Token *tkn) {
-  if (tkn) {
-    if (tkn->loc) {
-      free(tkn->loc->file_name);
-      free(tkn->loc);
-    }
+typedef struct Options {
+  char *fileName;
+  int maxDepth; // evaluator frames allowed before a StackOverflowError
+  int threads;  // parfor workers, 0 picks one per cpu
+  size_t maxHeap;  // bytes the script may hold, 0 for no cap
+  int heapStats;   // print the allocation counters at exit
+  long maxSteps;   // loop iterations and calls allowed, 0 for no limit
+  double timeout;  // seconds the script may run, 0 for no limit
+  int pipeline;    // lex on a thread of its own while parsing
+  int lexThreads;  // threads lexing the file up front
+  int lazy;        // parse function bodies on their first call
+  int noInline;    // keep calls to one line functions as calls
+  int noOptimize;  // leave loop invariant and repeated expressions in place
+  int noCompile;   // evaluate number expressions node by node
+} Options;
+
+void printUsage() {
+  printf("Please enter file name....\n Usage: ./main [options] <filename>\n");
+  printf("  --max-depth <n>   maximum evaluation depth (default %d)\n",
+         DEFAULT_MAX_DEPTH);
+  printf("  --threads <n>     parfor worker threads (default one per cpu)\n");
+  printf("  --max-heap <n>    heap limit in bytes, k m g suffixes allowed\n");
+  printf("  --heap-stats      print allocation counters to stderr at exit\n");
+  printf("  --max-steps <n>   stop after n loop iterations and calls "
+         "(exit %d)\n",
+         EXIT_STEP_LIMIT);
+  printf("  --timeout <s>     stop after s seconds (exit %d)\n", EXIT_TIMEOUT);
+  printf("  --pipeline        lex on a separate thread while parsing\n");
+  printf("  --lex-threads <n> lex large files on n threads (default 1)\n");
+  printf("  --lazy            parse function bodies when first called\n");
+  printf("  --no-inline       do not inline calls to one line functions\n");
+  printf("  --no-optimize     do not hoist loop invariant or repeated "
+         "expressions\n");
+  printf("  --no-compile      do not lower number expressions to closures\n");
+}
 
-    if (tkn->value) {
-      free(tkn->value);
+// reads the cli options, everything that is not an option is the file name
+Options parseOptions(int argc, char **argv) {
+  Options opts = {0};
+  opts.maxDepth = DEFAULT_MAX_DEPTH;
+  opts.threads = DEFAULT_THREADS;
+  opts.lexThreads = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+      opts.maxDepth = atoi(argv[++i]);
+      if (opts.maxDepth <= 0) {
+        printf("--max-depth expects a positive number\n");
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      opts.threads = atoi(argv[++i]);
+      if (opts.threads <= 0) {
+        printf("--threads expects a positive number\n");
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[i], "--lex-threads") == 0 && i + 1 < argc) {
+      opts.lexThreads = atoi(argv[++i]);
+      if (opts.lexThreads <= 0) {
+        printf("--lex-threads expects a positive number\n");
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[i], "--max-heap") == 0 && i + 1 < argc) {
+      opts.maxHeap = parseSize(argv[++i]);
+      if (opts.maxHeap == 0) {
+        printf("--max-heap expects a size like 4096, 512k or 64m\n");
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+      opts.maxSteps = atol(argv[++i]);
+      if (opts.maxSteps <= 0) {
+        printf("--max-steps expects a positive number\n");
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+      opts.timeout = atof(argv[++i]);
+      if (opts.timeout <= 0) {
+        printf("--timeout expects a positive number of seconds\n");
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[i], "--heap-stats") == 0) {
+      opts.heapStats = 1;
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      opts.pipeline = 1;
+    } else if (strcmp(argv[i], "--lazy") == 0) {
+      opts.lazy = 1;
+    } else if (strcmp(argv[i], "--no-inline") == 0) {
+      opts.noInline = 1;
+    } else if (strcmp(argv[i], "--no-optimize") == 0) {
+      opts.noOptimize = 1;
+    } else if (strcmp(argv[i], "--no-compile") == 0) {
+      opts.noCompile = 1;
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      printf("unknown option %s\n", argv[i]);
+      printUsage();
+      exit(EXIT_FAILURE);
+    } else {
+      opts.fileName = argv[i];
     }
-    free(tkn);
   }
+  return opts;
 }
 
 void addToProgram(AstNode *ast, Program *pg) {
@@ -39,7 +135,7 @@ void addToProgram(AstNode *ast, Program *pg) {
   if (pg->size >= pg->capacity) {
     pg->capacity *= 2;
     AstNode **newProgram =
-        (AstNode **)realloc(pg->program, pg->capacity * sizeof(AstNode *));
+        (AstNode **)memRealloc(pg->program, pg->capacity * sizeof(AstNode *));
     if (!newProgram) {
       printf("Memory allocation failed\n");
       exit(EXIT_FAILURE);
@@ -60,43 +156,19 @@ void freeTable(SymbolTable *table) {
     if (!entry) {
       continue;
     }
-    // Free the symbol
-    free(entry->symbol);
-
-    // Free the array (if applicable)
-    if (entry->isArray) {
-      if (strcmp(entry->type, "string") == 0) {
-        for (int j = 0; j < entry->arraySize; j++) {
-          free(((char **)entry->value)[j]);
-        }
-      }
-      free(entry->value);
-    }
+    // names are interned, values belong to the collector
 
-    // Free the value (if it's a string and not an array)
-    if (!entry->isArray && !entry->isFn && strcmp(entry->type, "string") == 0) {
-      free(entry->value);
-    }
-    // Free the type
-    free(entry->type);
-
-    // Free function-related memory
+    // the parameters themselves go with the definition's node in freeAst
     if (entry->isFn && !entry->isParam) {
-      for (int i = 0; i < entry->function.parameterCount; i++) {
-        FuncParams *param = entry->function.params[i];
-        free(param->name);
-        free(param->type);
-        free(param);
-      }
-      free(entry->function.params);
+      memFree(entry->function.params);
     }
     // Now, free the SymbolTableEntry itself
-    free(entry);
+    memFree(entry);
   }
 
   // Free the array of entries
-  free(table->entries);
-  free(table);
+  memFree(table->entries);
+  memFree(table);
 }
 
 void freeSymbolContext(SymbolContext *ctx) {
@@ -105,23 +177,25 @@ void freeSymbolContext(SymbolContext *ctx) {
     freeTable(ctx->stack->frames[i]->localTable);
   }
 
-  free(ctx->stack->frames);
-  free(ctx->stack);
+  releaseFrames(ctx->stack);
+  memFree(ctx->stack->frames);
+  memFree(ctx->stack);
   freeTable(ctx->globalTable);
-  free(ctx);
+  memFree(ctx);
 }
 
 int main(int argc, char **argv) {
   FILE *fp;
 
-  if (argc <= 1) {
-    printf("Please enter file name....\n Usage: ./main <filename>\n");
+  Options opts = parseOptions(argc, argv);
+  if (!opts.fileName) {
+    printUsage();
     exit(EXIT_FAILURE);
   }
-
-  // shifiting the cli arguments
-  shiftArgs(&argc, argv);
-  char *file_name = argc[argv];
+  char *file_name = opts.fileName;
+  setMaxHeap(opts.maxHeap);
+  setMemErrorHandler(reportMemoryError);
+  setStepLimit(opts.maxSteps);
 
   fp = fopen(file_name, "r");
 
@@ -135,7 +209,7 @@ int main(int argc, char **argv) {
   rewind(fp);
 
   // allocating the memory for file
-  char *file_content = (char *)malloc(file_size + 1);
+  char *file_content = (char *)memAlloc(file_size + 1);
   if (!file_content) {
     fclose(fp);
     printf("failed allocating file");
@@ -150,9 +224,13 @@ int main(int argc, char **argv) {
 
   SymbolContext *ctx = createSymbolContext(100);
 
-  Parser *p = InitParser(lex, ctx);
+  Parser *p = InitParser(lex, ctx, opts.pipeline, opts.lexThreads);
+  p->lazyBodies = opts.lazy;
+  p->eval = createEvalStack(opts.maxDepth);
+  setParallelThreads(opts.threads);
+  setTaskThreads(opts.threads);
 
-  Program *prog = (Program *)calloc(1, sizeof(Program));
+  Program *prog = (Program *)memCalloc(1, sizeof(Program));
 
   if (prog == NULL) {
     printf("buy more ram\n");
@@ -161,7 +239,7 @@ int main(int argc, char **argv) {
 
   prog->size = 0;
   prog->capacity = 10000;
-  prog->program = (AstNode **)calloc(prog->capacity, sizeof(AstNode));
+  prog->program = (AstNode **)memCalloc(prog->capacity, sizeof(AstNode *));
 
   while (p->current->type != TOKEN_EOF) {
 
@@ -170,33 +248,65 @@ int main(int argc, char **argv) {
       addToProgram(ast, prog);
       prog->size++;
     }
+    releaseTokens(p);
+  }
+
+  // every type error the checker can prove is reported before anything runs
+  if (checkProgram(prog->program, prog->size) > 0) {
+    exit(EXIT_FAILURE);
+  }
+  if (!opts.noInline) {
+    inlineCalls(prog->program, prog->size);
+  }
+  if (!opts.noOptimize) {
+    optimizeProgram(prog->program, prog->size);
+  }
+  if (!opts.noCompile) {
+    compileProgram(prog->program, prog->size);
   }
 
+  setTimeLimit(opts.timeout);
   for (int i = 0; i < prog->size; i++) {
     if (prog->program[i]) {
-      Result res = EvalAst(prog->program[i], p);
-      freeResult(&res);
+      EvalAst(prog->program[i], p);
     }
   }
 
+  // tasks still running need the ast and the function table
+  shutdownTasks();
+  freeChannels();
+
+  if (opts.heapStats) {
+    MemStats stats = memStats();
+    fprintf(stderr,
+            "heap: %zu bytes live, %zu peak, %ld allocations, %ld frees, "
+            "limit %zu\n",
+            stats.live, stats.peak, stats.allocs, stats.frees, maxHeap());
+  }
+
   for (int i = 0; i < prog->size; i++) {
     freeAst(prog->program[i]);
   }
 
-  free(prog->program);
-  free(prog);
+  memFree(prog->program);
+  memFree(prog);
 
   for (int i = 0; i < p->size; i++) {
-    freeTokens(p->tokens[i]);
+    freeToken(p->tokens[i]);
   }
 
-  free(p->tokens);
-  free(p->lex->source);
-  free(p->lex->filename);
-  free(p->lex);
+  memFree(p->tokens);
+  memFree(p->lex->source);
+  memFree(p->lex->filename);
+  memFree(p->lex);
   freeSymbolContext(p->ctx);
-  free(p);
+  freeNodes();
+  freeInterned();
+  freeEvalStack(p->eval);
+  shutdownParallel();
+  gcShutdown();
+  memFree(p);
   fclose(fp);
-  free(file_content);
+  memFree(file_content);
   return 0;
 }
@@ -0,0 +1,844 @@
+#include "optimize.h"
+#include "alloc.h"
+#include "builtin.h"
+#include "intern.h"
+#include "parser.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// an expression larger than this is not moved or shared as a whole, its
+// parts still can be
+#define OPT_MAX_NODES 32
+// a block computes a smaller expression again, reading a temporary back
+// costs about as much
+#define OPT_MIN_SHARED 5
+// expressions a block keeps looking for again, the oldest is forgotten first
+#define OPT_MAX_AVAILABLE 64
+
+typedef struct KeySet {
+  const void **slots;
+  size_t capacity;
+  size_t count;
+} KeySet;
+
+// what a function can do when it is called. the names are interned, the
+// pointer is the key
+typedef struct FnInfo {
+  const char *name;
+  AstNode *def;
+  int count;    // definitions of the name, and parameters that hold a function
+  int writes;   // may assign a variable it did not declare or change an array
+  int pure;     // the result only depends on the arguments, nothing changes
+  KeySet calls; // names its body calls
+} FnInfo;
+
+// what a stretch of code can change
+typedef struct Effects {
+  KeySet names;   // variables and arrays assigned or declared
+  int arrays;     // an array may change through any name it goes by
+  int everything; // calls a function that may assign any global
+} Effects;
+
+// the occurrences of one expression, they all get the same temporary
+typedef struct Group {
+  AstNode *expr; // the first occurrence
+  uint64_t shape;
+  NodeList uses;
+} Group;
+
+typedef struct Optimizer {
+  FnInfo *fns;
+  size_t fnCapacity;
+  int sharedArrays; // a task may change arrays while the program runs
+  int temps;        // temporaries made so far, they are numbered
+  KeySet reaching;  // functions that can call the one being optimized
+} Optimizer;
+
+// ------------------------------ sets -------------------------------------
+
+static size_t hashKey(const void *key) {
+  uint64_t hash = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ULL;
+  return (size_t)(hash >> 32);
+}
+
+static const void **probeSet(KeySet *set, const void *key) {
+  size_t i = hashKey(key) & (set->capacity - 1);
+  while (set->slots[i] && set->slots[i] != key) {
+    i = (i + 1) & (set->capacity - 1);
+  }
+  return &set->slots[i];
+}
+
+static int inSet(KeySet *set, const void *key) {
+  return set->capacity && *probeSet(set, key);
+}
+
+static void addToSet(KeySet *set, const void *key) {
+  if ((set->count + 1) * 2 > set->capacity) {
+    KeySet grown = {0};
+    grown.capacity = set->capacity ? set->capacity * 2 : 16;
+    grown.slots = (const void **)memCalloc(grown.capacity, sizeof(void *));
+    if (!grown.slots) {
+      printf("failed allocating memory while optimizing\n");
+      exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < set->capacity; i++) {
+      if (set->slots[i]) {
+        *probeSet(&grown, set->slots[i]) = set->slots[i];
+      }
+    }
+    grown.count = set->count;
+    memFree(set->slots);
+    *set = grown;
+  }
+
+  const void **slot = probeSet(set, key);
+  if (!*slot) {
+    *slot = key;
+    set->count++;
+  }
+}
+
+// ------------------------------ functions --------------------------------
+
+static FnInfo *probeFn(Optimizer *o, const char *name) {
+  size_t i = hashKey(name) & (o->fnCapacity - 1);
+  while (o->fns[i].name && o->fns[i].name != name) {
+    i = (i + 1) & (o->fnCapacity - 1);
+  }
+  return &o->fns[i];
+}
+
+static FnInfo *findFn(Optimizer *o, const char *name) {
+  FnInfo *fn = probeFn(o, name);
+  return fn->name ? fn : NULL;
+}
+
+// a name a call can reach something other than its one definition through
+// can do anything
+static void addFn(Optimizer *o, const char *name, AstNode *def) {
+  FnInfo *fn = probeFn(o, name);
+  fn->name = name;
+  fn->def = def;
+  fn->count++;
+  fn->pure = fn->count == 1 && def &&
+             !def->function.defination.body->block.pending;
+  fn->writes = !fn->pure;
+}
+
+// what calling node can do, folded into writes and pure
+static void callEffects(Optimizer *o, AstNode *node, int *writes, int *pure) {
+  FnInfo *fn = findFn(o, node->function.call.name);
+  const Builtin *builtin = lookupBuiltin(node->function.call.name);
+  if (!fn && !builtin) {
+    *writes = 1; // fails when it runs
+    *pure = 0;
+    return;
+  }
+  // the builtin runs wherever the script function is out of scope
+  if (fn) {
+    *writes |= fn->writes;
+    *pure &= fn->pure;
+  }
+  if (builtin) {
+    *pure &= builtin->pure;
+  }
+}
+
+// looks at the body of fn again with what is known about its callees.
+// returns 1 when fn turned out to do more than was assumed
+static int summarize(Optimizer *o, FnInfo *fn) {
+  if (fn->writes) {
+    return 0; // nothing left to lose
+  }
+
+  AstNode *def = fn->def;
+  NodeList nodes = {0};
+  flattenAst(&nodes, def->function.defination.body, 0);
+
+  KeySet declared = {0};
+  for (int i = 0; i < def->function.defination.paramsCount; i++) {
+    addToSet(&declared, def->function.defination.params[i]->name);
+  }
+  for (int i = 0; i < nodes.size; i++) {
+    AstNode *node = nodes.nodes[i];
+    if (node->type == NODE_IDENTIFIER_ASSIGNMENT ||
+        node->type == NODE_IDENTIFIER_DECLERATION) {
+      addToSet(&declared, node->identifier.name);
+    }
+  }
+
+  int writes = 0;
+  int pure = 1;
+  for (int i = 0; i < nodes.size; i++) {
+    AstNode *node = nodes.nodes[i];
+    switch (node->type) {
+    case NODE_IDENTIFIER_MUTATION:
+      writes |= !inSet(&declared, node->identifier.name);
+      break;
+    case NODE_IDENTIFIER_VALUE:
+      pure &= inSet(&declared, node->identifier.name);
+      break;
+    case NODE_ARRAY_INIT:
+    case NODE_ARRAY_DECLARATION:
+    case NODE_ARRAY_ELEMENT_ASSIGN:
+      writes = 1; // arrays are global
+      break;
+    case NODE_ARRAY_ELEMENT_ACCESS:
+    case NODE_FUNCTION_PRINT:
+    case NODE_FUNCTION_READ_IN:
+    case NODE_SPAWN:
+    case NODE_AWAIT:
+    case NODE_FUNCTION:
+      pure = 0;
+      break;
+    case NODE_FUNCTION_CALL:
+      callEffects(o, node, &writes, &pure);
+      break;
+    }
+  }
+  memFree(nodes.nodes);
+  memFree(declared.slots);
+
+  pure &= !writes;
+  int changed = writes > fn->writes || pure < fn->pure;
+  fn->writes |= writes;
+  fn->pure &= pure;
+  return changed;
+}
+
+// every function starts out pure and loses it once a callee does, until
+// nothing changes
+static void summarizeFunctions(Optimizer *o, NodeList *all) {
+  NodeList defs = {0};
+  for (int i = 0; i < all->size; i++) {
+    if (all->nodes[i]->type == NODE_FUNCTION) {
+      appendNode(all->nodes[i], &defs);
+    }
+  }
+
+  o->fnCapacity = 64;
+  while (o->fnCapacity < (size_t)defs.size * 4) {
+    o->fnCapacity *= 2;
+  }
+  o->fns = (FnInfo *)memCalloc(o->fnCapacity, sizeof(FnInfo));
+  if (!o->fns) {
+    printf("failed allocating memory while optimizing\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < defs.size; i++) {
+    AstNode *def = defs.nodes[i];
+    addFn(o, def->function.defination.name, def);
+    for (int j = 0; j < def->function.defination.paramsCount; j++) {
+      FuncParams *param = def->function.defination.params[j];
+      if (param->isFunc) {
+        addFn(o, param->name, NULL);
+      }
+    }
+  }
+
+  for (int i = 0; i < defs.size; i++) {
+    AstNode *def = defs.nodes[i];
+    if (def->function.defination.body->block.pending) {
+      continue;
+    }
+    FnInfo *fn = findFn(o, def->function.defination.name);
+    NodeList nodes = {0};
+    flattenAst(&nodes, def->function.defination.body, 0);
+    for (int j = 0; j < nodes.size; j++) {
+      if (nodes.nodes[j]->type == NODE_FUNCTION_CALL) {
+        addToSet(&fn->calls, nodes.nodes[j]->function.call.name);
+      }
+    }
+    memFree(nodes.nodes);
+  }
+
+  int changed;
+  do {
+    changed = 0;
+    for (size_t i = 0; i < o->fnCapacity; i++) {
+      if (o->fns[i].name) {
+        changed |= summarize(o, &o->fns[i]);
+      }
+    }
+  } while (changed);
+
+  memFree(defs.nodes);
+}
+
+// the functions that can end up calling name, name included
+static void findReaching(Optimizer *o, const char *name, KeySet *out) {
+  addToSet(out, name);
+  int changed;
+  do {
+    changed = 0;
+    for (size_t i = 0; i < o->fnCapacity; i++) {
+      FnInfo *fn = &o->fns[i];
+      if (!fn->name || inSet(out, fn->name)) {
+        continue;
+      }
+      for (size_t j = 0; j < fn->calls.capacity; j++) {
+        if (fn->calls.slots[j] && inSet(out, fn->calls.slots[j])) {
+          addToSet(out, fn->name);
+          changed = 1;
+          break;
+        }
+      }
+    }
+  } while (changed);
+}
+
+// ------------------------------ expressions ------------------------------
+
+static int isScalar(int type) {
+  return type == TYPE_NUMBER || type == TYPE_STRING;
+}
+
+static void addEffects(Optimizer *o, Effects *e, AstNode *root) {
+  NodeList nodes = {0};
+  flattenAst(&nodes, root, 0);
+  for (int i = 0; i < nodes.size; i++) {
+    AstNode *node = nodes.nodes[i];
+    switch (node->type) {
+    case NODE_IDENTIFIER_MUTATION:
+      // an array is copied into the one the name holds
+      e->arrays |= !isScalar(node->identifier.value->valueType);
+      addToSet(&e->names, node->identifier.name);
+      break;
+    case NODE_IDENTIFIER_ASSIGNMENT:
+    case NODE_IDENTIFIER_DECLERATION:
+      addToSet(&e->names, node->identifier.name);
+      break;
+    case NODE_ARRAY_INIT:
+    case NODE_ARRAY_DECLARATION:
+      e->arrays = 1;
+      addToSet(&e->names, node->array.name);
+      break;
+    case NODE_ARRAY_ELEMENT_ASSIGN:
+      e->arrays = 1;
+      addToSet(&e->names, node->arrayElm.name);
+      break;
+    case NODE_FUNCTION_CALL: {
+      int writes = 0;
+      int pure = 1;
+      callEffects(o, node, &writes, &pure);
+      e->everything |= writes;
+      break;
+    }
+    }
+  }
+  memFree(nodes.nodes);
+}
+
+// an expression without side effects that gives the same value every time
+// it runs while only e happens. counts its nodes into size
+static int isStable(Optimizer *o, Effects *e, AstNode *node, int *size) {
+  if (++*size > OPT_MAX_NODES) {
+    return 0;
+  }
+
+  switch (node->type) {
+  case NODE_NUMBER:
+  case NODE_STRING_LITERAL:
+  case NODE_HOISTED:
+    return 1;
+  case NODE_IDENTIFIER_VALUE:
+    if (!isScalar(node->valueType) && (e->arrays || o->sharedArrays)) {
+      return 0;
+    }
+    return !e->everything && !inSet(&e->names, node->identifier.name);
+  case NODE_ARRAY_ELEMENT_ACCESS:
+    return !e->everything && !e->arrays && !o->sharedArrays &&
+           !inSet(&e->names, node->arrayElm.name) &&
+           isStable(o, e, node->arrayElm.index, size);
+  case NODE_UNARY_OP:
+    return isStable(o, e, node->unaryOp.right, size);
+  case NODE_BINARY_OP:
+    return isStable(o, e, node->binaryOp.left, size) &&
+           isStable(o, e, node->binaryOp.right, size);
+  case NODE_FUNCTION_CALL: {
+    // a call that can come back to the function around it stays in place,
+    // a self call under a return has to stay there to reuse the activation
+    if (inSet(&o->reaching, node->function.call.name)) {
+      return 0;
+    }
+    int writes = 0;
+    int pure = 1;
+    callEffects(o, node, &writes, &pure);
+    if (!pure) {
+      return 0;
+    }
+    for (int i = 0; i < node->function.call.argsCount; i++) {
+      if (!isStable(o, e, node->function.call.args[i], size)) {
+        return 0;
+      }
+    }
+    return 1;
+  }
+  default:
+    return 0;
+  }
+}
+
+static uint64_t mix(uint64_t hash, uint64_t value) {
+  return (hash ^ value) * 0x100000001B3ULL;
+}
+
+// equal expressions hash the same, see sameShape
+static uint64_t shapeOf(AstNode *node) {
+  uint64_t hash = mix(0xCBF29CE484222325ULL, node->type);
+  switch (node->type) {
+  case NODE_NUMBER: {
+    uint64_t bits;
+    memcpy(&bits, &node->number.value, sizeof(bits));
+    return mix(hash, bits);
+  }
+  case NODE_STRING_LITERAL:
+    for (const char *c = node->stringLiteral.value; *c; c++) {
+      hash = mix(hash, (unsigned char)*c);
+    }
+    return hash;
+  case NODE_IDENTIFIER_VALUE:
+  case NODE_HOISTED:
+    return mix(hash, (uintptr_t)node->identifier.name);
+  case NODE_ARRAY_ELEMENT_ACCESS:
+    hash = mix(hash, (uintptr_t)node->arrayElm.name);
+    return mix(hash, shapeOf(node->arrayElm.index));
+  case NODE_UNARY_OP:
+    hash = mix(hash, node->unaryOp.op);
+    return mix(hash, shapeOf(node->unaryOp.right));
+  case NODE_BINARY_OP:
+    hash = mix(hash, node->binaryOp.op);
+    hash = mix(hash, shapeOf(node->binaryOp.left));
+    return mix(hash, shapeOf(node->binaryOp.right));
+  case NODE_FUNCTION_CALL:
+    hash = mix(hash, (uintptr_t)node->function.call.name);
+    for (int i = 0; i < node->function.call.argsCount; i++) {
+      hash = mix(hash, shapeOf(node->function.call.args[i]));
+    }
+    return hash;
+  default:
+    return hash;
+  }
+}
+
+// both compute the same thing, only called on stable expressions
+static int sameShape(AstNode *a, AstNode *b) {
+  if (a->type != b->type) {
+    return 0;
+  }
+
+  switch (a->type) {
+  case NODE_NUMBER:
+    return a->number.value == b->number.value;
+  case NODE_STRING_LITERAL:
+    return strcmp(a->stringLiteral.value, b->stringLiteral.value) == 0;
+  case NODE_IDENTIFIER_VALUE:
+  case NODE_HOISTED:
+    return a->identifier.name == b->identifier.name;
+  case NODE_ARRAY_ELEMENT_ACCESS:
+    return a->arrayElm.name == b->arrayElm.name &&
+           sameShape(a->arrayElm.index, b->arrayElm.index);
+  case NODE_UNARY_OP:
+    return a->unaryOp.op == b->unaryOp.op &&
+           sameShape(a->unaryOp.right, b->unaryOp.right);
+  case NODE_BINARY_OP:
+    return a->binaryOp.op == b->binaryOp.op &&
+           sameShape(a->binaryOp.left, b->binaryOp.left) &&
+           sameShape(a->binaryOp.right, b->binaryOp.right);
+  case NODE_FUNCTION_CALL:
+    if (a->function.call.name != b->function.call.name ||
+        a->function.call.argsCount != b->function.call.argsCount) {
+      return 0;
+    }
+    for (int i = 0; i < a->function.call.argsCount; i++) {
+      if (!sameShape(a->function.call.args[i], b->function.call.args[i])) {
+        return 0;
+      }
+    }
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// the expressions under root worth a temporary, outer ones first. the
+// call a spawn runs, the call a return makes, loops on other threads and
+// hoisted expressions stay
+static void candidates(NodeList *out, AstNode *root) {
+  NodeList work = {0};
+  pushChildren(&work, root);
+  while (work.size > 0) {
+    AstNode *node = work.nodes[--work.size];
+    switch (node->type) {
+    case NODE_HOISTED:
+    case NODE_PARFOR_LOOP:
+    case NODE_FUNCTION:
+      continue;
+    case NODE_SPAWN:
+      pushChildren(&work, node->expr);
+      continue;
+    case NODE_RETURN:
+      if (node->expr && node->expr->type == NODE_FUNCTION_CALL) {
+        pushChildren(&work, node->expr);
+        continue;
+      }
+      break;
+    case NODE_UNARY_OP:
+    case NODE_BINARY_OP:
+    case NODE_ARRAY_ELEMENT_ACCESS:
+    case NODE_FUNCTION_CALL:
+      if (isScalar(node->valueType)) {
+        appendNode(node, out);
+      }
+      break;
+    }
+    pushChildren(&work, node);
+  }
+  memFree(work.nodes);
+}
+
+// the group of an expression equal to node, NULL when there is none
+static Group *findGroup(Group *groups, int count, AstNode *node,
+                        uint64_t shape) {
+  for (int i = 0; i < count; i++) {
+    if (groups[i].shape == shape && sameShape(groups[i].expr, node)) {
+      return &groups[i];
+    }
+  }
+  return NULL;
+}
+
+static void consumeTree(KeySet *consumed, AstNode *root) {
+  NodeList nodes = {0};
+  flattenAst(&nodes, root, 0);
+  for (int i = 0; i < nodes.size; i++) {
+    addToSet(consumed, nodes.nodes[i]);
+  }
+  memFree(nodes.nodes);
+}
+
+// ------------------------------ rewriting --------------------------------
+
+// a zeroed node on the line of like
+static AstNode *newNode(AstNode *like, int type) {
+  AstNode *node = copyNode(like);
+  int line = like->line;
+  memset(node, 0, sizeof(AstNode));
+  node->type = type;
+  node->line = line;
+  return node;
+}
+
+// turns every use of the group into a read of a new temporary and returns
+// its declaration
+static AstNode *hoistGroup(Optimizer *o, Group *g) {
+  char name[32];
+  int length = snprintf(name, sizeof(name), "#%d", ++o->temps);
+  char *temp = intern(name, length);
+  ValueType type = (ValueType)g->expr->valueType;
+
+  for (int i = 0; i < g->uses.size; i++) {
+    AstNode *use = g->uses.nodes[i];
+    AstNode *expr = copyNode(use);
+    int line = use->line;
+    memset(use, 0, sizeof(AstNode));
+    use->type = NODE_HOISTED;
+    use->line = line;
+    use->valueType = type;
+    use->checked = 1;
+    use->identifier.name = temp;
+    use->identifier.type = type;
+    use->identifier.value = expr;
+  }
+
+  AstNode *decl = newNode(g->expr, NODE_IDENTIFIER_DECLERATION);
+  decl->identifier.name = temp;
+  decl->identifier.type = type;
+  decl->identifier.isDeceleration = 1;
+  return decl;
+}
+
+// block gets the declarations of the groups used more than min times put in
+// front of its statements
+static void declareGroups(Optimizer *o, AstNode *block, Group *groups,
+                          int count, int min) {
+  int temps = 0;
+  for (int i = 0; i < count; i++) {
+    temps += groups[i].uses.size >= min;
+  }
+  if (temps == 0) {
+    return;
+  }
+
+  int total = block->block.statementCount + temps;
+  AstNode **statements = (AstNode **)memAlloc(sizeof(AstNode *) * total);
+  if (!statements) {
+    printf("failed allocating memory while optimizing\n");
+    exit(EXIT_FAILURE);
+  }
+  int size = 0;
+  for (int i = 0; i < count; i++) {
+    if (groups[i].uses.size >= min) {
+      statements[size++] = hoistGroup(o, &groups[i]);
+    }
+  }
+  memcpy(statements + size, block->block.statements,
+         sizeof(AstNode *) * block->block.statementCount);
+  memFree(block->block.statements);
+  block->block.statements = statements;
+  block->block.statementCount = total;
+  block->block.bare = 0;
+}
+
+static void freeGroups(Group *groups, int count) {
+  for (int i = 0; i < count; i++) {
+    memFree(groups[i].uses.nodes);
+  }
+}
+
+// ------------------------------ loops ------------------------------------
+
+// the expressions that give the same value on every iteration of the for or
+// while loop node are computed the first time they run and read back after
+// that. node becomes a block declaring their temporaries around the loop.
+// returns the loop
+static AstNode *hoistLoop(Optimizer *o, AstNode *node) {
+  Effects e = {0};
+  addEffects(o, &e, node);
+
+  NodeList found = {0};
+  if (node->type == NODE_FOR_LOOP) {
+    candidates(&found, node->loopFor.condition);
+    candidates(&found, node->loopFor.icrDcr);
+    candidates(&found, node->loopFor.loopBody);
+  } else {
+    candidates(&found, node->whileLoop.condition);
+    candidates(&found, node->whileLoop.body);
+  }
+
+  Group groups[OPT_MAX_AVAILABLE];
+  int count = 0;
+  KeySet consumed = {0};
+  for (int i = 0; i < found.size; i++) {
+    AstNode *c = found.nodes[i];
+    int size = 0;
+    if (inSet(&consumed, c) || !isStable(o, &e, c, &size)) {
+      continue;
+    }
+
+    uint64_t shape = shapeOf(c);
+    Group *g = findGroup(groups, count, c, shape);
+    if (!g) {
+      if (count == OPT_MAX_AVAILABLE) {
+        continue;
+      }
+      g = &groups[count++];
+      *g = (Group){c, shape, {0}};
+    }
+    appendNode(c, &g->uses);
+    consumeTree(&consumed, c);
+  }
+  memFree(found.nodes);
+  memFree(consumed.slots);
+  memFree(e.names.slots);
+
+  if (count == 0) {
+    return node;
+  }
+  AstNode *loop = copyNode(node);
+  AstNode **statements = (AstNode **)memAlloc(sizeof(AstNode *));
+  if (!statements) {
+    printf("failed allocating memory while optimizing\n");
+    exit(EXIT_FAILURE);
+  }
+  statements[0] = loop;
+  node->type = NODE_BLOCK;
+  node->block.statements = statements;
+  node->block.statementCount = 1;
+  node->block.pending = NULL;
+  node->block.pendingCount = 0;
+  declareGroups(o, node, groups, count, 1);
+  freeGroups(groups, count);
+  return loop;
+}
+
+// ------------------------------ blocks -----------------------------------
+
+// a statement that runs its expressions once, in order, and changes at most
+// one name after them
+static int isSimple(AstNode *node) {
+  switch (node->type) {
+  case NODE_IDENTIFIER_ASSIGNMENT:
+  case NODE_IDENTIFIER_MUTATION:
+  case NODE_ARRAY_ELEMENT_ASSIGN:
+  case NODE_FUNCTION_PRINT:
+  case NODE_RETURN:
+  case NODE_FUNCTION_CALL:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// an expression the statements of block compute more than once, with nothing
+// changing what it reads in between, is computed once into a temporary. the
+// temporaries live in the block's scope
+static void shareExpressions(Optimizer *o, AstNode *block) {
+  Group groups[OPT_MAX_AVAILABLE];
+  int count = 0;
+  int alive[OPT_MAX_AVAILABLE]; // groups still available, oldest first
+  int aliveCount = 0;
+  KeySet consumed = {0};
+  NodeList found = {0};
+
+  for (int k = 0; k < block->block.statementCount; k++) {
+    AstNode *stmt = block->block.statements[k];
+    if (!stmt) {
+      continue;
+    }
+    Effects e = {0};
+    addEffects(o, &e, stmt);
+
+    found.size = 0;
+    if (isSimple(stmt) && !e.everything) {
+      candidates(&found, stmt);
+    }
+
+    for (int i = 0; i < found.size; i++) {
+      AstNode *c = found.nodes[i];
+      Effects none = {0};
+      int size = 0;
+      if (inSet(&consumed, c) || !isStable(o, &none, c, &size) ||
+          size < OPT_MIN_SHARED) {
+        continue;
+      }
+
+      uint64_t shape = shapeOf(c);
+      Group *g = NULL;
+      for (int j = 0; j < aliveCount && !g; j++) {
+        Group *a = &groups[alive[j]];
+        if (a->shape == shape && sameShape(a->expr, c)) {
+          g = a;
+        }
+      }
+      if (g) {
+        appendNode(c, &g->uses);
+        consumeTree(&consumed, c);
+        continue;
+      }
+      if (count == OPT_MAX_AVAILABLE) {
+        continue;
+      }
+
+      if (aliveCount == OPT_MAX_AVAILABLE) {
+        memmove(alive, alive + 1, sizeof(int) * --aliveCount);
+      }
+      alive[aliveCount++] = count;
+      groups[count] = (Group){c, shape, {0}};
+      appendNode(c, &groups[count++].uses);
+    }
+
+    // what the statement changed is computed anew after it
+    int kept = 0;
+    for (int j = 0; j < aliveCount; j++) {
+      int size = 0;
+      if (isStable(o, &e, groups[alive[j]].expr, &size)) {
+        alive[kept++] = alive[j];
+      }
+    }
+    aliveCount = kept;
+    memFree(e.names.slots);
+  }
+  memFree(found.nodes);
+  memFree(consumed.slots);
+
+  declareGroups(o, block, groups, count, 2);
+  freeGroups(groups, count);
+}
+
+// ------------------------------ program ----------------------------------
+
+static void optimizeFunction(Optimizer *o, AstNode *def);
+
+// loops first, so the blocks see the expressions they left
+static void optimizeStatement(Optimizer *o, AstNode *root) {
+  NodeList work = {0};
+  appendNode(root, &work);
+  while (work.size > 0) {
+    AstNode *node = work.nodes[--work.size];
+    switch (node->type) {
+    case NODE_FOR_LOOP:
+    case NODE_WHILE_LOOP: {
+      AstNode *loop = hoistLoop(o, node);
+      if (loop->type == NODE_FOR_LOOP) {
+        appendNode(loop->loopFor.loopBody, &work);
+      } else {
+        appendNode(loop->whileLoop.body, &work);
+      }
+      break;
+    }
+    case NODE_BLOCK:
+      if (node->block.pending) {
+        break; // parsed on its first call, after this
+      }
+      shareExpressions(o, node);
+      for (int i = node->block.statementCount - 1; i >= 0; i--) {
+        appendNode(node->block.statements[i], &work);
+      }
+      break;
+    case NODE_FUNCTION:
+      optimizeFunction(o, node);
+      break;
+    case NODE_IF_ELSE:
+      appendNode(node->ifElseBlock.elseBlock, &work);
+      appendNode(node->ifElseBlock.ifBlock, &work);
+      break;
+    }
+  }
+  memFree(work.nodes);
+}
+
+// the body of def, with the calls that can come back to def kept in place
+static void optimizeFunction(Optimizer *o, AstNode *def) {
+  KeySet outer = o->reaching;
+  o->reaching = (KeySet){0};
+  findReaching(o, def->function.defination.name, &o->reaching);
+  optimizeStatement(o, def->function.defination.body);
+  memFree(o->reaching.slots);
+  o->reaching = outer;
+}
+
+void optimizeProgram(AstNode **program, int count) {
+  Optimizer o = {0};
+  NodeList all = {0}; // every node, function bodies included
+  for (int i = 0; i < count; i++) {
+    flattenAst(&all, program[i], 1);
+  }
+  summarizeFunctions(&o, &all);
+
+  // a task only sees its parameters and locals, arrays are what it can
+  // change under the program
+  for (int i = 0; i < all.size; i++) {
+    if (all.nodes[i]->type == NODE_SPAWN) {
+      int writes = 0;
+      int pure = 1;
+      callEffects(&o, all.nodes[i]->expr, &writes, &pure);
+      o.sharedArrays |= writes;
+    }
+  }
+  memFree(all.nodes);
+
+  for (int i = 0; i < count; i++) {
+    if (program[i]) {
+      optimizeStatement(&o, program[i]);
+    }
+  }
+  for (size_t i = 0; i < o.fnCapacity; i++) {
+    memFree(o.fns[i].calls.slots);
+  }
+  memFree(o.fns);
+}
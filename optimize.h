@@ -0,0 +1,14 @@
+#ifndef OPTIMIZE_H_
+#define OPTIMIZE_H_
+
+#include "common.h"
+
+// moves the pure expressions a for or while loop computes the same way on
+// every iteration out of it, and lets the repeated pure expressions of a
+// block share one evaluation. either becomes a NODE_HOISTED that computes
+// its expression the first time it runs in the scope of a temporary and
+// reads the temporary after that, so nothing is evaluated earlier or more
+// often than before. runs after checkProgram, it relies on the types it
+// proved
+void optimizeProgram(AstNode **program, int count);
+#endif // OPTIMIZE_H_
@@ -0,0 +1,351 @@
+#include "parallel.h"
+#include "alloc.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "pool.h"
+#include "symbol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// chunks per worker a loop is cut into, more chunks balance uneven bodies
+#define PARFOR_CHUNKS 8
+
+static int parallelThreads = DEFAULT_THREADS;
+static ThreadPool *pool = NULL;
+
+void setParallelThreads(int threads) { parallelThreads = threads; }
+
+static ThreadPool *getPool(void) {
+  if (!pool) {
+    int threads = parallelThreads;
+    if (threads <= 0) {
+      threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    pool = createThreadPool(threads);
+  }
+  return pool;
+}
+
+void shutdownParallel(void) {
+  freeThreadPool(pool);
+  pool = NULL;
+}
+
+// ------------------------------ body check ------------------------------
+//
+// iterations run at the same time, so before the loop starts its body and
+// every function it can call are checked for writes that could race
+
+typedef struct ParCheck {
+  Parser *p;
+  char *loopVar;
+  NodeList checked; // function bodies already checked
+
+  // spawned functions may only use their own parameters and locals, the
+  // global functions they reach are collected for the task
+  int isolated;
+  SymbolTable *functions;
+} ParCheck;
+
+static int declares(NodeList *nodes, FuncParams **params, int paramsCount,
+                    char *name) {
+  for (int i = 0; i < paramsCount; i++) {
+    if (params[i]->name == name) {
+      return 1;
+    }
+  }
+  for (int i = 0; i < nodes->size; i++) {
+    AstNode *node = nodes->nodes[i];
+    if ((node->type == NODE_IDENTIFIER_ASSIGNMENT ||
+         node->type == NODE_IDENTIFIER_DECLERATION) &&
+        node->identifier.name == name) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// array nodes cache their array on the first run, resolving them here keeps
+// the workers from all writing that cache at once
+static void resolveArrayNode(AstNode *node, Parser *p) {
+  if (node->arrayElm.array) {
+    return;
+  }
+  SymbolTableEntry *var =
+      lookupSymbol(p->ctx, node->arrayElm.name, SYMBOL_KIND_VARIABLES);
+  if (var && var->isArray) {
+    node->arrayElm.array = (Array *)var->value;
+  }
+}
+
+static void checkScope(ParCheck *check, AstNode *root, const char *fnName,
+                       FuncParams **params, int paramsCount);
+
+static void checkFunction(ParCheck *check, SymbolTableEntry *fn) {
+  for (int i = 0; i < check->checked.size; i++) {
+    if (check->checked.nodes[i] == fn->function.body) {
+      return;
+    }
+  }
+  appendNode(fn->function.body, &check->checked);
+  parseLazyBody(fn->function.body);
+
+  if (check->functions) {
+    SymbolTable *table = check->functions;
+    if (table->size >= table->capacity) {
+      table->capacity = table->capacity ? table->capacity * 2 : 4;
+      table->entries = (SymbolTableEntry **)memRealloc(
+          table->entries, sizeof(SymbolTableEntry *) * table->capacity);
+      if (!table->entries) {
+        printf("failed allocating memory while checking spawn\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    table->entries[table->size++] = fn;
+  }
+  checkScope(check, fn->function.body, fn->symbol, fn->function.params,
+             fn->function.parameterCount);
+}
+
+// checks the loop body when fnName is NULL, otherwise a function it calls
+static void checkScope(ParCheck *check, AstNode *root, const char *fnName,
+                       FuncParams **params, int paramsCount) {
+  NodeList nodes = {0};
+  flattenAst(&nodes, root, 0);
+
+  for (int i = 0; i < nodes.size; i++) {
+    AstNode *node = nodes.nodes[i];
+
+    switch (node->type) {
+    case NODE_IDENTIFIER_MUTATION:
+      if (!declares(&nodes, params, paramsCount, node->identifier.name)) {
+        if (fnName) {
+          printEvalError(nodeLoc(node),
+                         "%s cannot assign %s while it runs in parallel",
+                         fnName, node->identifier.name);
+        } else {
+          printEvalError(nodeLoc(node),
+                         "parfor iterations cannot assign %s, it is declared "
+                         "outside the loop body",
+                         node->identifier.name);
+        }
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case NODE_IDENTIFIER_VALUE:
+      if (check->isolated &&
+          !declares(&nodes, params, paramsCount, node->identifier.name)) {
+        printEvalError(nodeLoc(node),
+                       "%s cannot read %s, spawned functions only see their "
+                       "parameters and locals",
+                       fnName, node->identifier.name);
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case NODE_ARRAY_ELEMENT_ASSIGN: {
+      AstNode *index = node->arrayElm.index;
+      if (fnName) {
+        printEvalError(nodeLoc(node),
+                       "%s cannot write to array %s while it runs in "
+                       "parallel",
+                       fnName, node->arrayElm.name);
+        exit(EXIT_FAILURE);
+      }
+      if (index->type != NODE_IDENTIFIER_VALUE ||
+          index->identifier.name != check->loopVar) {
+        printEvalError(nodeLoc(node),
+                       "parfor iterations may only write %s[%s], the index "
+                       "must be the loop variable",
+                       node->arrayElm.name, check->loopVar);
+        exit(EXIT_FAILURE);
+      }
+      resolveArrayNode(node, check->p);
+      break;
+    }
+
+    case NODE_ARRAY_ELEMENT_ACCESS:
+      if (check->isolated) {
+        printEvalError(nodeLoc(node),
+                       "%s cannot read array %s from a spawned task",
+                       fnName, node->arrayElm.name);
+        exit(EXIT_FAILURE);
+      }
+      resolveArrayNode(node, check->p);
+      break;
+
+    case NODE_ARRAY_INIT:
+    case NODE_ARRAY_DECLARATION:
+      if (check->isolated) {
+        printEvalError(nodeLoc(node),
+                       "%s cannot declare array %s, arrays are global and "
+                       "spawned tasks cannot touch them",
+                       fnName, node->array.name);
+      } else {
+        printEvalError(nodeLoc(node),
+                       "array %s cannot be declared inside a parfor",
+                       node->array.name);
+      }
+      exit(EXIT_FAILURE);
+
+    case NODE_FUNCTION:
+      parseLazyBody(node->function.defination.body);
+      checkScope(check, node->function.defination.body,
+                 node->function.defination.name,
+                 node->function.defination.params,
+                 node->function.defination.paramsCount);
+      break;
+
+    case NODE_FUNCTION_CALL: {
+      // tasks only get the global functions
+      char *name = node->function.call.name;
+      SymbolTableEntry *fn =
+          check->isolated
+              ? lookupGlobalScope(check->p->ctx->globalTable, name,
+                                  SYMBOL_KIND_FUNCTION)
+              : lookupSymbol(check->p->ctx, name, SYMBOL_KIND_FUNCTION);
+      if (!fn) {
+        break; // a builtin or a function defined inside the body
+      }
+      checkFunction(check, fn);
+      break;
+    }
+    }
+  }
+  memFree(nodes.nodes);
+}
+
+SymbolTable *checkSpawnedFunction(SymbolTableEntry *fn, Parser *p) {
+  ParCheck check = {0};
+  check.p = p;
+  check.isolated = 1;
+  check.functions = (SymbolTable *)memCalloc(1, sizeof(SymbolTable));
+  if (!check.functions) {
+    printf("failed allocating memory while checking spawn\n");
+    exit(EXIT_FAILURE);
+  }
+  checkFunction(&check, fn);
+  memFree(check.checked.nodes);
+  return check.functions;
+}
+
+// ------------------------------- workers --------------------------------
+
+// the evaluator of one pool worker, with the loop variable in its own scope
+typedef struct ParWorker {
+  Parser parser;
+  SymbolTableEntry *index;
+} ParWorker;
+
+typedef struct ParFor {
+  AstNode *node;
+  double start;
+  double step;
+  ParWorker *workers;
+} ParFor;
+
+static void startWorker(ParWorker *w, Parser *p, AstNode *node) {
+  w->parser = *p;
+  w->parser.ctx = forkSymbolContext(p->ctx->globalTable, p->ctx->stack);
+  w->parser.eval = createEvalStack(p->eval->maxDepth);
+  w->parser.inParallel = 1;
+  w->parser.level++;
+  enterScope(w->parser.ctx);
+
+  // numbers are never written in place, every iteration gets its own
+  AstNode *init = node->loopFor.initializer;
+  Result index = newResult(gcNumber(0), NODE_NUMBER);
+  SymbolError err =
+      insertSymbol(w->parser.ctx, TYPE_NUMBER, init->identifier.name, &index,
+                   SYMBOL_KIND_VARIABLES, w->parser.level);
+  if (err != SYMBOL_ERROR_NONE) {
+    printSymbolError(err, nodeLoc(init), init->identifier.name, TYPE_NUMBER);
+  }
+  w->index = lookupSymbol(w->parser.ctx, init->identifier.name,
+                          SYMBOL_KIND_VARIABLES);
+}
+
+static void stopWorker(ParWorker *w) {
+  exitScope(w->parser.ctx);
+  freeForkedSymbolContext(w->parser.ctx);
+  freeEvalStack(w->parser.eval);
+}
+
+static void runIterations(void *arg, int worker, long from, long to) {
+  ParFor *job = (ParFor *)arg;
+  ParWorker *w = &job->workers[worker];
+  AstNode *body = job->node->loopFor.loopBody;
+
+  for (long i = from; i < to; i++) {
+    w->index->value = gcNumber(job->start + (double)i * job->step);
+    Result res = EvalAst(body, &w->parser);
+    if (res.isBreak || res.isReturn) {
+      printEvalError(nodeLoc(job->node), "%s cannot leave a parfor",
+                     res.isBreak ? "break" : "return");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static double evalNumber(AstNode *expr, Parser *p, AstNode *node) {
+  Result res = EvalAst(expr, p);
+  if (res.NodeType != NODE_NUMBER) {
+    printEvalError(nodeLoc(node), "parfor bounds must be numbers");
+    exit(EXIT_FAILURE);
+  }
+  return *(double *)res.result;
+}
+
+Result evalParFor(AstNode *node, Parser *p) {
+  AstNode *condition = node->loopFor.condition;
+  ParFor job = {0};
+  job.node = node;
+  job.start = evalNumber(node->loopFor.initializer->identifier.value, p, node);
+  job.step =
+      node->loopFor.icrDcr->identifier.value->binaryOp.right->number.value;
+  double bound = evalNumber(condition->binaryOp.right, p, node);
+
+  // the header was checked by the parser: i < bound or i <= bound, step > 0
+  double span = (bound - job.start) / job.step;
+  long whole = (long)span;
+  long count = 0;
+  if (condition->binaryOp.op == TOKEN_LESSER) {
+    count = span > 0 ? whole + (whole < span) : 0;
+  } else {
+    count = span >= 0 ? whole + 1 : 0;
+  }
+
+  ParCheck check = {0};
+  check.p = p;
+  check.loopVar = node->loopFor.initializer->identifier.name;
+  checkScope(&check, node->loopFor.loopBody, NULL, NULL, 0);
+  memFree(check.checked.nodes);
+
+  // a parfor inside a parfor runs on the worker that reached it
+  int workers = p->inParallel || count < 2 ? 1 : poolWorkers(getPool());
+  job.workers = (ParWorker *)memCalloc(workers, sizeof(ParWorker));
+  if (!job.workers) {
+    printf("failed allocating parfor workers\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < workers; i++) {
+    startWorker(&job.workers[i], p, node);
+  }
+
+  if (workers == 1) {
+    runIterations(&job, 0, 0, count);
+  } else {
+    long grain = count / ((long)workers * PARFOR_CHUNKS);
+    poolRun(getPool(), count, grain, runIterations, &job);
+  }
+
+  for (int i = 0; i < workers; i++) {
+    stopWorker(&job.workers[i]);
+  }
+  memFree(job.workers);
+  return newResult(NULL, NODE_NONE);
+}
@@ -0,0 +1,22 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include "common.h"
+
+#define DEFAULT_THREADS 0 // one worker per online cpu
+
+// sets the size of the pool, must be called before the first parfor runs
+void setParallelThreads(int threads);
+
+// runs the iterations of a parfor on the thread pool. iterations see the
+// enclosing variables read only; the only writes allowed outside the body's
+// own locals are to array elements indexed by the loop variable
+Result evalParFor(AstNode *node, Parser *p);
+
+// checks that a function can run as a task next to the rest of the program:
+// it and every function it calls read and write nothing but their own
+// parameters and locals. returns the global functions it can reach
+SymbolTable *checkSpawnedFunction(SymbolTableEntry *fn, Parser *p);
+
+void shutdownParallel(void);
+#endif // PARALLEL_H_
@@ -1,78 +1,258 @@
 
 #include "parser.h"
+#include "alloc.h"
+#include "chunk.h"
 #include "common.h"
+#include "feed.h"
 #include "interpreter.h"
 #include "lexer.h"
+#include "types.h"
 
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-char *getNodeType(int nodeType) {
+// the type of a literal node, array literals hold nothing else
+static ValueType literalType(int nodeType) {
   switch (nodeType) {
-  case NODE_STRING_LITERAL: {
-    return "string";
+  case NODE_STRING_LITERAL:
+    return TYPE_STRING;
+  case NODE_NUMBER:
+    return TYPE_NUMBER;
+  default:
+    return TYPE_UNKNOWN;
   }
-  case NODE_NUMBER: {
-    return "number";
+}
+
+// nodes are carved from blocks in the order they are parsed, so a tree and
+// the trees around it sit next to each other in memory
+#define NODES_PER_BLOCK 1024
+
+typedef struct NodeBlock {
+  struct NodeBlock *next;
+  int used;
+  AstNode nodes[NODES_PER_BLOCK];
+} NodeBlock;
+
+static NodeBlock *nodeBlocks;
+static char *sourceName; // the file every node comes from
+
+// a zeroed node, NULL when memory ran out
+static AstNode *allocNode(void) {
+  if (!nodeBlocks || nodeBlocks->used == NODES_PER_BLOCK) {
+    NodeBlock *block = (NodeBlock *)memCalloc(1, sizeof(NodeBlock));
+    if (!block) {
+      return NULL;
+    }
+    block->next = nodeBlocks;
+    nodeBlocks = block;
   }
-  default: {
-    return "nan";
+  return &nodeBlocks->nodes[nodeBlocks->used++];
+}
+
+void freeNodes(void) {
+  while (nodeBlocks) {
+    NodeBlock *next = nodeBlocks->next;
+    memFree(nodeBlocks);
+    nodeBlocks = next;
   }
+}
+
+// a new node with the fields of node. the text of a string literal is copied,
+// children are shared with node
+AstNode *copyNode(AstNode *node) {
+  AstNode *copy = allocNode();
+  if (!copy) {
+    printf("unable to allocate new ast node\n");
+    exit(EXIT_FAILURE);
   }
+  *copy = *node;
+  if (node->type == NODE_STRING_LITERAL) {
+    copy->stringLiteral.value = memStrdup(node->stringLiteral.value);
+    if (!copy->stringLiteral.value) {
+      printf("Memory allocation failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return copy;
 }
 
-void populateTokens(Parser *p, Lexer *lex, int initialCapacity, int *size) {
-  // Allocate initial memory for tokens
-  //
-  p->tokens = (Token **)malloc(sizeof(Token *) * initialCapacity);
+Loc nodeLoc(AstNode *node) {
+  Loc loc = {sourceName, node->line, 0};
+  return loc;
+}
 
-  if (p->tokens == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(EXIT_FAILURE);
+// ------------------------------ walking ----------------------------------
+
+static void visitChild(AstNode *child, ChildFn fn, void *ctx) {
+  if (child) {
+    fn(child, ctx);
   }
+}
 
-  *size = 0; // Initialize sizepa
-  Token *tkn = GetNextToken(lex);
+void forEachChild(AstNode *node, ChildFn fn, void *ctx) {
+  switch (node->type) {
+  case NODE_BINARY_OP:
+    visitChild(node->binaryOp.left, fn, ctx);
+    visitChild(node->binaryOp.right, fn, ctx);
+    break;
+  case NODE_UNARY_OP:
+    visitChild(node->unaryOp.right, fn, ctx);
+    break;
+  case NODE_IDENTIFIER_VALUE:
+  case NODE_IDENTIFIER_DECLERATION:
+  case NODE_IDENTIFIER_ASSIGNMENT:
+  case NODE_IDENTIFIER_MUTATION:
+  case NODE_HOISTED:
+    visitChild(node->identifier.value, fn, ctx);
+    break;
+  case NODE_COMPILED:
+    visitChild(node->compiled.source, fn, ctx);
+    break;
+  case NODE_BLOCK:
+    for (int i = 0; i < node->block.statementCount; i++) {
+      visitChild(node->block.statements[i], fn, ctx);
+    }
+    break;
+  case NODE_FUNCTION:
+    visitChild(node->function.defination.body, fn, ctx);
+    break;
+  case NODE_FUNCTION_CALL:
+    for (int i = 0; i < node->function.call.argsCount; i++) {
+      visitChild(node->function.call.args[i], fn, ctx);
+    }
+    break;
+  case NODE_IF_ELSE:
+    visitChild(node->ifElseBlock.condition, fn, ctx);
+    visitChild(node->ifElseBlock.ifBlock, fn, ctx);
+    visitChild(node->ifElseBlock.elseBlock, fn, ctx);
+    break;
+  case NODE_RETURN:
+  case NODE_SPAWN:
+  case NODE_AWAIT:
+    visitChild(node->expr, fn, ctx);
+    break;
+  case NODE_FUNCTION_PRINT:
+    for (int i = 0; i < node->print.statementCount; i++) {
+      visitChild(node->print.statments[i], fn, ctx);
+    }
+    break;
+  case NODE_FOR_LOOP:
+  case NODE_PARFOR_LOOP:
+    visitChild(node->loopFor.initializer, fn, ctx);
+    visitChild(node->loopFor.condition, fn, ctx);
+    visitChild(node->loopFor.icrDcr, fn, ctx);
+    visitChild(node->loopFor.loopBody, fn, ctx);
+    break;
+  case NODE_WHILE_LOOP:
+    visitChild(node->whileLoop.condition, fn, ctx);
+    visitChild(node->whileLoop.body, fn, ctx);
+    break;
+  case NODE_ARRAY_INIT:
+  case NODE_ARRAY_DECLARATION:
+    visitChild(node->array.arraySize, fn, ctx);
+    for (int i = 0; i < node->array.actualSize; i++) {
+      visitChild(node->array.elements[i], fn, ctx);
+    }
+    visitChild(node->array.init, fn, ctx);
+    break;
+  case NODE_ARRAY_ELEMENT_ASSIGN:
+    visitChild(node->arrayElm.index, fn, ctx);
+    visitChild(node->arrayElm.value, fn, ctx);
+    break;
+  case NODE_ARRAY_ELEMENT_ACCESS:
+    visitChild(node->arrayElm.index, fn, ctx);
+    break;
+  }
+}
 
-  while (tkn->type != TOKEN_EOF) {
-    // Check if more space is needed
-    if (*size >= initialCapacity) {
-      initialCapacity += 100;
-      Token **newTokens =
-          (Token **)realloc(p->tokens, sizeof(Token *) * initialCapacity);
-      if (newTokens == NULL) {
-        fprintf(stderr, "Memory reallocation failed\n");
-        exit(EXIT_FAILURE);
-      }
-      p->tokens = newTokens;
+void appendNode(AstNode *node, void *list) {
+  NodeList *nodes = (NodeList *)list;
+  if (!node) {
+    return;
+  }
+  if (nodes->size >= nodes->capacity) {
+    nodes->capacity = nodes->capacity ? nodes->capacity * 2 : 64;
+    nodes->nodes = (AstNode **)memRealloc(nodes->nodes,
+                                          sizeof(AstNode *) * nodes->capacity);
+    if (!nodes->nodes) {
+      printf("failed allocating memory while walking the ast\n");
+      exit(EXIT_FAILURE);
     }
-    // Assign token and increment size
-    p->tokens[*size] = tkn;
-    (*size)++;
-    // Get the next token
-    tkn = GetNextToken(lex);
   }
+  nodes->nodes[nodes->size++] = node;
+}
+
+void pushChildren(NodeList *work, AstNode *node) {
+  int from = work->size;
+  forEachChild(node, appendNode, work);
+  for (int i = from, j = work->size - 1; i < j; i++, j--) {
+    AstNode *swap = work->nodes[i];
+    work->nodes[i] = work->nodes[j];
+    work->nodes[j] = swap;
+  }
+}
+
+// generated code can nest deeper than the C stack, so the walk keeps its own
+void flattenAst(NodeList *all, AstNode *root, int enterFunctions) {
+  NodeList work = {0};
+  appendNode(root, &work);
+  while (work.size > 0) {
+    AstNode *node = work.nodes[--work.size];
+    appendNode(node, all);
+    if (node->type != NODE_FUNCTION || enterFunctions) {
+      pushChildren(&work, node);
+    }
+  }
+  memFree(work.nodes);
+}
 
-  // Add the EOF token
-  if (*size >= initialCapacity) {
-    initialCapacity += 100;
+// appends a token to the parser's list
+static void pushToken(Parser *p, Token *tkn) {
+  if (p->size >= p->capacity) {
+    p->capacity *= 2;
     Token **newTokens =
-        (Token **)realloc(p->tokens, sizeof(Token *) * initialCapacity);
+        (Token **)memRealloc(p->tokens, sizeof(Token *) * p->capacity);
     if (newTokens == NULL) {
       fprintf(stderr, "Memory reallocation failed\n");
       exit(EXIT_FAILURE);
     }
     p->tokens = newTokens;
   }
+  p->tokens[p->size++] = tkn;
+}
 
-  p->tokens[*size] = tkn;
-  (*size)++;
+// lexes the whole source, the EOF token is the last one
+void populateTokens(Parser *p, Lexer *lex) {
+  Token *tkn;
+  do {
+    tkn = GetNextToken(lex);
+    pushToken(p, tkn);
+  } while (tkn->type != TOKEN_EOF);
 }
-// initializing the parser
-Parser *InitParser(Lexer *lex, SymbolContext *ctx) {
-  Parser *p = (Parser *)malloc(sizeof(Parser));
+
+// the token at index i. a pipelined parser takes tokens from the lexer
+// thread only as far as it looks ahead, past the end every index is EOF
+static Token *tokenAt(Parser *p, int i) {
+  while (i >= p->size && p->feed) {
+    Token *tkn = nextFedToken(p->feed);
+    pushToken(p, tkn);
+    if (tkn->type == TOKEN_EOF) {
+      stopFeed(p->feed);
+      p->feed = NULL;
+    }
+  }
+  return i < p->size ? p->tokens[i] : p->tokens[p->size - 1];
+}
+
+// initializing the parser. a pipelined parser lexes on its own thread
+// while it parses, otherwise the whole file is lexed up front, split over
+// lexThreads threads when there is more than one
+Parser *InitParser(Lexer *lex, SymbolContext *ctx, int pipelined,
+                   int lexThreads) {
+  Parser *p = (Parser *)memAlloc(sizeof(Parser));
   if (p == NULL) {
     printf("unable to allocate parser");
     exit(EXIT_FAILURE);
@@ -80,18 +260,46 @@ Parser *InitParser(Lexer *lex, SymbolContext *ctx) {
 
   memset(p, 0, sizeof(Parser));
   p->lex = lex;
-  int size = 0;
+  sourceName = lex->filename;
   p->level = 0;
   p->idx = 0;
-  int initialCapacity = 100;
-  populateTokens(p, lex, initialCapacity, &size);
+  p->pipelined = pipelined;
+  if (!pipelined && lexThreads > 1) {
+    p->tokens = lexChunks(lex, lexThreads, &p->size);
+    p->capacity = p->size;
+  } else {
+    p->capacity = pipelined ? 64 : 1024;
+    p->tokens = (Token **)memAlloc(sizeof(Token *) * p->capacity);
+    if (p->tokens == NULL) {
+      fprintf(stderr, "Memory allocation failed\n");
+      exit(EXIT_FAILURE);
+    }
+    if (pipelined) {
+      p->feed = startFeed(lex);
+    } else {
+      populateTokens(p, lex);
+    }
+  }
   p->ctx = ctx;
-  p->current = p->tokens[0];
-  p->size = size;
+  p->current = tokenAt(p, 0);
   return p;
 }
 
-int parserIsAtEnd(Parser *p) { return p->idx >= p->size; }
+// frees the tokens the parser has moved past. called between top level
+// statements, where the parser holds on to nothing but the current token
+void releaseTokens(Parser *p) {
+  if (!p->pipelined || p->idx == 0) {
+    return;
+  }
+  for (int i = 0; i < p->idx; i++) {
+    freeToken(p->tokens[i]);
+  }
+  p->size -= p->idx;
+  memmove(p->tokens, p->tokens + p->idx, sizeof(Token *) * p->size);
+  p->idx = 0;
+}
+
+int parserIsAtEnd(Parser *p) { return p->current->type == TOKEN_EOF; }
 
 Token *advanceParser(Parser *p) {
   do {
@@ -99,27 +307,17 @@ Token *advanceParser(Parser *p) {
       return p->current;
     }
     p->idx++;
-    p->current = p->tokens[p->idx];
+    p->current = tokenAt(p, p->idx);
   } while (p->current->type == TOKEN_COMMENT);
 
   return p->current;
 }
 
 // to look ate the next occuring token
-Token *parserPeek(Parser *p) {
-  if (!parserIsAtEnd(p)) {
-    return p->tokens[p->idx + 1];
-  }
-  return NULL;
-}
+Token *parserPeek(Parser *p) { return tokenAt(p, p->idx + 1); }
 
 // to look at the the 2nd positon from the current parser positon
-Token *parserPeekNext(Parser *p) {
-  if (!parserIsAtEnd(p)) {
-    return p->tokens[p->idx + 2];
-  }
-  return NULL;
-}
+Token *parserPeekNext(Parser *p) { return tokenAt(p, p->idx + 2); }
 
 // checks the type and advances the parser
 void consume(TokenType type, Parser *p) {
@@ -144,17 +342,9 @@ static char *getType(Parser *p) {
   }
 }
 
-int isKeyword(char *name) {
-  int arraySize = 6;
-  const char *keywords[] = {"number", "string", "if",      "fn",
-                            "else",   "for",    "println", "readIn"};
-  for (int i = 0; i < arraySize; i++) {
-    if (strcmp(keywords[i], name) == 0) {
-      return 1;
-    }
-  }
-  return 0;
-}
+// the lexer turns the other keywords into their own tokens, only the type
+// names reach the parser as identifiers
+int isKeyword(char *name) { return typeFromName(name) != TYPE_UNKNOWN; }
 
 void printError(Token *tkn, const char *s, ...) {
 
@@ -190,32 +380,24 @@ static double convertStrToDouble(char *s) {
 }
 
 int checkValidType(Token *typeToken) {
-  int arraySize = 2;
-  const char *types[] = {"number", "string"};
-
-  for (int i = 0; i < arraySize; i++) {
-    if (strcmp(types[i], typeToken->value) == 0) {
-      return 1;
-    }
-  }
-  return 0;
+  return typeFromName(typeToken->value) != TYPE_UNKNOWN;
 }
 
 // -------------------------for parsing ast -----------------------
 
-AstNode *newArrayNode(char *name, char *type, int isFixed, int actualSize,
+AstNode *newArrayNode(char *name, ValueType type, int isFixed, int actualSize,
                       AstNode *size, AstNode **elements, Loc loc) {
-  AstNode *node = (AstNode *)calloc(1, sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
 
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_ARRAY_INIT;
   node->array.isFixed = isFixed;
-  node->array.name = strdup(name);
-  node->array.type = strdup(type);
+  node->array.name = name;
+  node->array.type = type;
   node->array.actualSize = actualSize;
   node->array.arraySize = size;
   node->array.elements = elements;
@@ -223,59 +405,64 @@ AstNode *newArrayNode(char *name, char *type, int isFixed, int actualSize,
 }
 
 AstNode *newArrayElmAccessNode(AstNode *index, char *name, Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_ARRAY_ELEMENT_ACCESS;
-  node->arrayElm.name = strdup(name);
+  node->arrayElm.name = name;
   node->arrayElm.index = index;
+  node->arrayElm.value = NULL;
+  node->arrayElm.array = NULL;
   return node;
 };
 
 AstNode *newArrayElmAssignNode(char *name, AstNode *index, AstNode *value,
                                Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_ARRAY_ELEMENT_ASSIGN;
   node->arrayElm.value = value;
   node->arrayElm.index = index;
-  node->arrayElm.name = strdup(name);
+  node->arrayElm.name = name;
+  node->arrayElm.array = NULL;
   return node;
 }
 
-AstNode *newArrayDeclNode(char *name, char *type, int isFixed, AstNode *size,
-                          Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+AstNode *newArrayDeclNode(char *name, ValueType type, int isFixed,
+                          AstNode *size, Loc loc) {
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
 
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_ARRAY_DECLARATION;
   node->array.isDeclaration = 1;
   node->array.isFixed = isFixed;
-  node->array.name = strdup(name);
-  node->array.type = strdup(type);
+  node->array.name = name;
+  node->array.type = type;
   node->array.arraySize = size;
   node->array.elements = NULL;
+  node->array.actualSize = 0;
+  node->array.init = NULL;
   return node;
 }
 
 AstNode *newWhileNode(AstNode *condition, AstNode *body, Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_WHILE_LOOP;
   node->whileLoop.body = body;
   node->whileLoop.condition = condition;
@@ -283,34 +470,34 @@ AstNode *newWhileNode(AstNode *condition, AstNode *body, Loc loc) {
 }
 
 AstNode *newBreakNode(Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_BREAK;
   return node;
 }
 
 AstNode *newContinueNode(Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_CONTNUE;
   return node;
 }
 
 AstNode *newPrintNode(AstNode **stmts, int currentSize, Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_FUNCTION_PRINT;
   node->print.statments = stmts;
   node->print.statementCount = currentSize;
@@ -319,12 +506,12 @@ AstNode *newPrintNode(AstNode **stmts, int currentSize, Loc loc) {
 
 AstNode *newForLoopNode(AstNode *initalizer, AstNode *conditon, AstNode *icrDcr,
                         AstNode *loopBody, Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_FOR_LOOP;
   node->loopFor.icrDcr = icrDcr;
   node->loopFor.condition = conditon;
@@ -334,12 +521,13 @@ AstNode *newForLoopNode(AstNode *initalizer, AstNode *conditon, AstNode *icrDcr,
 }
 
 AstNode *newIfElseNode(AstNode *condition, AstNode *ifBlock,
-                       AstNode *elseBlock) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+                       AstNode *elseBlock, Loc loc) {
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
+  node->line = loc.row;
   node->type = NODE_IF_ELSE;
   node->ifElseBlock.condition = condition;
   node->ifElseBlock.ifBlock = ifBlock;
@@ -349,58 +537,47 @@ AstNode *newIfElseNode(AstNode *condition, AstNode *ifBlock,
 
 // creates and returns new ast for block stmt;
 
-AstNode *newReturnNode(AstNode *expression, int nodeType) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+AstNode *newReturnNode(AstNode *expression, int nodeType, Loc loc) {
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
+  node->line = loc.row;
   node->type = nodeType;
   node->expr = expression;
   return node;
 }
 
-AstNode *newReadInNode(int nodeType, char *type) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+AstNode *newReadInNode(int nodeType, ValueType type) {
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
   node->type = nodeType;
-  node->read.type = strdup(type);
-  free(type);
+  node->read.type = type;
   return node;
 }
 
 // returns the identifier ast from the provided argumentes
 
-AstNode *newIdentifierNode(char *type, char *name, AstNode *value, Parser *p,
-                           int nodeType, int isParam, Loc locNo) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+AstNode *newIdentifierNode(ValueType type, char *name, AstNode *value,
+                           Parser *p, int nodeType, int isParam, Loc locNo) {
+  AstNode *node = allocNode();
   if (!node) {
     printf("Unable to allocate new AST node\n");
     exit(EXIT_FAILURE);
   }
 
   int isDeceleration = (nodeType == NODE_IDENTIFIER_DECLERATION) ? 1 : 0;
-  node->loc = *p->current->loc;
+  node->line = p->current->loc->row;
   node->type = nodeType;
 
   node->identifier.value = value;
 
-  node->identifier.type = type ? strdup(type) : NULL;
-  if (type && !node->identifier.type) {
-    printf("Memory allocation failed\n");
-    free(node);
-    exit(EXIT_FAILURE);
-  }
-  node->identifier.name = strdup(name);
-  if (!node->identifier.name) {
-    printf("Memory allocation failed\n");
-    free(node->identifier.type);
-    free(node);
-    exit(EXIT_FAILURE);
-  }
+  node->identifier.type = type;
+  node->identifier.name = name;
 
   node->isParam = isParam;
   node->identifier.isDeceleration = isDeceleration;
@@ -411,13 +588,13 @@ AstNode *newIdentifierNode(char *type, char *name, AstNode *value, Parser *p,
 // returns the binary ast from the provided argumentes
 AstNode *newBinaryNode(TokenType op, AstNode *left, AstNode *right, Loc loc) {
 
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
   node->type = NODE_BINARY_OP;
-  node->loc = loc;
+  node->line = loc.row;
   node->binaryOp.op = op;
   node->binaryOp.left = left;
   node->binaryOp.right = right;
@@ -425,26 +602,27 @@ AstNode *newBinaryNode(TokenType op, AstNode *left, AstNode *right, Loc loc) {
 }
 // returns the number ast from the provided argumentes
 AstNode *newNumberNode(double value, Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
   node->type = NODE_NUMBER;
-  node->loc = loc;
-  node->number = value;
+  node->line = loc.row;
+  node->number.header.kind = GC_STATIC;
+  node->number.value = value;
   return node;
 }
 // returns the unary ast from the provided argumentes
 
 AstNode *newUnaryNode(TokenType type, AstNode *right, Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("unable to allocate new ast node\n");
     exit(EXIT_FAILURE);
   }
   node->type = NODE_UNARY_OP;
-
+  node->line = loc.row;
   node->unaryOp.op = type;
   node->unaryOp.right = right;
   return node;
@@ -453,17 +631,16 @@ AstNode *newUnaryNode(TokenType type, AstNode *right, Loc loc) {
 // returns the string ast from the provided argumentes
 
 AstNode *newStringNode(char *value, Loc loc) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *node = allocNode();
   if (!node) {
     printf("Unable to allocate new AST node\n");
     exit(EXIT_FAILURE);
   }
-  node->loc = loc;
+  node->line = loc.row;
   node->type = NODE_STRING_LITERAL;
-  node->stringLiteral.value = strdup(value); // Duplicate the string value
+  node->stringLiteral.value = memStrdup(value); // Duplicate the string value
   if (!node->stringLiteral.value) {
     printf("Memory allocation failed\n");
-    free(node);
     exit(EXIT_FAILURE);
   }
 
@@ -560,7 +737,7 @@ AstNode *factor(Parser *p) {
     }
 
     // to parse the variable that was assigned as a value
-    AstNode *node = newIdentifierNode("", tkn->value, NULL, p,
+    AstNode *node = newIdentifierNode(TYPE_UNKNOWN, tkn->value, NULL, p,
                                       NODE_IDENTIFIER_VALUE, 0, *tkn->loc);
     consume(TOKEN_IDEN, p);
     return node;
@@ -577,9 +754,16 @@ AstNode *factor(Parser *p) {
     return node;
   }
 
-  case TOKEN_FOR: {
+  case TOKEN_FOR:
+  case TOKEN_PARFOR: {
     return parseForLoop(p);
   }
+
+  case TOKEN_SPAWN:
+    return parseSpawn(p);
+
+  case TOKEN_AWAIT:
+    return parseAwait(p);
   default:
     printError(p->current,
                "Unexpected token %s with value '%s'. Expected number, "
@@ -634,11 +818,11 @@ AstNode *handleNumberIdentifiers(Parser *p, Token *typeToken, char *varName,
                                  int nodeType) {
   AstNode *valueNode = logical(p);
   if (nodeType == NODE_IDENTIFIER_MUTATION) {
-    return newIdentifierNode("number", varName, valueNode, p, nodeType, 0,
+    return newIdentifierNode(TYPE_NUMBER, varName, valueNode, p, nodeType, 0,
                              *typeToken->loc);
   }
-  return newIdentifierNode(typeToken->value, varName, valueNode, p, nodeType, 0,
-                           *typeToken->loc);
+  return newIdentifierNode(typeFromName(typeToken->value), varName, valueNode,
+                           p, nodeType, 0, *typeToken->loc);
 }
 
 AstNode *handleStringIdentifiers(Parser *p, Token *typeToken, char *varName,
@@ -646,47 +830,42 @@ AstNode *handleStringIdentifiers(Parser *p, Token *typeToken, char *varName,
   AstNode *valueNode = logical(p);
 
   if (nodeType == NODE_IDENTIFIER_MUTATION) {
-    return newIdentifierNode("string", varName, valueNode, p, nodeType, 0,
+    return newIdentifierNode(TYPE_STRING, varName, valueNode, p, nodeType, 0,
                              *typeToken->loc);
   }
-  return newIdentifierNode(typeToken->value, varName, valueNode, p, nodeType, 0,
-                           *typeToken->loc);
+  return newIdentifierNode(typeFromName(typeToken->value), varName, valueNode,
+                           p, nodeType, 0, *typeToken->loc);
 }
 
 AstNode *handleIdenIdentifiers(Parser *p, Token *typeToken, char *varName,
                                int nodeType) {
   AstNode *valueNode = logical(p);
-  return newIdentifierNode(typeToken->value, varName, valueNode, p, nodeType, 0,
-                           *typeToken->loc);
+  return newIdentifierNode(typeFromName(typeToken->value), varName, valueNode,
+                           p, nodeType, 0, *typeToken->loc);
 }
 
 AstNode *handleIdenReadIn(Parser *p, Token *typeToken, char *varName,
                           int nodeType) {
   AstNode *valueNode = logical(p);
-  return newIdentifierNode(typeToken->value, varName, valueNode, p, nodeType, 0,
-                           *typeToken->loc);
+  return newIdentifierNode(typeFromName(typeToken->value), varName, valueNode,
+                           p, nodeType, 0, *typeToken->loc);
 }
 AstNode *handleReadInIdentiers(Parser *p, Token *typeToken, char *varname,
                                int nodeType) {
   AstNode *valueNode = logical(p);
-  return newIdentifierNode(typeToken->value, varname, valueNode, p, nodeType, 0,
-                           *typeToken->loc);
+  return newIdentifierNode(typeFromName(typeToken->value), varname, valueNode,
+                           p, nodeType, 0, *typeToken->loc);
 }
 // handles  variables
 
 AstNode *varDecleration(Parser *p) {
   Token *tkn = p->current;
 
-  char *varName = strdup(tkn->value);
-  if (!varName) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(EXIT_FAILURE);
-  }
+  char *varName = tkn->value;
 
   if (isKeyword(varName)) {
     printError(p->current,
                "cannot use keyword as variable \"%s\" is a keyword\n", varName);
-    free(varName);
     exit(EXIT_FAILURE);
   }
 
@@ -695,11 +874,10 @@ AstNode *varDecleration(Parser *p) {
   if (p->current->type == TOKEN_ASSIGN) {
     consume(TOKEN_ASSIGN, p);
     Token newToken;
-    newToken.value = strdup(p->current->value);
+    newToken.value = memStrdup(p->current->value);
 
     if (!newToken.value) {
       fprintf(stderr, "Memory allocation failed\n");
-      free(varName);
       exit(EXIT_FAILURE);
     }
 
@@ -729,12 +907,10 @@ AstNode *varDecleration(Parser *p) {
     default:
       printError(p->current, "unknown token \"%s\" \n",
                  tokenNames[p->current->type]);
-      free(newToken.value);
-      free(varName);
+      memFree(newToken.value);
       exit(EXIT_FAILURE);
     }
-    free(varName);
-    free(newToken.value);
+    memFree(newToken.value);
     return node;
   }
 
@@ -742,19 +918,17 @@ AstNode *varDecleration(Parser *p) {
   Token *typeToken = p->current;
   consume(TOKEN_IDEN, p);
 
-  if (p->current->type == TOKEN_SEMI_COLON) {
-    AstNode *node =
-        newIdentifierNode(typeToken->value, varName, NULL, p,
-                          NODE_IDENTIFIER_DECLERATION, 0, *typeToken->loc);
-    free(varName);
-    return node;
-  }
-
   if (!checkValidType(typeToken)) {
     printError(p->current, "\"%s\" is not a valid type\n", typeToken->value);
-    free(varName);
     exit(EXIT_FAILURE);
   }
+
+  if (p->current->type == TOKEN_SEMI_COLON) {
+    AstNode *node = newIdentifierNode(typeFromName(typeToken->value), varName,
+                                      NULL, p, NODE_IDENTIFIER_DECLERATION, 0,
+                                      *typeToken->loc);
+    return node;
+  }
   consume(TOKEN_ASSIGN, p);
 
   AstNode *node;
@@ -779,10 +953,8 @@ AstNode *varDecleration(Parser *p) {
   default:
     printError(p->current, "unexpected token %s\n",
                tokenNames[p->current->type]);
-    free(varName);
     exit(EXIT_FAILURE);
   }
-  free(varName);
   return node;
 }
 void addStatementToBlock(AstNode *blockNode, AstNode *statement) {
@@ -793,8 +965,8 @@ void addStatementToBlock(AstNode *blockNode, AstNode *statement) {
 
   // Allocate or reallocate memory for the new statement
   blockNode->block.statements =
-      realloc(blockNode->block.statements,
-              (blockNode->block.statementCount + 1) * sizeof(AstNode *));
+      memRealloc(blockNode->block.statements,
+                 (blockNode->block.statementCount + 1) * sizeof(AstNode *));
 
   // Add the statement to the block
   blockNode->block.statements[blockNode->block.statementCount++] = statement;
@@ -810,7 +982,7 @@ AstNode *parseBlockStmt(Parser *p) {
 
   consume(TOKEN_LCURLY, p);
 
-  AstNode *blockNode = (AstNode *)malloc(sizeof(AstNode));
+  AstNode *blockNode = allocNode();
 
   if (!blockNode) {
     printf("unable to allocate memory for ast node\n");
@@ -818,19 +990,106 @@ AstNode *parseBlockStmt(Parser *p) {
   }
 
   blockNode->type = NODE_BLOCK;
+  blockNode->line = p->current->loc->row;
   blockNode->block.statements = NULL;
   blockNode->block.statementCount = 0;
+  blockNode->block.bare = 1;
   while (p->current->type != TOKEN_RCURLY && !parserIsAtEnd(p)) {
     AstNode *stmt = parseAst(p);
     addStatementToBlock(blockNode, stmt);
+    if (stmt && (stmt->type == NODE_IDENTIFIER_ASSIGNMENT ||
+                 stmt->type == NODE_IDENTIFIER_DECLERATION ||
+                 stmt->type == NODE_FUNCTION)) {
+      blockNode->block.bare = 0;
+    }
   }
   consume(TOKEN_RCURLY, p);
 
   return blockNode;
 }
 
+// an empty block holding the tokens of a function body up to the matching
+// }. the parser takes the tokens out of its list, parseLazyBody parses them
+// the first time the body is needed
+static AstNode *skipBlockStmt(Parser *p) {
+  if (p->current->type != TOKEN_LCURLY) {
+    printError(p->current, "expected ->{<-but got %s\n",
+               tokenNames[p->current->type]);
+    exit(EXIT_FAILURE);
+  }
+
+  int start = p->idx;
+  int depth = 0;
+  for (;;) {
+    if (p->current->type == TOKEN_LCURLY) {
+      depth++;
+    } else if (p->current->type == TOKEN_RCURLY && --depth == 0) {
+      break;
+    } else if (p->current->type == TOKEN_EOF) {
+      printError(p->current, "expected } but the file ended\n");
+      exit(EXIT_FAILURE);
+    }
+    advanceParser(p);
+  }
+
+  AstNode *blockNode = allocNode();
+  if (!blockNode) {
+    printf("unable to allocate memory for ast node\n");
+    exit(EXIT_FAILURE);
+  }
+  int count = p->idx - start + 1;
+  blockNode->type = NODE_BLOCK;
+  blockNode->line = p->tokens[start + 1]->loc->row;
+  blockNode->block.pendingCount = count;
+  blockNode->block.pending = (Token **)memAlloc(sizeof(Token *) * count);
+  if (!blockNode->block.pending) {
+    printf("unable to allocate memory for a function body\n");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(blockNode->block.pending, p->tokens + start, sizeof(Token *) * count);
+
+  consume(TOKEN_RCURLY, p);
+  for (int i = start; i < start + count; i++) {
+    p->tokens[i] = NULL;
+  }
+  return blockNode;
+}
+
+// bodies are parsed by whichever thread calls first, one at a time
+static pthread_mutex_t lazyLock = PTHREAD_MUTEX_INITIALIZER;
+
+void parseLazyBody(AstNode *block) {
+  if (!__atomic_load_n(&block->block.pending, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+
+  pthread_mutex_lock(&lazyLock);
+  Token **tokens = block->block.pending;
+  if (tokens) {
+    Parser sub;
+    memset(&sub, 0, sizeof(Parser));
+    sub.tokens = tokens;
+    sub.size = block->block.pendingCount;
+    sub.capacity = sub.size;
+    sub.lazyBodies = 1;
+    sub.current = tokens[0];
+
+    AstNode *parsed = parseBlockStmt(&sub);
+    block->block.statements = parsed->block.statements;
+    block->block.statementCount = parsed->block.statementCount;
+    block->block.bare = parsed->block.bare;
+    for (int i = 0; i < sub.size; i++) {
+      freeToken(tokens[i]);
+    }
+    memFree(tokens);
+    __atomic_store_n(&block->block.pending, NULL, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&lazyLock);
+}
+
 AstNode *ifElseParser(Parser *p) {
 
+  Loc loc = *p->current->loc;
   if (p->current->type != TOKEN_IF) {
     printError(p->current, "expected \"if\" but got %s\n", p->current->value);
     exit(EXIT_FAILURE);
@@ -860,24 +1119,24 @@ AstNode *ifElseParser(Parser *p) {
 
     elseBlock = parseBlockStmt(p);
   }
-  return newIfElseNode(ast, ifBlock, elseBlock);
+  return newIfElseNode(ast, ifBlock, elseBlock, loc);
 }
 
 // ------------------------parsing functions-------------------------------
 
-AstNode *newFnParams(Parser *p, char *fnName, char *returnType, int paramsCount,
-                     FuncParams **params, AstNode *fnBody) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+AstNode *newFnParams(Parser *p, char *fnName, ValueType returnType,
+                     int paramsCount, FuncParams **params, AstNode *fnBody) {
+  AstNode *node = allocNode();
   if (!node) {
     printf("failed allocating memory for the ast\n");
     exit(EXIT_FAILURE);
   }
   node->type = NODE_FUNCTION;
-  node->loc = *p->current->loc;
+  node->line = p->current->loc->row;
   node->isParam = 1;
   node->function.defination.params = params;
-  node->function.defination.returnType = strdup(returnType);
-  node->function.defination.name = strdup(fnName);
+  node->function.defination.returnType = returnType;
+  node->function.defination.name = fnName;
   node->function.defination.paramsCount = paramsCount;
   node->function.defination.body = fnBody;
   return node;
@@ -913,9 +1172,9 @@ FuncParams *parseFnParams(Parser *p) {
     consume(TOKEN_COMMA, p);
   }
 
-  FuncParams *param = calloc(1, sizeof(FuncParams));
-  param->name = strdup(paramName->value);
-  param->type = strdup(paramType->value);
+  FuncParams *param = memCalloc(1, sizeof(FuncParams));
+  param->name = paramName->value;
+  param->type = typeFromName(paramType->value);
   return param;
 }
 
@@ -932,12 +1191,13 @@ AstNode *parseFunction(Parser *p) {
   consume(TOKEN_LPAREN, p);
 
   int paramsSize = 2;
-  FuncParams **params = (FuncParams **)malloc(sizeof(FuncParams *) * 2);
+  FuncParams **params = (FuncParams **)memAlloc(sizeof(FuncParams *) * 2);
   int paramsCount = 0;
 
   while (p->current->type != TOKEN_RPAREN) {
     if (paramsCount >= paramsSize) {
-      params = (FuncParams **)realloc(params, paramsSize *= 2);
+      params = (FuncParams **)memRealloc(
+          params, sizeof(FuncParams *) * (paramsSize *= 2));
     }
     FuncParams *param = parseFnParams(p);
     params[paramsCount++] = param;
@@ -945,40 +1205,23 @@ AstNode *parseFunction(Parser *p) {
   consume(TOKEN_RPAREN, p);
 
   consume(TOKEN_ARROW, p);
-  char *returnType = p->current->value;
+  if (!checkValidType(p->current)) {
+    printError(p->current, "unknown return type %s", p->current->value);
+    exit(EXIT_FAILURE);
+  }
+  ValueType returnType = typeFromName(p->current->value);
 
   consume(TOKEN_IDEN, p);
-  AstNode *fnBody = parseBlockStmt(p);
+  AstNode *fnBody = p->lazyBodies ? skipBlockStmt(p) : parseBlockStmt(p);
   return newFnParams(p, fnName, returnType, paramsCount, params, fnBody);
 }
 
-AstNode *parseFnArguments(Parser *p) {
-  Loc loc = *p->current->loc;
-  switch (p->current->type) {
-  case TOKEN_STRING: {
-    AstNode *ast = newStringNode(p->current->value, loc);
-    consume(TOKEN_STRING, p);
-    return ast;
-  }
-  case TOKEN_NUMBER: {
-    AstNode *ast = newNumberNode(convertStrToDouble(p->current->value), loc);
-    consume(TOKEN_NUMBER, p);
-    return ast;
-  }
+// arguments are full expressions so calls like f(n - 1) can recurse
+AstNode *parseFnArguments(Parser *p) { return logical(p); }
 
-  case TOKEN_IDEN: {
-    AstNode *ast = newIdentifierNode(NULL, p->current->value, NULL, p,
-                                     NODE_IDENTIFIER_VALUE, 0, loc);
-    consume(TOKEN_IDEN, p);
-    return ast;
-  }
-  }
-  printError(p->current, "unknown argument type");
-  exit(EXIT_FAILURE);
-}
-
-AstNode *newFnCallNode(char *fnName, int argsCount, AstNode **callArgs) {
-  AstNode *node = (AstNode *)malloc(sizeof(AstNode));
+AstNode *newFnCallNode(char *fnName, int argsCount, AstNode **callArgs,
+                       Loc loc) {
+  AstNode *node = allocNode();
 
   if (!node) {
     printf("failed allocating memory for the ast\n");
@@ -986,27 +1229,29 @@ AstNode *newFnCallNode(char *fnName, int argsCount, AstNode **callArgs) {
   }
 
   node->type = NODE_FUNCTION_CALL;
+  node->line = loc.row;
   node->isCall = 1;
   node->function.call.argsCount = argsCount;
-  node->function.call.name = strdup(fnName);
+  node->function.call.name = fnName;
   node->function.call.args = callArgs;
   return node;
 }
 
 AstNode *functionCall(Parser *p) {
 
-  char *fnName = strdup(p->current->value);
+  Loc loc = *p->current->loc;
+  char *fnName = p->current->value;
   consume(TOKEN_IDEN, p);
   consume(TOKEN_LPAREN, p);
 
   int capacity = 2;
   int argsCount = 0;
 
-  AstNode **callArgs = (AstNode **)malloc(sizeof(AstNode *) * capacity);
+  AstNode **callArgs = (AstNode **)memAlloc(sizeof(AstNode *) * capacity);
   while (p->current->type != TOKEN_RPAREN) {
     if (argsCount >= capacity) {
       capacity *= 2;
-      callArgs = (AstNode **)realloc(callArgs, sizeof(AstNode *) * capacity);
+      callArgs = (AstNode **)memRealloc(callArgs, sizeof(AstNode *) * capacity);
     }
     AstNode *argAst = parseFnArguments(p);
     if (p->current->type != TOKEN_RPAREN) {
@@ -1016,8 +1261,7 @@ AstNode *functionCall(Parser *p) {
     argsCount++;
   }
   consume(TOKEN_RPAREN, p);
-  AstNode *node = newFnCallNode(fnName, argsCount, callArgs);
-  free(fnName);
+  AstNode *node = newFnCallNode(fnName, argsCount, callArgs, loc);
   return node;
 }
 
@@ -1030,7 +1274,25 @@ AstNode *parseReturn(Parser *p) {
   }
   consume(TOKEN_RETURN, p);
   AstNode *expression = logical(p);
-  return newReturnNode(expression, NODE_RETURN);
+  return newReturnNode(expression, NODE_RETURN, *tkn->loc);
+}
+
+// spawn f(args) starts f as a task and evaluates to a handle for it
+AstNode *parseSpawn(Parser *p) {
+  Token *tkn = p->current;
+  consume(TOKEN_SPAWN, p);
+  if (p->current->type != TOKEN_IDEN || parserPeek(p)->type != TOKEN_LPAREN) {
+    printError(p->current, "spawn expects a function call");
+    exit(EXIT_FAILURE);
+  }
+  return newReturnNode(functionCall(p), NODE_SPAWN, *tkn->loc);
+}
+
+// await h waits for the task behind the handle h and evaluates to its result
+AstNode *parseAwait(Parser *p) {
+  Token *tkn = p->current;
+  consume(TOKEN_AWAIT, p);
+  return newReturnNode(factor(p), NODE_AWAIT, *tkn->loc);
 }
 
 AstNode *parsePrint(Parser *p) {
@@ -1038,8 +1300,8 @@ AstNode *parsePrint(Parser *p) {
 
   if (tkn->type != TOKEN_PRINT) {
     printError(p->current, "excpted function println but got %s", tkn->value);
-    free(tkn->value);
-    free(tkn);
+    memFree(tkn->value);
+    memFree(tkn);
     exit(EXIT_FAILURE);
   }
   consume(TOKEN_PRINT, p);
@@ -1047,12 +1309,13 @@ AstNode *parsePrint(Parser *p) {
 
   int initalCapacity = 5;
   int currentSize = 0;
-  AstNode **stmts = (AstNode **)malloc(sizeof(AstNode *) * initalCapacity);
+  AstNode **stmts = (AstNode **)memAlloc(sizeof(AstNode *) * initalCapacity);
 
   while (p->current->type != TOKEN_RPAREN) {
     if (currentSize >= initalCapacity) {
       initalCapacity += 5;
-      stmts = (AstNode **)realloc(stmts, sizeof(AstNode *) * (initalCapacity));
+      stmts =
+          (AstNode **)memRealloc(stmts, sizeof(AstNode *) * (initalCapacity));
     }
 
     AstNode *stmt = logical(p);
@@ -1078,25 +1341,65 @@ AstNode *parseReadIn(Parser *p) {
   consume(TOKEN_READ_IN, p);
 
   consume(TOKEN_LPAREN, p);
-  char *type = strdup(p->current->value);
   if (!checkValidType(p->current)) {
-    printError(p->current, "unknown type parameter %s\n", type);
-    free(type);
+    printError(p->current, "unknown type parameter %s\n", p->current->value);
     exit(EXIT_FAILURE);
   }
+  ValueType type = typeFromName(p->current->value);
   consume(TOKEN_IDEN, p);
   consume(TOKEN_RPAREN, p);
   return newReadInNode(NODE_FUNCTION_READ_IN, type);
 }
 
+static int isLoopVariable(AstNode *node, char *name) {
+  return node && node->type == NODE_IDENTIFIER_VALUE &&
+         node->identifier.name == name;
+}
+
+// parfor needs a header whose trip count is known before the loop starts:
+// parfor(i:number = a; i < b; i = i + step) with a literal step above zero
+static void checkParForHeader(Token *keyword, AstNode *initializer,
+                              AstNode *condition, AstNode *icrDcr) {
+  if (initializer->type != NODE_IDENTIFIER_ASSIGNMENT ||
+      initializer->identifier.type != TYPE_NUMBER) {
+    printError(keyword, "parfor must declare a number loop variable");
+    exit(EXIT_FAILURE);
+  }
+  char *name = initializer->identifier.name;
+
+  if (condition->type != NODE_BINARY_OP ||
+      (condition->binaryOp.op != TOKEN_LESSER &&
+       condition->binaryOp.op != TOKEN_EQ_LESSER) ||
+      !isLoopVariable(condition->binaryOp.left, name)) {
+    printError(keyword, "parfor condition must be %s < bound or %s <= bound",
+               name, name);
+    exit(EXIT_FAILURE);
+  }
+
+  AstNode *step = icrDcr->type == NODE_IDENTIFIER_MUTATION
+                      ? icrDcr->identifier.value
+                      : NULL;
+  if (!step || icrDcr->identifier.name != name ||
+      step->type != NODE_BINARY_OP || step->binaryOp.op != TOKEN_PLUS ||
+      !isLoopVariable(step->binaryOp.left, name) ||
+      step->binaryOp.right->type != NODE_NUMBER ||
+      step->binaryOp.right->number.value <= 0) {
+    printError(keyword, "parfor must step with %s = %s + <positive number>",
+               name, name);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// parses both for and parfor, they only differ in how the body runs
 AstNode *parseForLoop(Parser *p) {
   Loc loc = *p->current->loc;
-  if (p->current->type != TOKEN_FOR) {
+  Token *keyword = p->current;
+  if (keyword->type != TOKEN_FOR && keyword->type != TOKEN_PARFOR) {
     printError(p->current, "expected for but got %s",
                tokenNames[p->current->type]);
     exit(EXIT_FAILURE);
   }
-  consume(TOKEN_FOR, p);
+  consume(keyword->type, p);
   consume(TOKEN_LPAREN, p);
 
   AstNode *initializer = varDecleration(p);
@@ -1114,7 +1417,13 @@ AstNode *parseForLoop(Parser *p) {
     exit(EXIT_FAILURE);
   }
   AstNode *loopBody = parseBlockStmt(p);
-  return newForLoopNode(initializer, condition, icrDcr, loopBody, loc);
+  AstNode *node =
+      newForLoopNode(initializer, condition, icrDcr, loopBody, loc);
+  if (keyword->type == TOKEN_PARFOR) {
+    checkParForHeader(keyword, initializer, condition, icrDcr);
+    node->type = NODE_PARFOR_LOOP;
+  }
+  return node;
 }
 
 AstNode *parseBreakNode(Parser *p) {
@@ -1161,30 +1470,32 @@ void parseFixedArray(Parser *p, AstNode ***elements, Token *type,
   int currentSize = 0;
   int capacity = 10;
 
-  *elements = (AstNode **)calloc(capacity, sizeof(AstNode *));
+  *elements = (AstNode **)memCalloc(capacity, sizeof(AstNode *));
   capacity *= 2;
-  *elements = (AstNode **)realloc(*elements, sizeof(AstNode *) * capacity);
+  *elements = (AstNode **)memRealloc(*elements, sizeof(AstNode *) * capacity);
   if (elements == NULL) {
     printf("cannot allocated enough memory for array elements of size");
     exit(EXIT_FAILURE);
   }
 
   while (p->current->type != TOKEN_RCURLY) {
-    if (currentSize >= capacity) {
+    // one slot is kept for the NULL that terminates the elements
+    if (currentSize + 1 >= capacity) {
       capacity *= 2;
-      *elements = (AstNode **)realloc(*elements, sizeof(AstNode *) * capacity);
-      if (elements == NULL) {
+      *elements =
+          (AstNode **)memRealloc(*elements, sizeof(AstNode *) * capacity);
+      if (*elements == NULL) {
         printf("cannot allocated enough memory for array elements of size");
         exit(EXIT_FAILURE);
       }
     }
 
     AstNode *ast = logical(p);
-    char *astType = getNodeType(ast->type);
+    ValueType astType = literalType(ast->type);
 
-    if (strcmp(astType, type->value) != 0) {
-      printError(type, "cannot insert type of %s in array of type %s", astType,
-                 type->value);
+    if (astType != typeFromName(type->value)) {
+      printError(type, "cannot insert type of %s in array of type %s",
+                 astType ? typeName(astType) : "nan", type->value);
       exit(EXIT_FAILURE);
     }
 
@@ -1196,6 +1507,7 @@ void parseFixedArray(Parser *p, AstNode ***elements, Token *type,
     }
     currentSize++;
   }
+  (*elements)[currentSize] = NULL;
   (*actualSize) = currentSize;
 }
 
@@ -1205,7 +1517,7 @@ void parseDynamicArray(Parser *p, AstNode ***elements, Token *type,
   int currentSize = 0;
   int capacity = 10;
 
-  *elements = (AstNode **)calloc(capacity, sizeof(AstNode *));
+  *elements = (AstNode **)memCalloc(capacity, sizeof(AstNode *));
   if (*elements == NULL) {
     printf("cannot allocated enough memory for array *elements ");
     exit(EXIT_FAILURE);
@@ -1215,9 +1527,10 @@ void parseDynamicArray(Parser *p, AstNode ***elements, Token *type,
 
     // reallocating the new mem size if the array is full
 
-    if (currentSize >= capacity) {
+    if (currentSize + 1 >= capacity) {
       capacity *= 2;
-      *elements = (AstNode **)realloc(elements, sizeof(AstNode *) * capacity);
+      *elements =
+          (AstNode **)memRealloc(*elements, sizeof(AstNode *) * capacity);
       if (*elements == NULL) {
         printf("cannot allocated enough memory for array *elements ");
         exit(EXIT_FAILURE);
@@ -1228,10 +1541,10 @@ void parseDynamicArray(Parser *p, AstNode ***elements, Token *type,
     // end
 
     AstNode *ast = logical(p);
-    char *astType = getNodeType(ast->type);
-    if (strcmp(astType, type->value) != 0) {
-      printError(type, "cannot insert type of %s in array of type %s", astType,
-                 type->value);
+    ValueType astType = literalType(ast->type);
+    if (astType != typeFromName(type->value)) {
+      printError(type, "cannot insert type of %s in array of type %s",
+                 astType ? typeName(astType) : "nan", type->value);
       exit(EXIT_FAILURE);
     }
 
@@ -1243,6 +1556,7 @@ void parseDynamicArray(Parser *p, AstNode ***elements, Token *type,
     (*elements)[currentSize] = ast;
     currentSize++;
   }
+  (*elements)[currentSize] = NULL;
   (*actualSize) = currentSize;
 }
 
@@ -1273,7 +1587,6 @@ AstNode *parseArray(Parser *p) {
   if (p->current->type == TOKEN_ASSIGN) {
     consume(TOKEN_ASSIGN, p);
     AstNode *value = logical(p);
-    char *nodeType = getNodeType(value->type);
     return newArrayElmAssignNode(name->value, arraySize, value, *name->loc);
   } else if (p->current->type == TOKEN_SEMI_COLON ||
              p->current->type == TOKEN_RPAREN ||
@@ -1292,15 +1605,25 @@ AstNode *parseArray(Parser *p) {
     printError(type, "unknown type param %s\n", type->value);
     exit(EXIT_FAILURE);
   }
+  ValueType arrayType = arrayTypeOf(typeFromName(type->value));
   consume(TOKEN_IDEN, p);
 
   if (p->current->type == TOKEN_SEMI_COLON) {
-    return newArrayDeclNode(name->value, type->value, isFixed, arraySize,
+    return newArrayDeclNode(name->value, arrayType, isFixed, arraySize,
                             *name->loc);
   }
   // =
   consume(TOKEN_ASSIGN, p);
 
+  // any other expression must evaluate to an array, e.g. `c[]:number = a + b;`
+  if (p->current->type != TOKEN_LCURLY) {
+    AstNode *init = logical(p);
+    AstNode *node = newArrayNode(name->value, arrayType, isFixed, 0, arraySize,
+                                 NULL, *name->loc);
+    node->array.init = init;
+    return node;
+  }
+
   //{
 
   consume(TOKEN_LCURLY, p);
@@ -1313,6 +1636,6 @@ AstNode *parseArray(Parser *p) {
 
   consume(TOKEN_RCURLY, p);
 
-  return newArrayNode(name->value, type->value, isFixed, actualSize, arraySize,
+  return newArrayNode(name->value, arrayType, isFixed, actualSize, arraySize,
                       elements, *name->loc);
 }
@@ -38,6 +38,12 @@ static const char *nodeTypeNames[] = {
     "array_declaration",
     "array_element_assign",
     "node_array_element_access",
+    "node_array_value",
+    "node_parfor_loop",
+    "node_spawn",
+    "node_await",
+    "node_hoisted",
+    "node_compiled",
 };
 enum {
   NODE_NONE,
@@ -65,6 +71,12 @@ enum {
   NODE_ARRAY_DECLARATION,
   NODE_ARRAY_ELEMENT_ASSIGN,
   NODE_ARRAY_ELEMENT_ACCESS,
+  NODE_ARRAY_VALUE, // result holding an Array *
+  NODE_PARFOR_LOOP,
+  NODE_SPAWN, // expr is the call that runs as a task
+  NODE_AWAIT, // expr evaluates to a task handle
+  NODE_HOISTED, // identifier.value computed once into identifier.name
+  NODE_COMPILED, // a number expression lowered into closures
 };
 
 // NECESSARY
@@ -82,6 +94,8 @@ AstNode *parseStatement(Parser *p);
 AstNode *parseReturn(Parser *p);
 AstNode *parsePrint(Parser *p);
 AstNode *parseForLoop(Parser *p);
+AstNode *parseSpawn(Parser *p);
+AstNode *parseAwait(Parser *p);
 AstNode *parseBreakNode(Parser *p);
 AstNode *parseContinueNode(Parser *p);
 AstNode *parseWhileNode(Parser *p);
@@ -91,13 +105,45 @@ AstNode *functionCall(Parser *p);
 AstNode *parseReadIn(Parser *p);
 AstNode *oarseArrayDecl(Parser *p);
 // utils
-Parser *InitParser(Lexer *, SymbolContext *);
+Parser *InitParser(Lexer *, SymbolContext *, int pipelined, int lexThreads);
+void releaseTokens(Parser *p);
+// parses a function body skipped by a lazy parser, a no-op once it is parsed
+void parseLazyBody(AstNode *block);
 void freeAst(AstNode *);
+// frees the blocks every node was carved from, after the last freeAst
+void freeNodes(void);
+// a copy of a single node, the children stay shared with the original
+AstNode *copyNode(AstNode *node);
+// where the node was parsed
+Loc nodeLoc(AstNode *node);
+
+// the one description of which fields of a node are its children, every
+// pass that walks the ast goes through it
+typedef void (*ChildFn)(AstNode *child, void *ctx);
+// calls fn on each child of node that is set, in source order. a function's
+// body is its child, one still pending holds no statements
+void forEachChild(AstNode *node, ChildFn fn, void *ctx);
+
+typedef struct NodeList {
+  AstNode **nodes;
+  int size;
+  int capacity;
+} NodeList;
+
+// appends node to the NodeList list, nothing when node is NULL. made to be
+// handed to forEachChild
+void appendNode(AstNode *node, void *list);
+// pushes the children of node onto work so they come off it in source order
+void pushChildren(NodeList *work, AstNode *node);
+// root and every node under it into all, parents before children and in
+// source order. function bodies are entered when enterFunctions is set
+void flattenAst(NodeList *all, AstNode *root, int enterFunctions);
 void consume(TokenType, Parser *);
 void printError(Token *, const char *s, ...);
 void printContext(Token *);
 int checkValidType(Token *);
 int parserIsAtEnd(Parser *p);
+Token *parserPeek(Parser *p);
 // MIGHT BE NEEDED
 
 int isKeyword(char *);
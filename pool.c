@@ -0,0 +1,217 @@
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// the part of the job a worker still owns: iterations [next, end)
+typedef struct WorkRange {
+  pthread_mutex_t lock;
+  long next;
+  long end;
+  char pad[64]; // keeps neighbouring ranges off the same cache line
+} WorkRange;
+
+struct ThreadPool {
+  pthread_t *threads;
+  WorkRange *ranges;
+  int workers;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start; // signalled when a new job is posted
+  pthread_cond_t done;  // signalled when the last worker leaves a job
+  long generation;      // bumped for every job
+  int running;          // workers that have not finished the current job
+  int shutdown;
+
+  PoolTask task;
+  void *arg;
+  long grain;
+};
+
+typedef struct WorkerArg {
+  ThreadPool *pool;
+  int id;
+} WorkerArg;
+
+// takes the back half of some other worker's range into the worker's own
+static int steal(ThreadPool *pool, int id) {
+  for (int i = 1; i < pool->workers; i++) {
+    WorkRange *victim = &pool->ranges[(id + i) % pool->workers];
+
+    pthread_mutex_lock(&victim->lock);
+    long left = victim->end - victim->next;
+    if (left <= 0) {
+      pthread_mutex_unlock(&victim->lock);
+      continue;
+    }
+    long end = victim->end;
+    long mid = victim->end - (left + 1) / 2;
+    victim->end = mid;
+    pthread_mutex_unlock(&victim->lock);
+
+    WorkRange *own = &pool->ranges[id];
+    pthread_mutex_lock(&own->lock);
+    own->next = mid;
+    own->end = end;
+    pthread_mutex_unlock(&own->lock);
+    return 1;
+  }
+  return 0;
+}
+
+static void work(ThreadPool *pool, int id) {
+  WorkRange *own = &pool->ranges[id];
+
+  for (;;) {
+    pthread_mutex_lock(&own->lock);
+    if (own->next < own->end) {
+      long from = own->next;
+      long to = from + pool->grain < own->end ? from + pool->grain : own->end;
+      own->next = to;
+      pthread_mutex_unlock(&own->lock);
+      pool->task(pool->arg, id, from, to);
+      continue;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    if (!steal(pool, id)) {
+      return;
+    }
+  }
+}
+
+static void finishWork(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  if (--pool->running == 0) {
+    pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void *workerMain(void *data) {
+  WorkerArg *arg = (WorkerArg *)data;
+  ThreadPool *pool = arg->pool;
+  int id = arg->id;
+  free(arg);
+
+  long seen = 0;
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->generation == seen && !pool->shutdown) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->shutdown) {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, id);
+    finishWork(pool);
+  }
+}
+
+ThreadPool *createThreadPool(int workers) {
+  ThreadPool *pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+  if (!pool) {
+    printf("failed allocating thread pool\n");
+    exit(EXIT_FAILURE);
+  }
+  if (workers < 1) {
+    workers = 1;
+  }
+
+  pool->workers = workers;
+  pool->threads = (pthread_t *)calloc(workers, sizeof(pthread_t));
+  pool->ranges = (WorkRange *)calloc(workers, sizeof(WorkRange));
+  if (!pool->threads || !pool->ranges) {
+    printf("failed allocating thread pool\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_init(&pool->ranges[i].lock, NULL);
+  }
+
+  for (int i = 1; i < workers; i++) {
+    WorkerArg *arg = (WorkerArg *)malloc(sizeof(WorkerArg));
+    if (!arg) {
+      printf("failed allocating thread pool\n");
+      exit(EXIT_FAILURE);
+    }
+    arg->pool = pool;
+    arg->id = i;
+    if (pthread_create(&pool->threads[i], NULL, workerMain, arg) != 0) {
+      printf("failed starting worker thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return pool;
+}
+
+int poolWorkers(ThreadPool *pool) { return pool->workers; }
+
+void poolRun(ThreadPool *pool, long count, long grain, PoolTask task,
+             void *arg) {
+  if (count <= 0) {
+    return;
+  }
+
+  // no worker is inside a job here, the ranges can be set without locks
+  long share = count / pool->workers;
+  long extra = count % pool->workers;
+  long next = 0;
+  for (int i = 0; i < pool->workers; i++) {
+    long size = share + (i < extra ? 1 : 0);
+    pool->ranges[i].next = next;
+    pool->ranges[i].end = next + size;
+    next += size;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->task = task;
+  pool->arg = arg;
+  pool->grain = grain > 0 ? grain : 1;
+  pool->running = pool->workers;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  work(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->running--;
+  while (pool->running > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void freeThreadPool(ThreadPool *pool) {
+  if (!pool) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 1; i < pool->workers; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  for (int i = 0; i < pool->workers; i++) {
+    pthread_mutex_destroy(&pool->ranges[i].lock);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  free(pool->ranges);
+  free(pool->threads);
+  free(pool);
+}
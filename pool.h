@@ -0,0 +1,19 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+// runs iterations [from, to) of a job on the given worker
+typedef void (*PoolTask)(void *arg, int worker, long from, long to);
+
+typedef struct ThreadPool ThreadPool;
+
+// starts workers - 1 threads, the thread calling poolRun is worker 0
+ThreadPool *createThreadPool(int workers);
+int poolWorkers(ThreadPool *pool);
+
+// splits [0, count) evenly across the workers. a worker takes grain sized
+// chunks from the front of its own range and, once that is empty, steals the
+// back half of another worker's range. returns when every iteration ran
+void poolRun(ThreadPool *pool, long count, long grain, PoolTask task,
+             void *arg);
+void freeThreadPool(ThreadPool *pool);
+#endif // POOL_H_
@@ -0,0 +1,160 @@
+#include "scan.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// ------------------------------- scalar ---------------------------------
+// used on non x86 targets
+
+#ifndef SCAN_X86
+static int isSpaceByte(unsigned char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static size_t skipSpacePlain(const char *s, size_t from, int *lines) {
+  size_t i = from;
+  while (isSpaceByte((unsigned char)s[i])) {
+    *lines += s[i] == '\n';
+    i++;
+  }
+  return i;
+}
+
+static size_t findBytePlain(const char *s, size_t from, char c, int *lines) {
+  size_t i = from;
+  while (s[i] != c && s[i] != '\0') {
+    *lines += s[i] == '\n';
+    i++;
+  }
+  return i;
+}
+
+static const ScanOps plainOps = {"scalar", skipSpacePlain, findBytePlain};
+#else
+
+// ------------------------------- sse2 -----------------------------------
+// a block is 16 bytes, the masks have one bit per byte
+
+// the bytes of x that are ' ' or in '\t'..'\r'
+static __m128i spaceSse2(__m128i x) {
+  __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+  __m128i control =
+      _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')),
+                     shifted);
+  return _mm_or_si128(control, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+
+static unsigned newlinesSse2(__m128i x) {
+  return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+}
+
+// the newlines among the bits of mask below stop, which is under 32
+static int countBelow(unsigned mask, int stop) {
+  return __builtin_popcount(mask & ((1u << stop) - 1));
+}
+
+static size_t skipSpaceSse2(const char *s, size_t from, int *lines) {
+  for (size_t i = from;; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+    unsigned newlines = newlinesSse2(x);
+    unsigned stop = ~(unsigned)_mm_movemask_epi8(spaceSse2(x)) & 0xFFFF;
+    if (stop) {
+      int at = __builtin_ctz(stop);
+      *lines += countBelow(newlines, at);
+      return i + at;
+    }
+    *lines += __builtin_popcount(newlines);
+  }
+}
+
+static size_t findByteSse2(const char *s, size_t from, char c, int *lines) {
+  __m128i wanted = _mm_set1_epi8(c);
+  __m128i zero = _mm_setzero_si128();
+  for (size_t i = from;; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+    unsigned newlines = newlinesSse2(x);
+    unsigned stop = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(x, wanted), _mm_cmpeq_epi8(x, zero)));
+    if (stop) {
+      int at = __builtin_ctz(stop);
+      *lines += countBelow(newlines, at);
+      return i + at;
+    }
+    *lines += __builtin_popcount(newlines);
+  }
+}
+
+static const ScanOps sse2Ops = {"sse2", skipSpaceSse2, findByteSse2};
+
+// ------------------------------- avx2 -----------------------------------
+// compiled for avx2 only here, they run after the cpu check in scanOps
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i spaceAvx2(__m256i x) {
+  __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+  __m256i control = _mm256_cmpeq_epi8(
+      _mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+  return _mm256_or_si256(control, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
+
+AVX2 static unsigned newlinesAvx2(__m256i x) {
+  return (unsigned)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+}
+
+AVX2 static size_t skipSpaceAvx2(const char *s, size_t from, int *lines) {
+  for (size_t i = from;; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+    unsigned newlines = newlinesAvx2(x);
+    unsigned stop = ~(unsigned)_mm256_movemask_epi8(spaceAvx2(x));
+    if (stop) {
+      int at = __builtin_ctz(stop);
+      *lines += countBelow(newlines, at);
+      return i + at;
+    }
+    *lines += __builtin_popcount(newlines);
+  }
+}
+
+AVX2 static size_t findByteAvx2(const char *s, size_t from, char c,
+                                int *lines) {
+  __m256i wanted = _mm256_set1_epi8(c);
+  __m256i zero = _mm256_setzero_si256();
+  for (size_t i = from;; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+    unsigned newlines = newlinesAvx2(x);
+    unsigned stop = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(x, wanted), _mm256_cmpeq_epi8(x, zero)));
+    if (stop) {
+      int at = __builtin_ctz(stop);
+      *lines += countBelow(newlines, at);
+      return i + at;
+    }
+    *lines += __builtin_popcount(newlines);
+  }
+}
+
+static const ScanOps avx2Ops = {"avx2", skipSpaceAvx2, findByteAvx2};
+#endif
+
+static const ScanOps *selectedOps = NULL;
+static pthread_once_t selectOnce = PTHREAD_ONCE_INIT;
+
+static void selectOps(void) {
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  selectedOps = __builtin_cpu_supports("avx2") ? &avx2Ops : &sse2Ops;
+#else
+  selectedOps = &plainOps;
+#endif
+}
+
+const ScanOps *scanOps(void) {
+  pthread_once(&selectOnce, selectOps);
+  return selectedOps;
+}
@@ -0,0 +1,22 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <stddef.h>
+
+// the lexer's source is followed by this many zero bytes past its
+// terminator, so the kernels can load whole blocks at the end of the input
+#define SCAN_PADDING 32
+
+// block scanners over the lexer's source. both stop at the terminating zero
+// byte and add the newlines they pass over to *lines
+typedef struct ScanOps {
+  const char *name;
+  // index of the first byte at or after from that isspace rejects
+  size_t (*skipSpace)(const char *s, size_t from, int *lines);
+  // index of the first c or zero byte at or after from
+  size_t (*findByte)(const char *s, size_t from, char c, int *lines);
+} ScanOps;
+
+// picks the widest scanners the cpu supports on the first call
+const ScanOps *scanOps(void);
+#endif // SCAN_H_
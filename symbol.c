@@ -1,5 +1,6 @@
 
 #include "symbol.h"
+#include "alloc.h"
 #include "common.h"
 #include "interpreter.h"
 #include "parser.h"
@@ -9,62 +10,37 @@
 #include <stdlib.h>
 #include <string.h>
 
-char *inferTypeFromResult(Result *res) {
-  if (res->NodeType == NODE_STRING_LITERAL) {
-    return "string";
-  }
-  if (res->NodeType == NODE_NUMBER) {
-    return "number";
-  }
-  return "nan";
-}
-
 SymbolContext *createSymbolContext(int capacity) {
-  SymbolContext *ctx = (SymbolContext *)calloc(1, sizeof(*ctx));
+  SymbolContext *ctx = (SymbolContext *)memCalloc(1, sizeof(*ctx));
 
   // Initialize global table
-  ctx->globalTable = (SymbolTable *)calloc(1, sizeof(SymbolTable));
+  ctx->globalTable = (SymbolTable *)memCalloc(1, sizeof(SymbolTable));
   ctx->globalTable->capacity = capacity;
   ctx->globalTable->size = 0;
 
-  ctx->globalTable->entries = (SymbolTableEntry **)calloc(
+  ctx->globalTable->entries = (SymbolTableEntry **)memCalloc(
       ctx->globalTable->capacity, sizeof(SymbolTableEntry *));
 
   // Initialize the stack
-  ctx->stack = (Stack *)calloc(1, sizeof(Stack));
+  ctx->stack = (Stack *)memCalloc(1, sizeof(Stack));
   ctx->stack->capacity = capacity;
   ctx->stack->frameCount = 0;
   ctx->stack->frames =
-      (StackFrame **)calloc(1, sizeof(StackFrame *) * ctx->stack->capacity);
+      (StackFrame **)memCalloc(1, sizeof(StackFrame *) * ctx->stack->capacity);
 
   return ctx;
 }
 
-void freeSymbolArray(SymbolTableEntry *entry) {
-
-  if (strcmp(entry->type, "string") == 0) {
-    for (int j = 0; j < entry->arraySize; j++) {
-      free(((char **)entry->value)[j]);
-    }
-  }
-  free(entry->value);
-}
-
+// the body belongs to the definition's node and goes with the program's
+// ast, a local function is declared from it again on the next call
 void freeFnSymbol(SymbolTableEntry *entry) {
-
-  if (entry->function.body) {
-    freeAst(entry->function.body);
-  }
-
   for (int i = 0; i < entry->function.parameterCount; i++) {
-    free(entry->function.params[i]->name);
-    if (strcmp(entry->function.params[i]->type, "string") == 0) {
-      free(entry->function.params[i]->value);
+    if (entry->function.params[i]->type == TYPE_STRING) {
+      memFree(entry->function.params[i]->value);
     }
-    free(entry->function.params[i]->type);
   }
 
-  free(entry->function.params);
+  memFree(entry->function.params);
 }
 
 void printStack(SymbolContext *ctx) {
@@ -96,6 +72,36 @@ void printGblTable(SymbolContext *ctx) {
   printf("\n\n");
 }
 
+// the frames of the scopes that were left stay above the open ones, a new
+// scope takes the next one before anything is allocated
+static StackFrame *openFrame(Stack *stack) {
+  if (stack->capacity <= stack->frameCount) {
+    int capacity = stack->capacity * 2;
+    StackFrame **frames =
+        memRealloc(stack->frames, sizeof(StackFrame *) * capacity);
+    if (!frames) {
+      printf("failed allocating the scope stack\n");
+      exit(EXIT_FAILURE);
+    }
+    memset(frames + stack->capacity, 0,
+           sizeof(StackFrame *) * (capacity - stack->capacity));
+    stack->frames = frames;
+    stack->capacity = capacity;
+  }
+
+  StackFrame *frame = stack->frames[stack->frameCount];
+  if (!frame) {
+    frame = memCalloc(1, sizeof(StackFrame));
+    if (!frame || !(frame->localTable = memCalloc(1, sizeof(SymbolTable)))) {
+      printf("failed allocating a scope\n");
+      exit(EXIT_FAILURE);
+    }
+    stack->frames[stack->frameCount] = frame;
+  }
+  stack->frameCount++;
+  return frame;
+}
+
 void exitScope(SymbolContext *ctx) {
 
   StackFrame *frame = ctx->stack->frames[ctx->stack->frameCount - 1];
@@ -114,50 +120,35 @@ void exitScope(SymbolContext *ctx) {
     if (!entry) {
       continue;
     }
-    free(entry->symbol);
-
-    if (strcmp(entry->type, "string") == 0) {
-      free(entry->value);
-    }
-
-    if (entry->isArray) {
-      freeSymbolArray(entry);
-    }
+    // the name is interned, the value is left to the collector
 
     if (entry->isFn) {
       freeFnSymbol(entry);
+      ctx->localFunctions--;
     }
 
-    free(entry->type);
-    free(entry);
+    memFree(entry);
   }
-  free(table->entries);
-  free(table);
-  free(frame);
+  // the frame and its entry array are kept for the next scope
+  table->size = 0;
+  frame->stackLevel = 0;
+  frame->isFunction = 0;
   ctx->stack->frameCount--;
 }
 
-void enterScope(SymbolContext *ctx) {
-
-  int frameCount = ctx->stack->frameCount;
-  int capacity = ctx->stack->capacity;
-
-  // Check if we need to increase the capacity of the stack
-  if (capacity <= frameCount) {
-    ctx->stack->capacity *= 2;
-    ctx->stack->frames = realloc(ctx->stack->frames,
-                                 sizeof(StackFrame *) * ctx->stack->capacity);
-    if (!ctx->stack->frames) {
-      // handle memory error
+void enterScope(SymbolContext *ctx) { openFrame(ctx->stack); }
+
+// frees the frames kept above the open scopes of stack
+void releaseFrames(Stack *stack) {
+  for (int i = stack->frameCount; i < stack->capacity; i++) {
+    StackFrame *frame = stack->frames[i];
+    if (frame) {
+      memFree(frame->localTable->entries);
+      memFree(frame->localTable);
+      memFree(frame);
+      stack->frames[i] = NULL;
     }
   }
-
-  // Create a new stack frame for the new scope
-  ctx->stack->frames[frameCount] = calloc(1, sizeof(StackFrame));
-  ctx->stack->frames[frameCount]->localTable = calloc(1, sizeof(SymbolTable));
-
-  // Increment frame count since we've entered a new scope
-  ctx->stack->frameCount++;
 }
 
 SymbolTableEntry *lookupLocalScope(SymbolTable *scope, char *name,
@@ -165,7 +156,7 @@ SymbolTableEntry *lookupLocalScope(SymbolTable *scope, char *name,
   for (int j = 0; j < scope->size; j++) {
 
     SymbolTableEntry *entry = scope->entries[j];
-    if (strcmp(entry->symbol, name) == 0) {
+    if (entry->symbol == name) { // names are interned
 
       switch (kind) {
       case SYMBOL_KIND_FUNCTION:
@@ -180,39 +171,20 @@ SymbolTableEntry *lookupLocalScope(SymbolTable *scope, char *name,
         break;
       }
     }
-
-    // If we are looking for a variable, it could be a function parameter.
-    if (entry->isFn && entry->function.parameterCount > 0) {
-      // Check for parametersi am in fire in the function's parameter list
-      for (int k = 0; k < entry->function.parameterCount; k++) {
-        FuncParams *param = entry->function.params[k];
-        if (strcmp(param->name, name) == 0) {
-          // Create a temporary SymbolTableEntry for the parameter
-          SymbolTableEntry *paramEntry = calloc(1, sizeof(SymbolTableEntry));
-          paramEntry->symbol = param->name;
-          paramEntry->type = param->type;
-          paramEntry->value = param->value;
-          paramEntry->isArray = param->isArray;
-          paramEntry->isFn = false;
-          paramEntry->isParam = true;
-          return paramEntry; // Return the entry for the parameter
-        }
-      }
-    }
   }
 
   return NULL;
 }
 // enters the array and it's value in symbol table
-SymbolError insertArray(SymbolContext *ctx, char *name, char *type, int size,
-                        void *values, int isFixed) {
+SymbolError insertArray(SymbolContext *ctx, char *name, ValueType type,
+                        Array *array) {
 
   SymbolTable *gblTable = ctx->globalTable;
 
   if (gblTable->size >= gblTable->capacity) {
     gblTable->capacity *= 2;
-    gblTable->entries = realloc(gblTable->entries, sizeof(SymbolTableEntry *) *
-                                                       gblTable->capacity);
+    gblTable->entries = memRealloc(
+        gblTable->entries, sizeof(SymbolTableEntry *) * gblTable->capacity);
     if (gblTable->entries == NULL) {
       return SYMBOL_MEM_ERROR; // Handle realloc failure
     }
@@ -220,18 +192,16 @@ SymbolError insertArray(SymbolContext *ctx, char *name, char *type, int size,
 
   // Allocate memory for a new SymbolTableEntry
   gblTable->entries[gblTable->size] =
-      (SymbolTableEntry *)calloc(1, sizeof(SymbolTableEntry));
+      (SymbolTableEntry *)memCalloc(1, sizeof(SymbolTableEntry));
   if (gblTable->entries[gblTable->size] == NULL) {
     return SYMBOL_MEM_ERROR; // Handle malloc failure
   }
 
-  ctx->globalTable->entries[ctx->globalTable->size]->value = values;
-  ctx->globalTable->entries[ctx->globalTable->size]->symbol = strdup(name);
-  ctx->globalTable->entries[ctx->globalTable->size]->type = strdup(type);
-  ctx->globalTable->entries[ctx->globalTable->size]->arraySize = size;
+  ctx->globalTable->entries[ctx->globalTable->size]->value = array;
+  ctx->globalTable->entries[ctx->globalTable->size]->symbol = name;
+  ctx->globalTable->entries[ctx->globalTable->size]->type = type;
   ctx->globalTable->entries[ctx->globalTable->size]->isArray = 1;
   ctx->globalTable->entries[ctx->globalTable->size]->isGlobal = 1;
-  ctx->globalTable->entries[ctx->globalTable->size]->isFixed = isFixed;
   ctx->globalTable->size++;
   return SYMBOL_ERROR_NONE;
 }
@@ -254,12 +224,17 @@ SymbolTableEntry *lookupSymbol(SymbolContext *context, char *name,
     if (entry) {
       return entry;
     }
+
+    // the caller's locals are not visible from inside a call
+    if (frame->isFunction) {
+      break;
+    }
   }
 
   return lookupGlobalScope(context->globalTable, name, kind);
 }
 
-SymbolError insertLocalSymbol(SymbolContext *ctx, char *type, char *name,
+SymbolError insertLocalSymbol(SymbolContext *ctx, ValueType type, char *name,
                               Result *value, SymbolKind kind, int level) {
   // Check if the symbol already exists
   SymbolTableEntry *entry = lookupSymbol(ctx, name, kind);
@@ -278,14 +253,14 @@ SymbolError insertLocalSymbol(SymbolContext *ctx, char *type, char *name,
 
   // Ensure the local table is initialized for the current frame
   if (frame->localTable == NULL) {
-    frame->localTable = calloc(1, sizeof(SymbolTable));
+    frame->localTable = memCalloc(1, sizeof(SymbolTable));
     if (!frame->localTable) {
       return SYMBOL_MEM_ERROR;
     }
     // Initialize capacity
     frame->localTable->capacity = 4; // Starting with a small capacity
     frame->localTable->entries =
-        calloc(frame->localTable->capacity, sizeof(SymbolTableEntry *));
+        memCalloc(frame->localTable->capacity, sizeof(SymbolTableEntry *));
     if (!frame->localTable->entries) {
       return SYMBOL_MEM_ERROR;
     }
@@ -295,7 +270,7 @@ SymbolError insertLocalSymbol(SymbolContext *ctx, char *type, char *name,
 
     frame->localTable->capacity = 4;
     frame->localTable->entries =
-        calloc(frame->localTable->capacity, sizeof(SymbolTableEntry *));
+        memCalloc(frame->localTable->capacity, sizeof(SymbolTableEntry *));
   }
 
   SymbolTable *locTable = frame->localTable;
@@ -314,7 +289,7 @@ SymbolError insertLocalSymbol(SymbolContext *ctx, char *type, char *name,
     // of failure
     size_t newCapacity = locTable->capacity * 2;
     SymbolTableEntry **temp =
-        realloc(locTable->entries, sizeof(SymbolTableEntry *) * newCapacity);
+        memRealloc(locTable->entries, sizeof(SymbolTableEntry *) * newCapacity);
 
     // Check for memory allocation failure
     if (!temp) {
@@ -329,15 +304,15 @@ SymbolError insertLocalSymbol(SymbolContext *ctx, char *type, char *name,
   }
 
   // Allocate and initialize the new symbol table entry
-  locTable->entries[locTable->size] = calloc(1, sizeof(SymbolTableEntry));
+  locTable->entries[locTable->size] = memCalloc(1, sizeof(SymbolTableEntry));
 
   if (!locTable->entries[locTable->size]) {
     return SYMBOL_MEM_ERROR;
   }
 
   // Copy the symbol and type
-  locTable->entries[locTable->size]->type = strdup(type);
-  locTable->entries[locTable->size]->symbol = strdup(name);
+  locTable->entries[locTable->size]->type = type;
+  locTable->entries[locTable->size]->symbol = name;
   locTable->entries[locTable->size]->isGlobal = 0;
 
   // Handle the case where the value is NULL (e.g., uninitialized variables)
@@ -347,19 +322,8 @@ SymbolError insertLocalSymbol(SymbolContext *ctx, char *type, char *name,
     return SYMBOL_ERROR_NONE;
   }
 
-  // Infer the type and check for type mismatch
-  char *inferredType = inferTypeFromResult(value);
-  if (strcmp(inferredType, type) != 0) {
-    return SYMBOL_TYPE_ERROR;
-  }
-
-  // Handle value assignment based on type
-  if (strcmp(type, "string") == 0) {
-    locTable->entries[locTable->size]->value = strdup((char *)value->result);
-    free(value->result); // Free the result as the value is now copied
-  } else if (strcmp(type, "number") == 0) {
-    locTable->entries[locTable->size]->value = (double *)value->result;
-  }
+  // the evaluator checked the type before inserting
+  locTable->entries[locTable->size]->value = value->result;
 
   // Increment the size of the local table
   locTable->size++;
@@ -367,7 +331,7 @@ SymbolError insertLocalSymbol(SymbolContext *ctx, char *type, char *name,
   return SYMBOL_ERROR_NONE;
 }
 // entires the entry in global scope
-SymbolError insertGlobalSymbol(SymbolContext *ctx, char *type, char *name,
+SymbolError insertGlobalSymbol(SymbolContext *ctx, ValueType type, char *name,
                                Result *value, SymbolKind kind) {
 
   SymbolTableEntry *entry = lookupSymbol(ctx, name, kind);
@@ -382,13 +346,13 @@ SymbolError insertGlobalSymbol(SymbolContext *ctx, char *type, char *name,
 
     ctx->globalTable->capacity *= 2;
     ctx->globalTable->entries =
-        realloc(ctx->globalTable->entries,
-                sizeof(SymbolTableEntry *) * ctx->globalTable->capacity);
+        memRealloc(ctx->globalTable->entries,
+                   sizeof(SymbolTableEntry *) * ctx->globalTable->capacity);
   }
 
-  ctx->globalTable->entries[size] = calloc(1, sizeof(SymbolTableEntry));
-  ctx->globalTable->entries[size]->symbol = strdup(name);
-  ctx->globalTable->entries[size]->type = strdup(type);
+  ctx->globalTable->entries[size] = memCalloc(1, sizeof(SymbolTableEntry));
+  ctx->globalTable->entries[size]->symbol = name;
+  ctx->globalTable->entries[size]->type = type;
   ctx->globalTable->entries[size]->isGlobal = 1;
 
   if (value == NULL) {
@@ -397,30 +361,19 @@ SymbolError insertGlobalSymbol(SymbolContext *ctx, char *type, char *name,
     return SYMBOL_ERROR_NONE;
   }
 
-  char *inferredType = inferTypeFromResult(value);
-
-  if (strcmp(inferredType, type) != 0) {
-    return SYMBOL_TYPE_ERROR;
-  }
-  if (strcmp(type, "string") == 0) {
-    ctx->globalTable->entries[size]->value = strdup((char *)value->result);
-    free(value->result);
-  }
-  if (strcmp(type, "number") == 0) {
-    ctx->globalTable->entries[size]->value = (double *)value->result;
-  }
+  ctx->globalTable->entries[size]->value = value->result;
   ctx->globalTable->size++;
   return SYMBOL_ERROR_NONE;
 }
 
 // entirs the function in global scope
-SymbolError insertFunction(SymbolTable *gblTable, char *name, char *type,
+SymbolError insertFunction(SymbolTable *gblTable, char *name, ValueType type,
                            int paramCount, FuncParams **params, AstNode *body,
                            SymbolKind kind) {
   if (gblTable->size >= gblTable->capacity) {
     gblTable->capacity *= 2;
-    gblTable->entries = realloc(gblTable->entries, sizeof(SymbolTableEntry *) *
-                                                       gblTable->capacity);
+    gblTable->entries = memRealloc(
+        gblTable->entries, sizeof(SymbolTableEntry *) * gblTable->capacity);
     if (gblTable->entries == NULL) {
       return SYMBOL_MEM_ERROR; // Handle realloc failure
     }
@@ -428,21 +381,21 @@ SymbolError insertFunction(SymbolTable *gblTable, char *name, char *type,
 
   // Allocate memory for a new SymbolTableEntry
   gblTable->entries[gblTable->size] =
-      (SymbolTableEntry *)calloc(1, sizeof(SymbolTableEntry));
+      (SymbolTableEntry *)memCalloc(1, sizeof(SymbolTableEntry));
   if (gblTable->entries[gblTable->size] == NULL) {
     return SYMBOL_MEM_ERROR; // Handle malloc failure
   }
 
   // Set up the function entry
   gblTable->entries[gblTable->size]->isFn = 1;
-  gblTable->entries[gblTable->size]->symbol = strdup(name);
-  gblTable->entries[gblTable->size]->type = strdup(type);
+  gblTable->entries[gblTable->size]->symbol = name;
+  gblTable->entries[gblTable->size]->type = type;
   gblTable->entries[gblTable->size]->function.parameterCount = paramCount;
   gblTable->entries[gblTable->size]->function.body = body;
 
   // Allocate memory for the parameter array in the function symbol
   gblTable->entries[gblTable->size]->function.params =
-      calloc(paramCount, sizeof(FuncParams *));
+      memCalloc(paramCount, sizeof(FuncParams *));
   if (gblTable->entries[gblTable->size]->function.params == NULL) {
     return SYMBOL_MEM_ERROR; // Handle malloc failure for params
   }
@@ -458,47 +411,19 @@ SymbolError insertFunction(SymbolTable *gblTable, char *name, char *type,
   return SYMBOL_ERROR_NONE;
 }
 
-// entires the function entry in local scope
-SymbolError insertFnStack(SymbolContext *ctx, char *name, char *type,
+// enters the function in the innermost open scope, it goes when that scope
+// is left
+SymbolError insertFnStack(SymbolContext *ctx, char *name, ValueType type,
                           int paramCount, FuncParams **params, AstNode *body,
                           SymbolKind kind) {
-
-  if (ctx->stack->capacity <= ctx->stack->frameCount) {
-    ctx->stack->capacity *= 2;
-    ctx->stack->frames = (StackFrame **)realloc(
-        ctx->stack->frames, sizeof(StackFrame *) * ctx->stack->capacity);
-    if (ctx->stack->frames == NULL) {
-      return SYMBOL_MEM_ERROR;
-    }
-  }
-
-  // Allocate memory for the new StackFrame if necessary
-  ctx->stack->frames[ctx->stack->frameCount] =
-      (StackFrame *)calloc(1, sizeof(StackFrame));
-  if (!ctx->stack->frames[ctx->stack->frameCount]) {
-    return SYMBOL_MEM_ERROR;
-  }
-
-  // Initialize the local symbol table in the new stack frame
-  StackFrame *newFrame = ctx->stack->frames[ctx->stack->frameCount];
-  newFrame->localTable = (SymbolTable *)calloc(1, sizeof(SymbolTable));
-  if (!newFrame->localTable) {
-    return SYMBOL_MEM_ERROR;
-  }
-
-  // Initialize local table's capacity and entries
-  newFrame->localTable->capacity = 10; // or some initial value
-  newFrame->localTable->size = 0;
-  newFrame->localTable->entries = (SymbolTableEntry **)calloc(
-      newFrame->localTable->capacity, sizeof(SymbolTableEntry *));
-  if (!newFrame->localTable->entries) {
-    return SYMBOL_MEM_ERROR;
+  if (ctx->stack->frameCount == 0) {
+    return SYMBOL_NOT_FOUND_ERROR;
   }
-
-  SymbolTable *localTable = newFrame->localTable;
+  StackFrame *frame = ctx->stack->frames[ctx->stack->frameCount - 1];
+  SymbolTable *localTable = frame->localTable;
   if (localTable->capacity <= localTable->size) {
-    localTable->capacity *= 2;
-    localTable->entries = (SymbolTableEntry **)realloc(
+    localTable->capacity = localTable->capacity ? localTable->capacity * 2 : 10;
+    localTable->entries = (SymbolTableEntry **)memRealloc(
         localTable->entries, sizeof(SymbolTableEntry *) * localTable->capacity);
 
     if (localTable->entries == NULL) {
@@ -508,21 +433,49 @@ SymbolError insertFnStack(SymbolContext *ctx, char *name, char *type,
 
   // Insert the function into the local table
   insertFunction(localTable, name, type, paramCount, params, body, kind);
-
-  ctx->stack->frameCount++;
+  ctx->localFunctions++;
   return SYMBOL_ERROR_NONE;
 }
 
-void updateParamWithArgs(SymbolTableEntry *sym, int index, Result *res) {
-  if (res->NodeType == NODE_STRING_LITERAL) {
-    sym->function.params[index]->value = strdup((char *)res->result);
-  } else {
-    sym->function.params[index]->value = (double *)res->result;
+// enters the scope that holds a call's parameters
+void enterFunctionScope(SymbolContext *ctx) {
+  enterScope(ctx);
+  ctx->stack->frames[ctx->stack->frameCount - 1]->isFunction = 1;
+}
+
+// binds the argument to the parameter at index inside the current call frame
+void updateParamWithArgs(SymbolContext *ctx, SymbolTableEntry *sym, int index,
+                         Result *res) {
+  StackFrame *frame = ctx->stack->frames[ctx->stack->frameCount - 1];
+  SymbolTable *table = frame->localTable;
+  FuncParams *param = sym->function.params[index];
+
+  if (table->size >= table->capacity) {
+    table->capacity = table->capacity ? table->capacity * 2 : 4;
+    table->entries = memRealloc(table->entries,
+                                sizeof(SymbolTableEntry *) * table->capacity);
   }
-};
+
+  SymbolTableEntry *entry = memCalloc(1, sizeof(SymbolTableEntry));
+  entry->symbol = param->name;
+  entry->type = param->type;
+  entry->isParam = 1;
+
+  entry->value = res->result;
+  table->entries[table->size++] = entry;
+}
+
+// gives the parameters of the call frame on top the values of a call that
+// reuses it, they were bound in order by updateParamWithArgs
+void rebindParams(SymbolContext *ctx, Result *args, int count) {
+  StackFrame *frame = ctx->stack->frames[ctx->stack->frameCount - 1];
+  for (int i = 0; i < count; i++) {
+    frame->localTable->entries[i]->value = args[i].result;
+  }
+}
 
 // handles the functions symbol entry
-SymbolError insertFunctionSymbol(SymbolContext *ctx, char *name, char *type,
+SymbolError insertFunctionSymbol(SymbolContext *ctx, char *name, ValueType type,
                                  int paramCount, FuncParams **params,
                                  SymbolKind kind, AstNode *body, int level) {
 
@@ -545,7 +498,7 @@ SymbolError insertFunctionSymbol(SymbolContext *ctx, char *name, char *type,
   return SYMBOL_ERROR_NONE;
 }
 
-SymbolError insertSymbol(SymbolContext *ctx, char *type, char *name,
+SymbolError insertSymbol(SymbolContext *ctx, ValueType type, char *name,
                          Result *value, SymbolKind kind, int level) {
   if (level > 0) {
     return insertLocalSymbol(ctx, type, name, value, kind, level);
@@ -554,32 +507,61 @@ SymbolError insertSymbol(SymbolContext *ctx, char *type, char *name,
 }
 
 // updates the value of particular symbol inside the context
-SymbolError updateSymbolTableValue(SymbolTableEntry *entry, Result *value) {
-
-  switch (value->NodeType) {
-  case NODE_STRING_LITERAL: {
-    if (strcmp(entry->type, "string") != 0) {
-      return SYMBOL_TYPE_ERROR;
-    }
-    if (entry->value) {
-      free(entry->value);
+// a context for another thread: it shares the globals and the open scopes
+// of shared, which must not change while the fork is in use, and pushes its
+// own scopes on top of them. shared may be NULL to start with no scopes
+SymbolContext *forkSymbolContext(SymbolTable *globals, Stack *shared) {
+  int frameCount = shared ? shared->frameCount : 0;
+  SymbolContext *fork = (SymbolContext *)memCalloc(1, sizeof(SymbolContext));
+  fork->globalTable = globals;
+  fork->stack = (Stack *)memCalloc(1, sizeof(Stack));
+  fork->stack->capacity = frameCount + INITIAL_CAPACITY;
+  fork->stack->frameCount = frameCount;
+  fork->stack->frames =
+      (StackFrame **)memCalloc(fork->stack->capacity, sizeof(StackFrame *));
+  if (!fork->stack->frames) {
+    printf("failed allocating symbol context\n");
+    exit(EXIT_FAILURE);
+  }
+  if (shared) {
+    memcpy(fork->stack->frames, shared->frames,
+           sizeof(StackFrame *) * frameCount);
+  }
+  for (int i = 0; i < frameCount; i++) {
+    SymbolTable *table = fork->stack->frames[i]->localTable;
+    for (int j = 0; table && j < table->size; j++) {
+      if (table->entries[j] && table->entries[j]->isFn) {
+        fork->localFunctions++;
+      }
     }
+  }
+  return fork;
+}
+
+// frees a fork once it has left every scope it entered
+void freeForkedSymbolContext(SymbolContext *fork) {
+  releaseFrames(fork->stack);
+  memFree(fork->stack->frames);
+  memFree(fork->stack);
+  memFree(fork);
+}
 
-    entry->value = strdup((char *)value->result);
-    entry->isAllocated = value->isAllocated;
-    free(value->result);
-    break;
+static void markTable(SymbolTable *table) {
+  if (!table) {
+    return;
   }
-  case NODE_NUMBER:
-    if (strcmp(entry->type, "number") != 0) {
-      return SYMBOL_TYPE_ERROR;
-    }
-    if (entry->isAllocated) {
-      free(entry->value);
+  for (int i = 0; i < table->size; i++) {
+    SymbolTableEntry *entry = table->entries[i];
+    if (entry && !entry->isFn) {
+      gcMark(entry->value);
     }
-    entry->value = (double *)value->result;
-    entry->isAllocated = value->isAllocated;
-    break;
   }
-  return SYMBOL_ERROR_NONE;
+}
+
+// marks the values of every variable the context can see
+void markSymbolContext(SymbolContext *ctx) {
+  markTable(ctx->globalTable);
+  for (int i = 0; i < ctx->stack->frameCount; i++) {
+    markTable(ctx->stack->frames[i]->localTable);
+  }
 }
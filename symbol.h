@@ -24,23 +24,31 @@ static const char *errorName[] = {
     "symbol_mem_error",  "symbol_error_none",
 };
 
-SymbolError insertGlobalSymbol(SymbolContext *ctx, char *type, char *name,
+SymbolError insertGlobalSymbol(SymbolContext *ctx, ValueType type, char *name,
                                Result *value, SymbolKind kind);
 
-SymbolError insertFunctionSymbol(SymbolContext *ctx, char *name, char *type,
+SymbolError insertFunctionSymbol(SymbolContext *ctx, char *name, ValueType type,
                                  int paramCount, FuncParams **params,
                                  SymbolKind kind, AstNode *body, int level);
 SymbolTableEntry *lookupSymbol(SymbolContext *context, char *name,
                                SymbolKind kind);
 
-SymbolError insertSymbol(SymbolContext *ctx, char *type, char *name,
+SymbolError insertSymbol(SymbolContext *ctx, ValueType type, char *name,
                          Result *value, SymbolKind kind, int level);
-SymbolError insertArray(SymbolContext *ctx, char *name, char *type, int size,
-                        void *values, int isFixed);
-SymbolError updateSymbolTableValue(SymbolTableEntry *entry, Result *value);
+SymbolError insertArray(SymbolContext *ctx, char *name, ValueType type,
+                        Array *array);
 void enterScope(SymbolContext *);
 void exitScope(SymbolContext *);
-void updateParamWithArgs(SymbolTableEntry *sym, int index, Result *res);
+void enterFunctionScope(SymbolContext *);
+void releaseFrames(Stack *stack);
+void updateParamWithArgs(SymbolContext *ctx, SymbolTableEntry *sym, int index,
+                         Result *res);
+void rebindParams(SymbolContext *ctx, Result *args, int count);
 
 SymbolContext *createSymbolContext(int capacity);
+SymbolContext *forkSymbolContext(SymbolTable *globals, Stack *shared);
+SymbolTableEntry *lookupGlobalScope(SymbolTable *table, char *name,
+                                    SymbolKind kind);
+void freeForkedSymbolContext(SymbolContext *fork);
+void markSymbolContext(SymbolContext *ctx);
 #endif // SYMBOL_H_
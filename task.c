@@ -0,0 +1,539 @@
+#include "task.h"
+#include "alloc.h"
+#include "interpreter.h"
+#include "parallel.h"
+#include "parser.h"
+#include "symbol.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// tasks are M:N: any number of them share a few scheduler threads. a task is
+// an evaluation on its own explicit stack, so it can stop after any step and
+// be resumed later by whichever thread picks it up next
+
+typedef enum TaskState {
+  TASK_READY,
+  TASK_PARKING, // parked but still finishing its step on a scheduler thread
+  TASK_BLOCKED,
+  TASK_DONE,
+} TaskState;
+
+struct Task {
+  int id;
+  TaskState state;
+  int claimed; // an await took the handle
+  Parser parser;          // the task's own evaluator and scopes
+  SymbolTable *functions; // the global functions it can call
+  SymbolTableEntry *fn;
+  AstNode *node; // the spawn, for errors
+  Result result;
+  WaitQueue waiters; // tasks awaiting this one, guarded by sched.lock
+  Task *next;
+};
+
+// the ready tasks of one scheduler thread. the owner pushes and pops at the
+// tail, thieves and requeued tasks use the head
+typedef struct TaskDeque {
+  pthread_mutex_t lock;
+  Task **tasks;
+  int head;
+  int count;
+  int capacity;
+  char pad[64]; // keeps neighbouring deques off the same cache line
+} TaskDeque;
+
+static struct {
+  int threads; // 0 picks one per cpu
+  int workers;
+  pthread_t *ids;
+  TaskDeque *deques;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake; // a task became ready or the scheduler stops
+  pthread_cond_t done; // a task finished
+  int ready;           // tasks sitting in the deques
+  int live;            // spawned tasks that have not finished
+  int shutdown;
+
+  // a collection stops the workers between two slices
+  pthread_cond_t stopped; // running or blocked changed while stopping
+  int stopping;
+  int running; // workers inside a slice
+  int blocked; // threads asleep in the middle of a step
+  int nextDeque; // spawns from outside the scheduler go round robin
+
+  Task **tasks; // by handle - 1, NULL once its result was taken
+  int taskCount;
+  int taskCapacity;
+} sched = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .stopped = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_once_t startOnce = PTHREAD_ONCE_INIT;
+static __thread int currentWorker = -1;
+
+void setTaskThreads(int threads) { sched.threads = threads; }
+
+// ------------------------------- deques ---------------------------------
+
+static void pushDeque(TaskDeque *d, Task *task, int atHead) {
+  pthread_mutex_lock(&d->lock);
+  if (d->count >= d->capacity) {
+    int capacity = d->capacity ? d->capacity * 2 : 16;
+    Task **tasks = (Task **)memAlloc(sizeof(Task *) * capacity);
+    if (!tasks) {
+      printf("failed allocating task queue\n");
+      exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < d->count; i++) {
+      tasks[i] = d->tasks[(d->head + i) % d->capacity];
+    }
+    memFree(d->tasks);
+    d->tasks = tasks;
+    d->head = 0;
+    d->capacity = capacity;
+  }
+
+  if (atHead) {
+    d->head = (d->head + d->capacity - 1) % d->capacity;
+    d->tasks[d->head] = task;
+  } else {
+    d->tasks[(d->head + d->count) % d->capacity] = task;
+  }
+  d->count++;
+  pthread_mutex_unlock(&d->lock);
+}
+
+static Task *popDeque(TaskDeque *d, int atHead) {
+  pthread_mutex_lock(&d->lock);
+  Task *task = NULL;
+  if (d->count > 0) {
+    if (atHead) {
+      task = d->tasks[d->head];
+      d->head = (d->head + 1) % d->capacity;
+    } else {
+      task = d->tasks[(d->head + d->count - 1) % d->capacity];
+    }
+    d->count--;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return task;
+}
+
+// ------------------------------ scheduler -------------------------------
+
+static void enqueue(Task *task, int atHead) {
+  int id = currentWorker;
+
+  pthread_mutex_lock(&sched.lock);
+  if (id < 0) {
+    id = sched.nextDeque++ % sched.workers;
+  }
+  pthread_mutex_unlock(&sched.lock);
+
+  pushDeque(&sched.deques[id], task, atHead);
+
+  pthread_mutex_lock(&sched.lock);
+  sched.ready++;
+  pthread_cond_signal(&sched.wake);
+  pthread_mutex_unlock(&sched.lock);
+}
+
+// the newest task of the worker's own deque, or the oldest of another one
+static Task *dequeue(int id) {
+  Task *task = popDeque(&sched.deques[id], 0);
+  for (int i = 1; !task && i < sched.workers; i++) {
+    task = popDeque(&sched.deques[(id + i) % sched.workers], 1);
+  }
+
+  if (task) {
+    pthread_mutex_lock(&sched.lock);
+    sched.ready--;
+    pthread_mutex_unlock(&sched.lock);
+  }
+  return task;
+}
+
+static void enqueueAll(Task *list) {
+  while (list) {
+    Task *next = list->next;
+    enqueue(list, 0);
+    list = next;
+  }
+}
+
+// empties the queue under sched.lock. tasks still finishing their step are
+// only marked ready, runTask requeues them; the rest come back as a list
+static Task *takeWaiters(WaitQueue *queue, int *count) {
+  Task *ready = NULL;
+  Task *task = queue->head;
+  queue->head = NULL;
+  while (task) {
+    Task *next = task->next;
+    if (task->state == TASK_BLOCKED) {
+      task->next = ready;
+      ready = task;
+    }
+    task->state = TASK_READY;
+    (*count)++;
+    task = next;
+  }
+  return ready;
+}
+
+static void parkLocked(WaitQueue *queue, Parser *p) {
+  Task *task = p->task;
+  task->state = TASK_PARKING;
+  task->next = queue->head;
+  queue->head = task;
+  p->parked = 1;
+}
+
+void parkTask(WaitQueue *queue, Parser *p) {
+  pthread_mutex_lock(&sched.lock);
+  parkLocked(queue, p);
+  pthread_mutex_unlock(&sched.lock);
+}
+
+int wakeTasks(WaitQueue *queue) {
+  int count = 0;
+  pthread_mutex_lock(&sched.lock);
+  Task *ready = takeWaiters(queue, &count);
+  pthread_mutex_unlock(&sched.lock);
+  enqueueAll(ready);
+  return count;
+}
+
+int awaitTask(Task *task, Parser *p) {
+  pthread_mutex_lock(&sched.lock);
+  int done = task->state == TASK_DONE;
+  if (!done) {
+    parkLocked(&task->waiters, p);
+  }
+  pthread_mutex_unlock(&sched.lock);
+  return done;
+}
+
+static void finishTask(Task *task) {
+  Result value = takeEvalResult(&task->parser);
+  exitScope(task->parser.ctx);
+  checkReturnValue(task->node, task->fn, value);
+
+  value.isReturn = 0;
+
+  pthread_mutex_lock(&sched.lock);
+  task->result = value;
+  int count = 0;
+  Task *ready = takeWaiters(&task->waiters, &count);
+  task->state = TASK_DONE;
+  sched.live--;
+  pthread_cond_broadcast(&sched.done);
+  pthread_mutex_unlock(&sched.lock);
+
+  // the task may be freed by now, only its waiters are left to touch
+  enqueueAll(ready);
+}
+
+static void runTask(Task *task) {
+  task->parser.parked = 0;
+  if (resumeEval(&task->parser, TASK_SLICE)) {
+    finishTask(task);
+    return;
+  }
+
+  if (task->parser.parked) {
+    // a wake may have come in while the step was still running
+    pthread_mutex_lock(&sched.lock);
+    int woken = task->state == TASK_READY;
+    if (!woken) {
+      task->state = TASK_BLOCKED;
+    }
+    pthread_mutex_unlock(&sched.lock);
+    if (woken) {
+      enqueue(task, 0);
+    }
+    return;
+  }
+
+  // out of its slice, the task goes where thieves look first
+  enqueue(task, 1);
+}
+
+// waits for a ready task while no collection stops the workers. returns 0
+// once the scheduler shuts down
+static int enterSlice(void) {
+  pthread_mutex_lock(&sched.lock);
+  while ((sched.ready == 0 || sched.stopping) && !sched.shutdown) {
+    pthread_cond_wait(&sched.wake, &sched.lock);
+  }
+  int stop = sched.ready == 0 && sched.shutdown;
+  if (!stop) {
+    sched.running++;
+  }
+  pthread_mutex_unlock(&sched.lock);
+  return !stop;
+}
+
+static void leaveSlice(void) {
+  pthread_mutex_lock(&sched.lock);
+  sched.running--;
+  if (sched.stopping) {
+    pthread_cond_signal(&sched.stopped);
+  }
+  pthread_mutex_unlock(&sched.lock);
+}
+
+static void *workerMain(void *arg) {
+  int id = (int)(long)arg;
+  currentWorker = id;
+
+  while (enterSlice()) {
+    Task *task = dequeue(id);
+    if (task) {
+      runTask(task);
+    }
+    leaveSlice();
+  }
+  return NULL;
+}
+
+static void startScheduler(void) {
+  int workers = sched.threads;
+  if (workers <= 0) {
+    workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (workers < 1) {
+    workers = 1;
+  }
+
+  sched.workers = workers;
+  sched.ids = (pthread_t *)memCalloc(workers, sizeof(pthread_t));
+  sched.deques = (TaskDeque *)memCalloc(workers, sizeof(TaskDeque));
+  if (!sched.ids || !sched.deques) {
+    printf("failed allocating task scheduler\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_init(&sched.deques[i].lock, NULL);
+  }
+  for (int i = 0; i < workers; i++) {
+    if (pthread_create(&sched.ids[i], NULL, workerMain, (void *)(long)i) !=
+        0) {
+      printf("failed starting scheduler thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// -------------------------------- tasks ---------------------------------
+
+static void freeTask(Task *task) {
+  freeEvalStack(task->parser.eval);
+  freeForkedSymbolContext(task->parser.ctx);
+  memFree(task->functions->entries);
+  memFree(task->functions);
+  memFree(task);
+}
+
+int spawnTask(AstNode *node, SymbolTableEntry *fn, Result *args, Parser *p) {
+  pthread_once(&startOnce, startScheduler);
+
+  Task *task = (Task *)memCalloc(1, sizeof(Task));
+  if (!task) {
+    printf("failed allocating task\n");
+    exit(EXIT_FAILURE);
+  }
+  task->fn = fn;
+  task->node = node;
+  task->functions = checkSpawnedFunction(fn, p);
+
+  // the task sees nothing but the global functions it can reach
+  task->parser = *p;
+  task->parser.ctx = forkSymbolContext(task->functions, NULL);
+  task->parser.eval = createEvalStack(p->eval->maxDepth);
+  task->parser.task = task;
+  task->parser.parked = 0;
+  task->parser.inParallel = 1;
+  task->parser.level = 0;
+
+  enterFunctionScope(task->parser.ctx);
+  for (int i = 0; i < fn->function.parameterCount; i++) {
+    updateParamWithArgs(task->parser.ctx, fn, i, &args[i]);
+  }
+  parseLazyBody(fn->function.body);
+  startEval(fn->function.body, &task->parser);
+
+  pthread_mutex_lock(&sched.lock);
+  if (sched.taskCount >= sched.taskCapacity) {
+    sched.taskCapacity = sched.taskCapacity ? sched.taskCapacity * 2 : 64;
+    sched.tasks =
+        (Task **)memRealloc(sched.tasks, sizeof(Task *) * sched.taskCapacity);
+    if (!sched.tasks) {
+      printf("failed allocating task table\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  sched.tasks[sched.taskCount++] = task;
+  task->id = sched.taskCount;
+  sched.live++;
+  pthread_mutex_unlock(&sched.lock);
+
+  int id = task->id;
+  enqueue(task, 0);
+  return id;
+}
+
+Task *claimTask(AstNode *node, double handle) {
+  int id = (int)handle;
+  Task *task = NULL;
+
+  pthread_mutex_lock(&sched.lock);
+  if (id >= 1 && id <= sched.taskCount && sched.tasks[id - 1] &&
+      !sched.tasks[id - 1]->claimed) {
+    task = sched.tasks[id - 1];
+    task->claimed = 1;
+  }
+  pthread_mutex_unlock(&sched.lock);
+
+  if (!task) {
+    printEvalError(nodeLoc(node),
+                   "%d is not a task handle or was already awaited", id);
+    exit(EXIT_FAILURE);
+  }
+  return task;
+}
+
+int isTaskDone(Task *task) {
+  pthread_mutex_lock(&sched.lock);
+  int done = task->state == TASK_DONE;
+  pthread_mutex_unlock(&sched.lock);
+  return done;
+}
+
+static void blockLocked(void) {
+  sched.blocked++;
+  if (sched.stopping) {
+    pthread_cond_signal(&sched.stopped);
+  }
+}
+
+void waitTask(Task *task) {
+  pthread_mutex_lock(&sched.lock);
+  if (task->state != TASK_DONE) {
+    blockLocked();
+    while (task->state != TASK_DONE) {
+      pthread_cond_wait(&sched.done, &sched.lock);
+    }
+    sched.blocked--;
+  }
+  pthread_mutex_unlock(&sched.lock);
+}
+
+Result takeTaskResult(Task *task) {
+  pthread_mutex_lock(&sched.lock);
+  sched.tasks[task->id - 1] = NULL;
+  pthread_mutex_unlock(&sched.lock);
+
+  Result res = task->result;
+  freeTask(task);
+  return res;
+}
+
+void enterBlocking(void) {
+  pthread_mutex_lock(&sched.lock);
+  blockLocked();
+  pthread_mutex_unlock(&sched.lock);
+}
+
+void leaveBlocking(void) {
+  pthread_mutex_lock(&sched.lock);
+  sched.blocked--;
+  pthread_mutex_unlock(&sched.lock);
+}
+
+int stopTasks(void) {
+  if (sched.workers == 0) {
+    return 1;
+  }
+
+  pthread_mutex_lock(&sched.lock);
+  sched.stopping = 1;
+  while (sched.running > 0 && sched.blocked == 0) {
+    pthread_cond_wait(&sched.stopped, &sched.lock);
+  }
+  int stopped = sched.running == 0;
+  if (!stopped) {
+    sched.stopping = 0;
+    pthread_cond_broadcast(&sched.wake);
+  }
+  pthread_mutex_unlock(&sched.lock);
+  return stopped;
+}
+
+void resumeTasks(void) {
+  if (sched.workers == 0) {
+    return;
+  }
+  pthread_mutex_lock(&sched.lock);
+  sched.stopping = 0;
+  pthread_cond_broadcast(&sched.wake);
+  pthread_mutex_unlock(&sched.lock);
+}
+
+// a stopped task sits between two steps, everything it holds is in its
+// scopes and on its value stack
+void markTasks(void) {
+  for (int i = 0; i < sched.taskCount; i++) {
+    Task *task = sched.tasks[i];
+    if (!task) {
+      continue;
+    }
+    if (task->state == TASK_DONE) {
+      markResult(&task->result);
+      continue;
+    }
+    markSymbolContext(task->parser.ctx);
+    markEvalStack(task->parser.eval);
+  }
+}
+
+void shutdownTasks(void) {
+  if (sched.workers == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&sched.lock);
+  while (sched.live > 0) {
+    pthread_cond_wait(&sched.done, &sched.lock);
+  }
+  sched.shutdown = 1;
+  pthread_cond_broadcast(&sched.wake);
+  pthread_mutex_unlock(&sched.lock);
+
+  for (int i = 0; i < sched.workers; i++) {
+    pthread_join(sched.ids[i], NULL);
+  }
+
+  // tasks nobody awaited
+  for (int i = 0; i < sched.taskCount; i++) {
+    if (sched.tasks[i]) {
+      freeTask(sched.tasks[i]);
+    }
+  }
+  for (int i = 0; i < sched.workers; i++) {
+    pthread_mutex_destroy(&sched.deques[i].lock);
+    memFree(sched.deques[i].tasks);
+  }
+  memFree(sched.tasks);
+  memFree(sched.deques);
+  memFree(sched.ids);
+  sched.workers = 0;
+}
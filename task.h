@@ -0,0 +1,57 @@
+#ifndef TASK_H_
+#define TASK_H_
+
+#include "common.h"
+
+// evaluator steps a task runs before it lets other tasks on its worker run
+#define TASK_SLICE 10000
+
+// sets the number of scheduler threads, must be called before the first spawn
+void setTaskThreads(int threads);
+
+// starts fn with the evaluated args as a task and returns its handle. the
+// args are consumed
+int spawnTask(AstNode *node, SymbolTableEntry *fn, Result *args, Parser *p);
+
+// tasks parked on something, guarded by the lock of whatever they wait on
+typedef struct WaitQueue {
+  Task *head;
+} WaitQueue;
+
+// parks the task p is running on the queue: the evaluator stops after the
+// current step and runs it again once the task is woken
+void parkTask(WaitQueue *queue, Parser *p);
+
+// makes every task on the queue ready and returns how many there were
+int wakeTasks(WaitQueue *queue);
+
+// returns 1 if the awaited task is done, otherwise parks p's task on it
+int awaitTask(Task *task, Parser *p);
+
+// takes the task behind a handle for an await. a handle can be awaited once
+Task *claimTask(AstNode *node, double handle);
+int isTaskDone(Task *task);
+
+// blocks the calling thread until the task has finished
+void waitTask(Task *task);
+
+// the result of a finished task, the task is freed
+Result takeTaskResult(Task *task);
+
+// stops the scheduler threads at the end of their slices, so every task sits
+// between two steps until resumeTasks. returns 0 and stops nothing when a
+// thread sleeps in the middle of a step, its values are not all on a stack
+int stopTasks(void);
+void resumeTasks(void);
+
+// a thread is about to sleep inside a step until another one wakes it
+void enterBlocking(void);
+void leaveBlocking(void);
+
+// marks what the stopped tasks reach: the scopes and value stacks of the
+// unfinished ones and the results nobody took yet
+void markTasks(void);
+
+// waits for every task still running and stops the scheduler
+void shutdownTasks(void);
+#endif // TASK_H_
@@ -0,0 +1,1043 @@
+#include "../alloc.h"
+#include "../budget.h"
+#include "../channel.h"
+#include "../checker.h"
+#include "../common.h"
+#include "../compile.h"
+#include "../interpreter.h"
+#include "../lexer.h"
+#include "../optimize.h"
+#include "../parallel.h"
+#include "../parser.h"
+#include "../symbol.h"
+#include "../task.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define OUT_MAX (64 * 1024) // output of a script kept for the checks
+
+static int failures;
+
+static void passed(const char *name) {
+  printf(GREEN "Passed: Test %s \n" RESET, name);
+}
+
+static void failed(const char *name, const char *why) {
+  printf(RED "Failed: in %s -> %s\n" RESET, name, why);
+  failures++;
+}
+
+// the command line options of main a script runs with, zero is the default
+typedef struct Config {
+  size_t maxHeap;
+  int maxDepth;
+  long maxSteps;
+  double timeout;
+  int threads;
+  int pipeline;
+  int lexThreads;
+  int lazy;
+  int noInline;
+  int noOptimize;
+  int noCompile;
+} Config;
+
+typedef struct Run {
+  int status;        // exit code, 128 + the signal when one ended it
+  char out[OUT_MAX]; // stdout and stderr, colors taken out
+} Run;
+
+// what main does with a file, in the child that runs the script
+static void runChild(const char *source, Config *config) {
+  setMaxHeap(config->maxHeap);
+  setMemErrorHandler(reportMemoryError);
+  setStepLimit(config->maxSteps);
+
+  Lexer *lex = InitLexer(memStrdup(source), "test.r");
+  Parser *p = InitParser(lex, createSymbolContext(100), config->pipeline,
+                         config->lexThreads ? config->lexThreads : 1);
+  p->lazyBodies = config->lazy;
+  p->eval = createEvalStack(config->maxDepth ? config->maxDepth
+                                             : DEFAULT_MAX_DEPTH);
+  setParallelThreads(config->threads);
+  setTaskThreads(config->threads);
+
+  AstNode **program = NULL;
+  int size = 0;
+  int capacity = 0;
+  while (p->current->type != TOKEN_EOF) {
+    AstNode *ast = parseAst(p);
+    if (ast) {
+      if (size >= capacity) {
+        capacity = capacity ? capacity * 2 : 16;
+        program =
+            (AstNode **)memRealloc(program, sizeof(AstNode *) * capacity);
+      }
+      program[size++] = ast;
+    }
+    releaseTokens(p);
+  }
+
+  if (checkProgram(program, size) > 0) {
+    exit(EXIT_FAILURE);
+  }
+  if (!config->noInline) {
+    inlineCalls(program, size);
+  }
+  if (!config->noOptimize) {
+    optimizeProgram(program, size);
+  }
+  if (!config->noCompile) {
+    compileProgram(program, size);
+  }
+
+  setTimeLimit(config->timeout);
+  for (int i = 0; i < size; i++) {
+    EvalAst(program[i], p);
+  }
+  shutdownTasks();
+  freeChannels();
+}
+
+// drops the color escapes the interpreter prints
+static void stripColors(char *text) {
+  char *out = text;
+  for (char *in = text; *in; in++) {
+    if (*in == '\033') {
+      while (*in && *in != 'm') {
+        in++;
+      }
+      if (!*in) {
+        break;
+      }
+      continue;
+    }
+    *out++ = *in;
+  }
+  *out = '\0';
+}
+
+// runs source in a child process, so errors that end the script and the
+// threads it starts stay out of the tests. the run is overwritten by the
+// next one
+static Run *runScriptWith(const char *source, Config config) {
+  static Run run;
+  memset(&run, 0, sizeof(run));
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    printf("failed creating a pipe for a test\n");
+    exit(EXIT_FAILURE);
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    printf("failed starting a test script\n");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    runChild(source, &config);
+    exit(EXIT_SUCCESS);
+  }
+
+  close(fds[1]);
+  size_t length = 0;
+  ssize_t got;
+  char chunk[4096];
+  while ((got = read(fds[0], chunk, sizeof(chunk))) > 0) {
+    size_t keep = (size_t)got;
+    if (keep > OUT_MAX - 1 - length) {
+      keep = OUT_MAX - 1 - length;
+    }
+    memcpy(run.out + length, chunk, keep);
+    length += keep;
+  }
+  close(fds[0]);
+  run.out[length] = '\0';
+  stripColors(run.out);
+
+  int status;
+  waitpid(pid, &status, 0);
+  run.status =
+      WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  return &run;
+}
+
+static Run *runScript(const char *source) {
+  Config config = {0};
+  return runScriptWith(source, config);
+}
+
+// the script exited with status and printed text, when there is one
+static void expect(const char *name, Run *run, int status, const char *text) {
+  char why[512];
+  if (run->status != status) {
+    snprintf(why, sizeof(why), "exit code %d instead of %d, output: %.300s",
+             run->status, status, run->out);
+    failed(name, why);
+    return;
+  }
+  if (text && !strstr(run->out, text)) {
+    snprintf(why, sizeof(why), "no \"%s\" in the output: %.300s", text,
+             run->out);
+    failed(name, why);
+    return;
+  }
+  passed(name);
+}
+
+// -------------------------------- evaluator ------------------------------
+
+// calls nest on the evaluator's own stack, far deeper than the C stack
+void TestDeepRecursion() {
+  Run *run = runScript("fn depth(n:number) -> number {\n"
+                       "  if(n == 0){ return 0; }\n"
+                       "  return 1 + depth(n - 1);\n"
+                       "}\n"
+                       "println(depth(200000));\n");
+  expect(__func__, run, 0, "200000\n");
+}
+
+// running out of frames is an error of the script, not a crash
+void TestStackOverflow() {
+  Run *run = runScript("fn forever(n:number) -> number {\n"
+                       "  return 1 + forever(n + 1);\n"
+                       "}\n"
+                       "println(forever(0));\n");
+  expect(__func__, run, 1, "test.r::2::Error-> StackOverflowError");
+}
+
+// --------------------------------- arrays --------------------------------
+
+// a dynamic array grows as it is appended to, one element past its end
+void TestArrayAppend() {
+  Run *run = runScript("xs[]:number = {1};\n"
+                       "for(i:number = 1; i < 100000; i = i + 1){\n"
+                       "  xs[i] = i + 1;\n"
+                       "}\n"
+                       "println(len(xs), \" \", xs[99999]);\n");
+  expect(__func__, run, 0, "100000 100000\n");
+}
+
+// a fixed array keeps its declared size
+void TestFixedArrayBound() {
+  Run *run = runScript("xs[2]:number = {1, 2};\nxs[2] = 3;\n");
+  expect(__func__, run, 1, "test.r::2::Error-> index out of bound");
+}
+
+// operators work element wise and the reductions read the whole array
+void TestWholeArrayArithmetic() {
+  Run *run = runScript("a[]:number = {1, 2, 3};\n"
+                       "b[]:number = {10, 20, 30};\n"
+                       "c[]:number = a * 2 + b;\n"
+                       "println(c[0], \" \", c[1], \" \", c[2]);\n"
+                       "println(sum(c), \" \", min(c), \" \", max(c), \" \", "
+                       "mean(a), \" \", dot(a, b));\n");
+  expect(__func__, run, 0, "12 24 36\n72 12 36 2 140\n");
+}
+
+void TestArrayLengthMismatch() {
+  Run *run = runScript("a[]:number = {1, 2, 3};\n"
+                       "b[]:number = {1, 2};\n"
+                       "c[]:number = a + b;\n");
+  expect(__func__, run, 1, "test.r::3::Error-> cannot do ( + ) between arrays");
+}
+
+// --------------------------------- parfor --------------------------------
+
+// every iteration writes its own element, on several threads
+void TestParFor() {
+  Config config = {0};
+  config.threads = 4;
+  Run *run = runScriptWith("n:number = 1000;\n"
+                           "data[]:number = {0};\n"
+                           "out[]:number = {0};\n"
+                           "for(i:number = 0; i < n; i = i + 1){\n"
+                           "  data[i] = i;\n"
+                           "  out[i] = 0;\n"
+                           "}\n"
+                           "parfor(i:number = 0; i < n; i = i + 1){\n"
+                           "  out[i] = 2 * data[i];\n"
+                           "}\n"
+                           "println(sum(out));\n",
+                           config);
+  expect(__func__, run, 0, "999000\n");
+}
+
+// writes iterations could race on are refused before the loop starts
+void TestParForSharedVariable() {
+  Run *run = runScript("total:number = 0;\n"
+                       "parfor(i:number = 0; i < 10; i = i + 1){\n"
+                       "  total = total + i;\n"
+                       "}\n");
+  expect(__func__, run, 1, "test.r::3::Error-> parfor iterations cannot "
+                           "assign total");
+}
+
+void TestParForOtherElement() {
+  Run *run = runScript("out[]:number = {0, 0, 0};\n"
+                       "parfor(i:number = 0; i < 2; i = i + 1){\n"
+                       "  out[i + 1] = i;\n"
+                       "}\n");
+  expect(__func__, run, 1, "test.r::3::Error-> parfor iterations may only "
+                           "write out[i]");
+}
+
+// functions the body calls are checked too
+void TestParForCalledWrite() {
+  Run *run = runScript("count:number = 0;\n"
+                       "fn bump(x:number) -> number {\n"
+                       "  count = count + x;\n"
+                       "  return count;\n"
+                       "}\n"
+                       "out[]:number = {0, 0};\n"
+                       "parfor(i:number = 0; i < 2; i = i + 1){\n"
+                       "  out[i] = bump(i);\n"
+                       "}\n");
+  expect(__func__, run, 1, "test.r::3::Error-> bump cannot assign count");
+}
+
+// --------------------------------- tasks ---------------------------------
+
+// arrays are global, a spawned function is told it cannot declare one
+void TestSpawnDeclaresArray() {
+  Run *run = runScript("fn f(n:number) -> number {\n"
+                       "  xs[]:number = {1, 2, 3};\n"
+                       "  return n;\n"
+                       "}\n"
+                       "h:number = spawn f(1);\n"
+                       "println(await h);\n");
+  expect(__func__, run, 1, "test.r::2::Error-> f cannot declare array xs");
+}
+
+// tasks run beside the main program and hand back what they returned
+void TestSpawnAwait() {
+  Config config = {0};
+  config.threads = 4;
+  Run *run = runScriptWith("fn fib(n:number) -> number {\n"
+                           "  if(n < 2){ return n; }\n"
+                           "  return fib(n - 1) + fib(n - 2);\n"
+                           "}\n"
+                           "a:number = spawn fib(20);\n"
+                           "b:number = spawn fib(15);\n"
+                           "other:number = fib(10);\n"
+                           "println(await a, \" \", await b, \" \", other);\n",
+                           config);
+  expect(__func__, run, 0, "6765 610 55\n");
+}
+
+// a task can spawn and await tasks of its own
+void TestNestedSpawn() {
+  Config config = {0};
+  config.threads = 2;
+  Run *run = runScriptWith("fn leaf(n:number) -> number {\n"
+                           "  return n * 2;\n"
+                           "}\n"
+                           "fn fan(n:number) -> number {\n"
+                           "  x:number = spawn leaf(n);\n"
+                           "  y:number = spawn leaf(n + 1);\n"
+                           "  return await x + await y;\n"
+                           "}\n"
+                           "h:number = spawn fan(5);\n"
+                           "println(await h);\n",
+                           config);
+  expect(__func__, run, 0, "22\n");
+}
+
+void TestAwaitTwice() {
+  Run *run = runScript("fn one() -> number {\n"
+                       "  return 1;\n"
+                       "}\n"
+                       "h:number = spawn one();\n"
+                       "println(await h);\n"
+                       "println(await h);\n");
+  expect(__func__, run, 1, "test.r::6::Error-> 1 is not a task handle or was "
+                           "already awaited");
+}
+
+void TestSpawnReadsGlobal() {
+  Run *run = runScript("g:number = 5;\n"
+                       "fn peek() -> number {\n"
+                       "  return g;\n"
+                       "}\n"
+                       "h:number = spawn peek();\n"
+                       "println(await h);\n");
+  expect(__func__, run, 1, "test.r::3::Error-> peek cannot read g");
+}
+
+// -------------------------------- channels -------------------------------
+
+// the producer waits while the channel is full, the reader while it is
+// empty, until it is closed and drained
+void TestChannelProducerConsumer() {
+  Config config = {0};
+  config.threads = 1;
+  Run *run = runScriptWith("fn produce(c:number, n:number) -> number {\n"
+                           "  for(i:number = 1; i <= n; i = i + 1){\n"
+                           "    send(c, i);\n"
+                           "  }\n"
+                           "  close(c);\n"
+                           "  return n;\n"
+                           "}\n"
+                           "c:number = chan(2);\n"
+                           "h:number = spawn produce(c, 100);\n"
+                           "total:number = 0;\n"
+                           "while(more(c)){\n"
+                           "  total = total + recv(c);\n"
+                           "}\n"
+                           "println(total, \" \", await h);\n",
+                           config);
+  expect(__func__, run, 0, "5050 100\n");
+}
+
+// values sent before close are still received
+void TestChannelDrainAfterClose() {
+  Run *run = runScript("c:number = chan(4);\n"
+                       "send(c, \"a\");\n"
+                       "send(c, 7);\n"
+                       "close(c);\n"
+                       "println(recv(c), \" \", recv(c), \" \", more(c));\n");
+  expect(__func__, run, 0, "a 7 0\n");
+}
+
+void TestSendOnClosed() {
+  Run *run = runScript("c:number = chan(1);\nclose(c);\nsend(c, 1);\n");
+  expect(__func__, run, 1, "test.r::3::Error-> send on a closed channel");
+}
+
+void TestRecvOnClosed() {
+  Run *run = runScript("c:number = chan(1);\nclose(c);\nx:number = recv(c);\n");
+  expect(__func__, run, 1,
+         "test.r::3::Error-> recv on a closed and empty channel");
+}
+
+// --------------------------------- memory --------------------------------
+
+// the collector runs between the main program's statements while a task is
+// still going, the task's values stay and its garbage goes
+void TestCollectWhileTaskRuns() {
+  static char source[128 * 1024];
+  int length = snprintf(source, sizeof(source),
+                        "fn total(n:number) -> number {\n"
+                        "  t:number = 0;\n"
+                        "  s:string = \"s\";\n"
+                        "  for(i:number = 0; i < n; i = i + 1){\n"
+                        "    t = t + i;\n"
+                        "    s = \"a\" . \"b\";\n"
+                        "  }\n"
+                        "  return t;\n"
+                        "}\n"
+                        "b:number = spawn total(100000);\n"
+                        "junk:string = \"j\";\n");
+  for (int i = 0; i < 1000; i++) {
+    length += snprintf(source + length, sizeof(source) - length,
+                       "for(k:number = 0; k < 1000; k = k + 1){ "
+                       "junk = \"a\" . \"b\"; }\n");
+  }
+  snprintf(source + length, sizeof(source) - length, "println(await b);\n");
+
+  Config config = {0};
+  config.threads = 2;
+  config.maxHeap = 8 * 1024 * 1024;
+  Run *run = runScriptWith(source, config);
+  expect(__func__, run, 0, "4999950000\n");
+}
+
+// a loop is one statement of the main program, its garbage stays until it
+// ends and the limit is hit on the line that was running
+void TestMaxHeap() {
+  Config config = {0};
+  config.maxHeap = 256 * 1024;
+  Run *run = runScriptWith("junk:string = \"j\";\n"
+                           "for(k:number = 0; k < 100000; k = k + 1){ "
+                           "junk = \"a\" . \"b\"; }\n"
+                           "println(junk);\n",
+                           config);
+  expect(__func__, run, 1, "test.r::2::Error-> MemoryError: script heap "
+                           "limit of 262144 bytes exceeded");
+}
+
+void TestHeapCounters() {
+  Run *run = runScript("a:number = heapAllocs();\n"
+                       "s:string = \"a\" . \"b\";\n"
+                       "println(heapUsed() > 0, heapAllocs() > a, "
+                       "heapPeak() >= heapUsed());\n");
+  expect(__func__, run, 0, "111\n");
+}
+
+// --------------------------------- limits --------------------------------
+
+// runs until a limit stops it
+static const char *spinSource = "fn spin(n:number) -> number {\n"
+                                "  while(1){ n = n + 1; }\n"
+                                "  return n;\n"
+                                "}\n"
+                                "println(spin(0));\n";
+
+void TestMaxSteps() {
+  Config config = {0};
+  config.maxSteps = 1000;
+  Run *run = runScriptWith(spinSource, config);
+  expect(__func__, run, 3, "test.r::2::Error-> StepLimitError: --max-steps "
+                           "of 1000 exceeded\n  in spin called at test.r:5");
+}
+
+void TestTimeout() {
+  Config config = {0};
+  config.timeout = 0.2;
+  Run *run = runScriptWith(spinSource, config);
+  expect(__func__, run, 4, "test.r::2::Error-> TimeoutError: --timeout of "
+                           "0.2s exceeded");
+}
+
+// a script within its budget runs as before
+void TestWithinSteps() {
+  Config config = {0};
+  config.maxSteps = 100;
+  Run *run = runScriptWith("for(i:number = 0; i < 10; i = i + 1){ }\n"
+                           "println(\"done\");\n",
+                           config);
+  expect(__func__, run, 0, "done\n");
+}
+
+// -------------------------------- checker --------------------------------
+
+// every error is reported before anything runs
+void TestTypeErrors() {
+  Run *run = runScript("println(\"ran\");\n"
+                       "x:number = \"a\";\n"
+                       "fn f(a:number) -> number { return a; }\n"
+                       "y:string = f(1);\n"
+                       "z:number = f(1, 2);\n");
+  if (strstr(run->out, "ran")) {
+    failed(__func__, "the script ran");
+    return;
+  }
+  expect(__func__, run, 1,
+         "test.r::2::Error-> cannot assign typeof string to number\n"
+         "test.r::4::Error-> cannot assign typeof number to string\n"
+         "test.r::5::Error-> f expects 1 arguments but got 2\n");
+}
+
+// a rejected operand leaves the unary node unknown, the assignment above it
+// does not fail again
+void TestUnaryErrorOnce() {
+  Run *run = runScript("s:string = \"a\";\nt:string = !s;\n");
+  if (strstr(run->out, "cannot assign")) {
+    failed(__func__, "the assignment was reported too");
+    return;
+  }
+  expect(__func__, run, 1, "test.r::2::Error-> Invalid type for unary");
+}
+
+// a name only a local function has is undeclared at the top level, as the
+// runtime finds it
+void TestLocalFunctionOutOfScope() {
+  Run *run = runScript("fn outer(n:number) -> number {\n"
+                       "  fn inner(k:number) -> number {\n"
+                       "    return k;\n"
+                       "  }\n"
+                       "  return inner(n);\n"
+                       "}\n"
+                       "println(outer(4));\n"
+                       "println(inner(1, 2));\n");
+  expect(__func__, run, 1,
+         "4\ntest.r::8::Error-> undeclared function inner was called");
+}
+
+// --------------------------------- types ---------------------------------
+
+// a name declared with one type per function keeps each
+void TestTypesPerScope() {
+  Run *run = runScript("fn a() -> number { v:number = 1; return v; }\n"
+                       "fn b() -> string { v:string = \"s\"; return v; }\n"
+                       "names[]:string = {\"x\", \"y\"};\n"
+                       "println(a(), b(), names[1]);\n");
+  expect(__func__, run, 0, "1sy\n");
+}
+
+// names declared with different types keep their runtime check, which
+// names the types the same way the checker does
+void TestRuntimeTypeCheck() {
+  Run *run = runScript("fn a() -> number { v:number = 1; return v; }\n"
+                       "fn b() -> number {\n"
+                       "  v:string = \"s\";\n"
+                       "  v = 3;\n"
+                       "  return 0;\n"
+                       "}\n"
+                       "println(a());\n"
+                       "println(b());\n");
+  expect(__func__, run, 1,
+         "1\ntest.r::4::Error-> cannot assign type of number to type of "
+         "string");
+}
+
+// --------------------------------- lexer ---------------------------------
+
+// names are compared by their interned pointer, ones that share a prefix
+// stay apart
+void TestSimilarNames() {
+  Run *run = runScript("a:number = 1;\n"
+                       "ab:number = 2;\n"
+                       "abc:number = 3;\n"
+                       "abcdefghijklmnopqrstuvwxyzlongname:number = 4;\n"
+                       "println(a, ab, abc, "
+                       "abcdefghijklmnopqrstuvwxyzlongname, a + ab + abc);\n");
+  expect(__func__, run, 0, "12346\n");
+}
+
+// a name that starts like a keyword or is one letter longer is still a name
+void TestNamesLikeKeywords() {
+  Run *run = runScript("returned:number = 1;\n"
+                       "fnord:number = 2;\n"
+                       "iff:number = 3;\n"
+                       "whiles:number = 4;\n"
+                       "forth:string = \"f\";\n"
+                       "println(returned, fnord, iff, whiles, forth);\n");
+  expect(__func__, run, 0, "1234f\n");
+}
+
+void TestKeywordAsName() {
+  Run *run = runScript("fn:number = 1;\n");
+  expect(__func__, run, 1, "test.r::1::Error-> unexpected token  : expected "
+                           "token identifier");
+}
+
+// comments, runs of blanks and long strings are skipped a block at a time,
+// what they hold and the lines they span still come out right
+static const char *scanSource =
+    "# a comment with \"quotes\" ; and\n"
+    "more lines #\n"
+    "\t  \t\n"
+    "x:number = 1; # trailing #\n"
+    "s:string = \"a long string with # hashes and spaces that is longer "
+    "than a block of sixty four bytes\";\n"
+    "\n"
+    "\n"
+    "\n"
+    "      y:number = x + 1;\n"
+    "println(s);\n"
+    "println(y);\n";
+
+void TestScanBlocks() {
+  Run *run = runScript(scanSource);
+  expect(__func__, run, 0,
+         "a long string with # hashes and spaces that is longer than a block "
+         "of sixty four bytes\n2\n");
+}
+
+void TestScanLines() {
+  char source[1024];
+  snprintf(source, sizeof(source), "%sz:number = \"late\";\n", scanSource);
+  Run *run = runScript(source);
+  expect(__func__, run, 1, "test.r::12::Error-> cannot assign typeof string");
+}
+
+// tokens are freed after each statement with --pipeline, the lines of the
+// nodes stay right for errors long after
+void TestPipeline() {
+  Config config = {0};
+  config.pipeline = 1;
+  Run *run = runScriptWith(scanSource, config);
+  expect(__func__, run, 0, "of sixty four bytes\n2\n");
+}
+
+void TestPipelineLines() {
+  Config config = {0};
+  config.pipeline = 1;
+  Run *run = runScriptWith("xs[]:number = {1};\n"
+                           "fn get(i:number) -> number {\n"
+                           "  return xs[i];\n"
+                           "}\n"
+                           "# filler #\n"
+                           "println(get(0));\n"
+                           "println(get(5));\n",
+                           config);
+  expect(__func__, run, 1, "1\ntest.r::3::Error-> index out of bound");
+}
+
+// names hold no digits, the number is spelled with letters
+static void letterName(char *out, int n) {
+  snprintf(out, 16, "v%d", n);
+  for (char *c = out + 1; *c; c++) {
+    *c = 'a' + (*c - '0');
+  }
+}
+
+// a file large enough to be split, its pieces cut between comments and
+// strings that span or hold newlines, lexes to the same lines as with one
+// thread
+void TestLexThreadsLines() {
+  static char source[512 * 1024];
+  int length = 0;
+  int line = 1;
+  char name[16];
+  for (int i = 0; i < 3000; i++) {
+    letterName(name, i);
+    length += snprintf(source + length, sizeof(source) - length,
+                       "# comment %d\nover two lines #\n"
+                       "%s:number = %d; s%s:string = \"a;b # c\";\n",
+                       i, name, i, name);
+    line += 3;
+  }
+  letterName(name, 2999);
+  snprintf(source + length, sizeof(source) - length,
+           "println(%s);\nz:number = \"late\";\n", name);
+  line += 1;
+
+  char text[64];
+  snprintf(text, sizeof(text), "test.r::%d::Error-> cannot assign", line);
+  Config config = {0};
+  config.lexThreads = 4;
+  Run *run = runScriptWith(source, config);
+  expect(__func__, run, 1, text);
+}
+
+// --------------------------------- parser --------------------------------
+
+// one expression spread over many blocks of nodes, the nodes after it keep
+// their lines
+void TestLongExpression() {
+  static char source[128 * 1024];
+  int length = snprintf(source, sizeof(source), "x:number = 1");
+  for (int i = 1; i < 20000; i++) {
+    length += snprintf(source + length, sizeof(source) - length, " + 1");
+  }
+  snprintf(source + length, sizeof(source) - length,
+           ";\nprintln(x);\nxs[]:number = {1};\nprintln(xs[x]);\n");
+  Run *run = runScript(source);
+  expect(__func__, run, 1, "20000\ntest.r::4::Error-> index out of bound");
+}
+
+// a body is checked on the first call with --lazy, after what ran before it
+void TestLazyTypeError() {
+  Config config = {0};
+  config.lazy = 1;
+  Run *run = runScriptWith("println(\"before\");\n"
+                           "fn bad() -> number {\n"
+                           "  x:number = \"s\";\n"
+                           "  return 1;\n"
+                           "}\n"
+                           "println(\"after\");\n"
+                           "println(bad());\n",
+                           config);
+  expect(__func__, run, 1,
+         "before\nafter\ntest.r::3::Error-> cannot assign typeof string");
+}
+
+void TestLazySyntaxError() {
+  Config config = {0};
+  config.lazy = 1;
+  Run *run = runScriptWith("fn broken() -> number {\n"
+                           "  return 1 +;\n"
+                           "}\n"
+                           "println(\"ran\");\n"
+                           "println(broken());\n",
+                           config);
+  expect(__func__, run, 1, "ran\ntest.r::2::Error-> Unexpected token ;");
+}
+
+// --------------------------------- calls ---------------------------------
+
+// a call site caches the function it resolved to, the same name at another
+// site or in another function still finds its own
+void TestCallSiteCache() {
+  Config config = {0};
+  config.noInline = 1;
+  Run *run = runScriptWith("fn a(n:number) -> number {\n"
+                           "  fn h(x:number) -> number {\n"
+                           "    return x;\n"
+                           "  }\n"
+                           "  return h(n);\n"
+                           "}\n"
+                           "fn b(n:number) -> number {\n"
+                           "  fn h(x:number, y:number) -> number {\n"
+                           "    return x + y;\n"
+                           "  }\n"
+                           "  return h(n, 100);\n"
+                           "}\n"
+                           "t:number = 0;\n"
+                           "for(i:number = 0; i < 3; i = i + 1){\n"
+                           "  t = t + a(i) + b(i);\n"
+                           "}\n"
+                           "println(t);\n",
+                           config);
+  expect(__func__, run, 0, "306\n");
+}
+
+// an argument with side effects keeps the call, inlining x + x would run
+// it twice
+void TestInlineImpureArgument() {
+  Run *run = runScript("fn twice(x:number) -> number { return x + x; }\n"
+                       "fn noisy() -> number {\n"
+                       "  println(\"n\");\n"
+                       "  return 1;\n"
+                       "}\n"
+                       "println(twice(noisy()));\n");
+  expect(__func__, run, 0, "n\n2\n");
+}
+
+// an inlined call is no longer a step
+static const char *incSource =
+    "fn inc(x:number) -> number { return x + 1; }\n"
+    "t:number = 0;\n"
+    "for(i:number = 0; i < 10; i = i + 1){ t = inc(t); }\n"
+    "println(t);\n";
+
+void TestInlineSavesSteps() {
+  Config config = {0};
+  config.maxSteps = 15;
+  Run *run = runScriptWith(incSource, config);
+  expect(__func__, run, 0, "10\n");
+}
+
+void TestNoInlineCountsSteps() {
+  Config config = {0};
+  config.maxSteps = 15;
+  config.noInline = 1;
+  Run *run = runScriptWith(incSource, config);
+  expect(__func__, run, 3, "test.r::3::Error-> StepLimitError");
+}
+
+// a self call in tail position reuses its activation, the depth stays the
+// same however far it recurses
+void TestTailCallDepth() {
+  Config config = {0};
+  config.maxDepth = 1000;
+  Run *run = runScriptWith("fn count(n:number, acc:number) -> number {\n"
+                           "  if(n == 0){ return acc; }\n"
+                           "  return count(n - 1, acc + 1);\n"
+                           "}\n"
+                           "println(count(100000, 0));\n",
+                           config);
+  expect(__func__, run, 0, "100000\n");
+}
+
+// a call that is not the last thing the function does still nests
+void TestNonTailCallDepth() {
+  Config config = {0};
+  config.maxDepth = 1000;
+  Run *run = runScriptWith("fn count(n:number) -> number {\n"
+                           "  if(n == 0){ return 0; }\n"
+                           "  return 1 + count(n - 1);\n"
+                           "}\n"
+                           "println(count(100000));\n",
+                           config);
+  expect(__func__, run, 1, "StackOverflowError: maximum evaluation depth");
+}
+
+// ------------------------------- optimizer -------------------------------
+
+// a loop invariant self call under a return is left for the activation to be
+// reused, hoisting it would nest a call per level
+void TestHoistKeepsTailCall() {
+  Run *run = runScript("fn f(n:number, a:number) -> number {\n"
+                       "  if(n == 0){ return a; }\n"
+                       "  for(i:number = 0; i < 1; i = i + 1){\n"
+                       "    k:number = i + 1;\n"
+                       "    while(k > 0){ return f(n - 1, a + k); }\n"
+                       "  }\n"
+                       "  return 0 - 1;\n"
+                       "}\n"
+                       "println(f(100000, 0));\n");
+  expect(__func__, run, 0, "100000");
+}
+
+// --------------------------------- scopes --------------------------------
+
+// blocks that declare nothing run in the scope around them, a loop body that
+// declares gets a fresh scope on every iteration
+void TestBareBlocks() {
+  Run *run = runScript("x:number = 1;\n"
+                       "if(x > 0){\n"
+                       "  x = x + 1;\n"
+                       "  {\n"
+                       "    x = x * 10;\n"
+                       "  }\n"
+                       "}\n"
+                       "println(x);\n"
+                       "for(i:number = 0; i < 3; i = i + 1){\n"
+                       "  k:number = i;\n"
+                       "  x = x + k;\n"
+                       "}\n"
+                       "println(x);\n");
+  expect(__func__, run, 0, "20\n23\n");
+}
+
+// what a block declares is gone once it ends
+void TestBlockScopeEnds() {
+  Run *run = runScript("x:number = 1;\n"
+                       "if(x > 0){ inner:number = 5; }\n"
+                       "y:number = inner + 1;\n");
+  expect(__func__, run, 1, "test.r::3::Error-> inner is not decleared");
+}
+
+// leaving the scope of a local function keeps the body it is declared from
+void TestLocalFunctionAgain() {
+  Run *run = runScript("fn outer(n:number) -> number {\n"
+                       "  fn inner(k:number) -> number {\n"
+                       "    return k + 1;\n"
+                       "  }\n"
+                       "  return inner(n);\n"
+                       "}\n"
+                       "println(outer(1));\n"
+                       "println(outer(2));\n");
+  expect(__func__, run, 0, "2\n3\n");
+}
+
+// a local function lives in the scope it is declared in and goes with it,
+// the caller's names are found again after the call
+void TestLocalFunctionScope() {
+  Run *run = runScript("fn a(n:number) -> number {\n"
+                       "  fn h(x:number) -> number {\n"
+                       "    return x;\n"
+                       "  }\n"
+                       "  return h(n);\n"
+                       "}\n"
+                       "t:number = 0;\n"
+                       "for(i:number = 0; i < 3; i = i + 1){\n"
+                       "  t = t + a(i);\n"
+                       "}\n"
+                       "println(t);\n");
+  expect(__func__, run, 0, "3\n");
+}
+
+// ------------------------------ quickening -------------------------------
+
+// a `.` node joins strings the same on every run after it quickened
+void TestQuickenConcat() {
+  Run *run = runScript("s:string = \"a\";\n"
+                       "i:number = 0;\n"
+                       "while(i < 3){\n"
+                       "  s = s . \"b\";\n"
+                       "  i = i + 1;\n"
+                       "}\n"
+                       "println(s);\n"
+                       "println(s . \"c\");\n");
+  expect(__func__, run, 0, "abbb\nabbbc\n");
+}
+
+// a number form gives what the generic operators give, run after run
+void TestQuickenNumbers() {
+  Run *run = runScript("t:number = 0;\n"
+                       "for(i:number = 0; i < 10; i = i + 1){\n"
+                       "  t = t + i * 2 - i % 3;\n"
+                       "}\n"
+                       "println(t);\n"
+                       "println(t > 70, t <= 70);\n");
+  expect(__func__, run, 0, "81\n10\n");
+}
+
+// ------------------------------- compiling -------------------------------
+
+static const char *mixedSource =
+    "a:number = 6;\n"
+    "b:number = 4;\n"
+    "total:number = 0;\n"
+    "for(i:number = 0; i < 4; i = i + 1){\n"
+    "  total = total + (a * b + 1) * i - (a * b + 1) / 5;\n"
+    "}\n"
+    "println(total);\n"
+    "println(total > 100 && !(a == b) || b % 3);\n";
+
+// a lowered expression gives what the generic evaluator gives, a hoisted
+// temporary not yet computed runs through its source
+void TestCompiledNumbers() {
+  Run *run = runScript(mixedSource);
+  expect(__func__, run, 0, "130\n1\n");
+}
+
+void TestNotCompiledNumbers() {
+  Config config = {0};
+  config.noCompile = 1;
+  Run *run = runScriptWith(mixedSource, config);
+  expect(__func__, run, 0, "130\n1\n");
+}
+
+// an expression over the node cap is lowered in parts
+void TestCompiledInParts() {
+  static char source[2048];
+  int length =
+      snprintf(source, sizeof(source), "a:number = 3;\nb:number = 2;\n");
+  length += snprintf(source + length, sizeof(source) - length, "println(0");
+  for (int i = 0; i < 30; i++) {
+    length += snprintf(source + length, sizeof(source) - length,
+                       " + (a * %d - b)", i % 7 + 1);
+  }
+  snprintf(source + length, sizeof(source) - length, ");\n");
+  Run *run = runScript(source);
+  expect(__func__, run, 0, "285\n");
+}
+
+int main() {
+  TestDeepRecursion();
+  TestStackOverflow();
+  TestArrayAppend();
+  TestFixedArrayBound();
+  TestWholeArrayArithmetic();
+  TestArrayLengthMismatch();
+  TestParFor();
+  TestParForSharedVariable();
+  TestParForOtherElement();
+  TestParForCalledWrite();
+  TestSpawnDeclaresArray();
+  TestSpawnAwait();
+  TestNestedSpawn();
+  TestAwaitTwice();
+  TestSpawnReadsGlobal();
+  TestChannelProducerConsumer();
+  TestChannelDrainAfterClose();
+  TestSendOnClosed();
+  TestRecvOnClosed();
+  TestCollectWhileTaskRuns();
+  TestMaxHeap();
+  TestHeapCounters();
+  TestMaxSteps();
+  TestTimeout();
+  TestWithinSteps();
+  TestTypeErrors();
+  TestUnaryErrorOnce();
+  TestLocalFunctionOutOfScope();
+  TestTypesPerScope();
+  TestRuntimeTypeCheck();
+  TestSimilarNames();
+  TestNamesLikeKeywords();
+  TestKeywordAsName();
+  TestScanBlocks();
+  TestScanLines();
+  TestPipeline();
+  TestPipelineLines();
+  TestLexThreadsLines();
+  TestLongExpression();
+  TestLazyTypeError();
+  TestLazySyntaxError();
+  TestCallSiteCache();
+  TestInlineImpureArgument();
+  TestInlineSavesSteps();
+  TestNoInlineCountsSteps();
+  TestTailCallDepth();
+  TestNonTailCallDepth();
+  TestHoistKeepsTailCall();
+  TestBareBlocks();
+  TestBlockScopeEnds();
+  TestLocalFunctionAgain();
+  TestLocalFunctionScope();
+  TestQuickenConcat();
+  TestQuickenNumbers();
+  TestCompiledNumbers();
+  TestNotCompiledNumbers();
+  TestCompiledInParts();
+  if (failures) {
+    printf(RED "%d tests failed\n" RESET, failures);
+    return EXIT_FAILURE;
+  }
+  printf(GREEN "All tests passed\n" RESET);
+  return 0;
+}
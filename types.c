@@ -0,0 +1,69 @@
+#include "types.h"
+#include "parser.h"
+
+#include <string.h>
+
+ValueType typeFromName(const char *name) {
+  if (strcmp(name, "number") == 0) {
+    return TYPE_NUMBER;
+  }
+  if (strcmp(name, "string") == 0) {
+    return TYPE_STRING;
+  }
+  return TYPE_UNKNOWN;
+}
+
+const char *typeName(ValueType type) {
+  switch (type) {
+  case TYPE_NUMBER:
+    return "number";
+  case TYPE_STRING:
+    return "string";
+  case TYPE_NUMBER_ARRAY:
+    return "number[]";
+  case TYPE_STRING_ARRAY:
+    return "string[]";
+  default:
+    return "unknown";
+  }
+}
+
+ValueType arrayTypeOf(ValueType element) {
+  switch (element) {
+  case TYPE_NUMBER:
+    return TYPE_NUMBER_ARRAY;
+  case TYPE_STRING:
+    return TYPE_STRING_ARRAY;
+  default:
+    return TYPE_UNKNOWN;
+  }
+}
+
+ValueType elementTypeOf(ValueType array) {
+  switch (array) {
+  case TYPE_NUMBER_ARRAY:
+    return TYPE_NUMBER;
+  case TYPE_STRING_ARRAY:
+    return TYPE_STRING;
+  default:
+    return TYPE_UNKNOWN;
+  }
+}
+
+int isArrayType(ValueType type) {
+  return type == TYPE_NUMBER_ARRAY || type == TYPE_STRING_ARRAY;
+}
+
+ValueType resultType(Result res) {
+  switch (res.NodeType) {
+  case NODE_NUMBER:
+    return TYPE_NUMBER;
+  case NODE_STRING_LITERAL:
+    return TYPE_STRING;
+  case NODE_ARRAY_VALUE:
+    return ((Array *)res.result)->kind == ARRAY_STRING ? TYPE_STRING_ARRAY
+                                                       : TYPE_NUMBER_ARRAY;
+  default:
+    return TYPE_UNKNOWN;
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef TYPES_H_
+#define TYPES_H_
+
+#include "common.h"
+
+// the type a type name in the source stands for, TYPE_UNKNOWN if it is none
+ValueType typeFromName(const char *name);
+
+// spelled the way errors show it: number, string, number[] and string[]
+const char *typeName(ValueType type);
+
+// number and string to their array types and back, anything else is unknown
+ValueType arrayTypeOf(ValueType element);
+ValueType elementTypeOf(ValueType array);
+int isArrayType(ValueType type);
+
+// the type of an evaluated value, TYPE_UNKNOWN for none
+ValueType resultType(Result res);
+#endif // TYPES_H_
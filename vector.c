@@ -0,0 +1,418 @@
+#include "vector.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VECTOR_X86 1
+#include <immintrin.h>
+#endif
+
+// -------------------------- scalar kernels ------------------------------
+// used on non x86 targets and for the tails the vector loops leave over
+
+static void binaryScalar(VectorOp op, double *dst, const double *a,
+                         const double *b, int from, int n) {
+  switch (op) {
+  case VEC_ADD:
+    for (int i = from; i < n; i++) {
+      dst[i] = a[i] + b[i];
+    }
+    break;
+  case VEC_SUB:
+    for (int i = from; i < n; i++) {
+      dst[i] = a[i] - b[i];
+    }
+    break;
+  case VEC_MUL:
+    for (int i = from; i < n; i++) {
+      dst[i] = a[i] * b[i];
+    }
+    break;
+  case VEC_DIV:
+    for (int i = from; i < n; i++) {
+      dst[i] = a[i] / b[i];
+    }
+    break;
+  case VEC_RSUB:
+    for (int i = from; i < n; i++) {
+      dst[i] = b[i] - a[i];
+    }
+    break;
+  case VEC_RDIV:
+    for (int i = from; i < n; i++) {
+      dst[i] = b[i] / a[i];
+    }
+    break;
+  }
+}
+
+static void scalarScalar(VectorOp op, double *dst, const double *a, double s,
+                         int from, int n) {
+  switch (op) {
+  case VEC_ADD:
+    for (int i = from; i < n; i++) {
+      dst[i] = a[i] + s;
+    }
+    break;
+  case VEC_SUB:
+    for (int i = from; i < n; i++) {
+      dst[i] = a[i] - s;
+    }
+    break;
+  case VEC_MUL:
+    for (int i = from; i < n; i++) {
+      dst[i] = a[i] * s;
+    }
+    break;
+  case VEC_DIV:
+    for (int i = from; i < n; i++) {
+      dst[i] = a[i] / s;
+    }
+    break;
+  case VEC_RSUB:
+    for (int i = from; i < n; i++) {
+      dst[i] = s - a[i];
+    }
+    break;
+  case VEC_RDIV:
+    for (int i = from; i < n; i++) {
+      dst[i] = s / a[i];
+    }
+    break;
+  }
+}
+
+static double minPlain(const double *a, int n) {
+  double min = a[0];
+  for (int i = 1; i < n; i++) {
+    min = a[i] < min ? a[i] : min;
+  }
+  return min;
+}
+
+static double maxPlain(const double *a, int n) {
+  double max = a[0];
+  for (int i = 1; i < n; i++) {
+    max = a[i] > max ? a[i] : max;
+  }
+  return max;
+}
+
+#ifndef VECTOR_X86
+static void binaryPlain(VectorOp op, double *dst, const double *a,
+                        const double *b, int n) {
+  binaryScalar(op, dst, a, b, 0, n);
+}
+
+static void scalarPlain(VectorOp op, double *dst, const double *a, double s,
+                        int n) {
+  scalarScalar(op, dst, a, s, 0, n);
+}
+
+static double sumPlain(const double *a, int n) {
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += a[i];
+  }
+  return sum;
+}
+
+static double dotPlain(const double *a, const double *b, int n) {
+  double dot = 0;
+  for (int i = 0; i < n; i++) {
+    dot += a[i] * b[i];
+  }
+  return dot;
+}
+
+static const VectorOps plainOps = {
+    "scalar", binaryPlain, scalarPlain, sumPlain,
+    minPlain, maxPlain,    dotPlain,
+};
+#else
+
+// ---------------------------- sse2 kernels ------------------------------
+// sse2 is part of x86_64 so these need no cpu check
+
+static void binarySse2(VectorOp op, double *dst, const double *a,
+                       const double *b, int n) {
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d x = _mm_load_pd(a + i);
+    __m128d y = _mm_load_pd(b + i);
+    __m128d r;
+    switch (op) {
+    case VEC_ADD:
+      r = _mm_add_pd(x, y);
+      break;
+    case VEC_SUB:
+      r = _mm_sub_pd(x, y);
+      break;
+    case VEC_MUL:
+      r = _mm_mul_pd(x, y);
+      break;
+    case VEC_DIV:
+      r = _mm_div_pd(x, y);
+      break;
+    case VEC_RSUB:
+      r = _mm_sub_pd(y, x);
+      break;
+    default:
+      r = _mm_div_pd(y, x);
+      break;
+    }
+    _mm_store_pd(dst + i, r);
+  }
+  binaryScalar(op, dst, a, b, i, n);
+}
+
+static void scalarSse2(VectorOp op, double *dst, const double *a, double s,
+                       int n) {
+  __m128d y = _mm_set1_pd(s);
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d x = _mm_load_pd(a + i);
+    __m128d r;
+    switch (op) {
+    case VEC_ADD:
+      r = _mm_add_pd(x, y);
+      break;
+    case VEC_SUB:
+      r = _mm_sub_pd(x, y);
+      break;
+    case VEC_MUL:
+      r = _mm_mul_pd(x, y);
+      break;
+    case VEC_DIV:
+      r = _mm_div_pd(x, y);
+      break;
+    case VEC_RSUB:
+      r = _mm_sub_pd(y, x);
+      break;
+    default:
+      r = _mm_div_pd(y, x);
+      break;
+    }
+    _mm_store_pd(dst + i, r);
+  }
+  scalarScalar(op, dst, a, s, i, n);
+}
+
+static double sumSse2(const double *a, int n) {
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc0 = _mm_add_pd(acc0, _mm_load_pd(a + i));
+    acc1 = _mm_add_pd(acc1, _mm_load_pd(a + i + 2));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+  double sum = lanes[0] + lanes[1];
+  for (; i < n; i++) {
+    sum += a[i];
+  }
+  return sum;
+}
+
+static double minSse2(const double *a, int n) {
+  if (n < 2) {
+    return minPlain(a, n);
+  }
+  __m128d acc = _mm_load_pd(a);
+  int i = 2;
+  for (; i + 2 <= n; i += 2) {
+    acc = _mm_min_pd(acc, _mm_load_pd(a + i));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, acc);
+  double min = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+  for (; i < n; i++) {
+    min = a[i] < min ? a[i] : min;
+  }
+  return min;
+}
+
+static double maxSse2(const double *a, int n) {
+  if (n < 2) {
+    return maxPlain(a, n);
+  }
+  __m128d acc = _mm_load_pd(a);
+  int i = 2;
+  for (; i + 2 <= n; i += 2) {
+    acc = _mm_max_pd(acc, _mm_load_pd(a + i));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, acc);
+  double max = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+  for (; i < n; i++) {
+    max = a[i] > max ? a[i] : max;
+  }
+  return max;
+}
+
+static double dotSse2(const double *a, const double *b, int n) {
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_load_pd(a + i), _mm_load_pd(b + i)));
+    acc1 = _mm_add_pd(
+        acc1, _mm_mul_pd(_mm_load_pd(a + i + 2), _mm_load_pd(b + i + 2)));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+  double dot = lanes[0] + lanes[1];
+  for (; i < n; i++) {
+    dot += a[i] * b[i];
+  }
+  return dot;
+}
+
+static const VectorOps sse2Ops = {
+    "sse2", binarySse2, scalarSse2, sumSse2, minSse2, maxSse2, dotSse2,
+};
+
+// ---------------------------- avx2 kernels ------------------------------
+// compiled for avx2 only here, they run after the cpu check in vectorOps
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256d applyAvx2(VectorOp op, __m256d x, __m256d y) {
+  switch (op) {
+  case VEC_ADD:
+    return _mm256_add_pd(x, y);
+  case VEC_SUB:
+    return _mm256_sub_pd(x, y);
+  case VEC_MUL:
+    return _mm256_mul_pd(x, y);
+  case VEC_DIV:
+    return _mm256_div_pd(x, y);
+  case VEC_RSUB:
+    return _mm256_sub_pd(y, x);
+  default:
+    return _mm256_div_pd(y, x);
+  }
+}
+
+AVX2 static void binaryAvx2(VectorOp op, double *dst, const double *a,
+                            const double *b, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d r = applyAvx2(op, _mm256_load_pd(a + i), _mm256_load_pd(b + i));
+    _mm256_store_pd(dst + i, r);
+  }
+  binaryScalar(op, dst, a, b, i, n);
+}
+
+AVX2 static void scalarAvx2(VectorOp op, double *dst, const double *a,
+                            double s, int n) {
+  __m256d y = _mm256_set1_pd(s);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_store_pd(dst + i, applyAvx2(op, _mm256_load_pd(a + i), y));
+  }
+  scalarScalar(op, dst, a, s, i, n);
+}
+
+AVX2 static double sumAvx2(const double *a, int n) {
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm256_add_pd(acc0, _mm256_load_pd(a + i));
+    acc1 = _mm256_add_pd(acc1, _mm256_load_pd(a + i + 4));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+  double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for (; i < n; i++) {
+    sum += a[i];
+  }
+  return sum;
+}
+
+AVX2 static double minAvx2(const double *a, int n) {
+  if (n < 4) {
+    return minPlain(a, n);
+  }
+  __m256d acc = _mm256_load_pd(a);
+  int i = 4;
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_min_pd(acc, _mm256_load_pd(a + i));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, acc);
+  double min = lanes[0];
+  for (int l = 1; l < 4; l++) {
+    min = lanes[l] < min ? lanes[l] : min;
+  }
+  for (; i < n; i++) {
+    min = a[i] < min ? a[i] : min;
+  }
+  return min;
+}
+
+AVX2 static double maxAvx2(const double *a, int n) {
+  if (n < 4) {
+    return maxPlain(a, n);
+  }
+  __m256d acc = _mm256_load_pd(a);
+  int i = 4;
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_max_pd(acc, _mm256_load_pd(a + i));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, acc);
+  double max = lanes[0];
+  for (int l = 1; l < 4; l++) {
+    max = lanes[l] > max ? lanes[l] : max;
+  }
+  for (; i < n; i++) {
+    max = a[i] > max ? a[i] : max;
+  }
+  return max;
+}
+
+AVX2 static double dotAvx2(const double *a, const double *b, int n) {
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm256_add_pd(
+        acc0, _mm256_mul_pd(_mm256_load_pd(a + i), _mm256_load_pd(b + i)));
+    acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_load_pd(a + i + 4),
+                                             _mm256_load_pd(b + i + 4)));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+  double dot = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for (; i < n; i++) {
+    dot += a[i] * b[i];
+  }
+  return dot;
+}
+
+static const VectorOps avx2Ops = {
+    "avx2", binaryAvx2, scalarAvx2, sumAvx2, minAvx2, maxAvx2, dotAvx2,
+};
+#endif
+
+static const VectorOps *selectedOps = NULL;
+static pthread_once_t selectOnce = PTHREAD_ONCE_INIT;
+
+static void selectOps(void) {
+#ifdef VECTOR_X86
+  __builtin_cpu_init();
+  selectedOps = __builtin_cpu_supports("avx2") ? &avx2Ops : &sse2Ops;
+#else
+  selectedOps = &plainOps;
+#endif
+}
+
+// parfor workers can reach here at the same time
+const VectorOps *vectorOps(void) {
+  pthread_once(&selectOnce, selectOps);
+  return selectedOps;
+}
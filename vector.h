@@ -0,0 +1,30 @@
+#ifndef VECTOR_H_
+#define VECTOR_H_
+
+// elementwise operations of the whole-array kernels. the R forms take the
+// scalar on the left: s - a and s / a
+typedef enum VectorOp {
+  VEC_ADD,
+  VEC_SUB,
+  VEC_MUL,
+  VEC_DIV,
+  VEC_RSUB,
+  VEC_RDIV,
+} VectorOp;
+
+// kernels over unboxed double payloads. every pointer must be
+// ARRAY_ALIGNMENT aligned, as Array payloads are
+typedef struct VectorOps {
+  const char *name;
+  void (*binary)(VectorOp op, double *dst, const double *a, const double *b,
+                 int n);
+  void (*scalar)(VectorOp op, double *dst, const double *a, double s, int n);
+  double (*sum)(const double *a, int n);
+  double (*min)(const double *a, int n);
+  double (*max)(const double *a, int n);
+  double (*dot)(const double *a, const double *b, int n);
+} VectorOps;
+
+// picks the widest kernels the cpu supports on the first call
+const VectorOps *vectorOps(void);
+#endif // VECTOR_H_